@@ -0,0 +1,202 @@
+/** \file
+ *  Header file for \c adaptive_mutex.
+ *
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __MONADIC_ADAPTIVE_MUTEX_HPP_INCLUDED__
+#define __MONADIC_ADAPTIVE_MUTEX_HPP_INCLUDED__
+
+#include "futex.hpp"
+#include "spin_mutex.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace monadic
+{
+
+/** A mutex which spins for a while and then parks the thread on a futex. It has the same interface as \c spin_mutex,
+ *  but does not require you to know ahead of time whether the lock will be held for long.
+ *
+ *  Taking an uncontended lock is a single compare-and-swap, as with \c spin_mutex. A thread which finds the lock held
+ *  spins on it (test-and-test-and-set, with a processor pause hint) for up to \c spin_limit iterations, then goes to
+ *  sleep in the kernel until the owner unlocks it, so a thread waiting on an owner which has been descheduled (or which
+ *  holds the lock for a long time) does not burn a core.
+ *
+ *  The spin limit tunes itself from how long the lock has recently been held: every time a waiter gets the lock by
+ *  spinning, the estimate moves towards the number of iterations it took; every time a waiter gives up and parks, the
+ *  estimate decays. Locks which are held briefly end up spinning just long enough to avoid the cost of parking, while
+ *  locks which are held for long stop spinning almost immediately.
+ *
+ *  The lock word follows the usual three-state futex mutex protocol: 0 is unlocked, 1 is locked, and 2 is locked with
+ *  threads (possibly) parked on it. \c unlock only makes a system call in the last case.
+**/
+class adaptive_mutex
+{
+public:
+    using native_handle_type = std::atomic<std::uint32_t>*;
+
+    /** The fewest iterations a contended \c lock spins before parking. **/
+    static const std::uint32_t min_spins = 16;
+
+    /** The most iterations a contended \c lock spins before parking. **/
+    static const std::uint32_t max_spins = 4096;
+
+public:
+    adaptive_mutex() :
+            state_(unlocked),
+            spin_estimate_(min_spins * 8)
+    { }
+
+    adaptive_mutex(const adaptive_mutex&) = delete;
+    adaptive_mutex(adaptive_mutex&&)      = delete;
+    adaptive_mutex& operator=(const adaptive_mutex&) = delete;
+    adaptive_mutex& operator=(adaptive_mutex&&)      = delete;
+
+    /** Attempt to lock this mutex without waiting. When the lock is acquired, there is an acquire guarantee (pairing
+     *  with the release in \c unlock). If the lock is not acquired, there is no memory ordering guarantee.
+     *
+     *  \returns \c true if the lock was obtained; \c false if it was not (someone else holds the lock).
+    **/
+    bool try_lock()
+    {
+        std::uint32_t expected = unlocked;
+        return state_.load(std::memory_order_relaxed) == unlocked
+            && state_.compare_exchange_strong(expected, locked, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+
+    /** Attempt to acquire the lock on this mutex until the specified \a expiry_time, spinning and then parking. If the
+     *  given time is in the past, this function will still attempt to acquire the lock once.
+     *
+     *  \param expiry_time The absolute time to give up at. You most likely want to use a monotonic clock (such as
+     *    \c std::chrono::steady_clock) for this so you are not subject to NTP or other clock changes.
+     *
+     *  \returns \c true if the lock was obtained; \c false if it was not (someone else holds the lock).
+    **/
+    template <typename TClock, typename TDuration>
+    bool try_lock_until(const std::chrono::time_point<TClock, TDuration>& expiry_time)
+    {
+        if (try_lock() || spin_then_lock())
+            return true;
+
+        while (state_.exchange(contended, std::memory_order_acquire) != unlocked)
+        {
+            auto remaining = expiry_time - TClock::now();
+            if (remaining <= remaining.zero())
+                return false;
+            futex::wait_for(state_, contended, remaining);
+        }
+        return true;
+    }
+
+    /** Attempt to acquire the lock on this mutex for the specified \a duration.
+     *
+     *  \param duration The relative time to wait before giving up. The actual ticking time is based on
+     *    \c std::chrono::steady_clock.
+     *
+     *  \returns \c true if the lock was obtained; \c false if it was not (someone else holds the lock).
+    **/
+    template <typename TRep, typename TPeriod>
+    bool try_lock_for(const std::chrono::duration<TRep, TPeriod>& duration)
+    {
+        return try_lock_until(std::chrono::steady_clock::now() + duration);
+    }
+
+    /** Attempt to acquire the lock by spinning for the specified number of \a spins, without ever parking. This does
+     *  not use or update the self-tuned spin limit.
+     *
+     *  \param spins The number of times to check the lock before giving up.
+     *
+     *  \returns \c true if the lock was obtained; \c false if it was not (someone else holds the lock).
+    **/
+    bool try_lock_spins(std::size_t spins)
+    {
+        while (spins --> 0)
+        {
+            if (try_lock())
+                return true;
+            if (spins > 0)
+                detail::cpu_relax();
+        }
+        return false;
+    }
+
+    /** Acquire a lock on this mutex, spinning for up to \c spin_limit iterations and then parking until it is
+     *  available.
+    **/
+    void lock()
+    {
+        if (try_lock() || spin_then_lock())
+            return;
+
+        while (state_.exchange(contended, std::memory_order_acquire) != unlocked)
+            futex::wait(state_, contended);
+    }
+
+    /** Unlock this mutex, with a release guarantee, and wake one parked thread if there are any. There is no checking
+     *  that you actually own the mutex.
+    **/
+    void unlock()
+    {
+        if (state_.exchange(unlocked, std::memory_order_release) == contended)
+            futex::wake_one(state_);
+    }
+
+    /** The number of iterations a contended \c lock currently spins for before parking. **/
+    std::uint32_t spin_limit() const
+    {
+        std::uint32_t limit = min_spins + spin_estimate_.load(std::memory_order_relaxed) / 4;
+        return limit < max_spins ? limit : max_spins;
+    }
+
+    /** Get a pointer to the atomic variable that backs this mutex. Please do not edit it. **/
+    native_handle_type native_handle()
+    {
+        return &state_;
+    }
+
+private:
+    static const std::uint32_t unlocked  = 0;
+    static const std::uint32_t locked    = 1;
+    static const std::uint32_t contended = 2;
+
+    /** Spin for up to \c spin_limit iterations waiting for the lock to be released, and take it if it is. The estimate
+     *  is kept as 8 times the average number of iterations a spinning waiter needed (so the average is kept with
+     *  fractional precision), updated with a weight of 1/8 for each new sample; the limit is twice the average.
+     *
+     *  \returns \c true if the lock was obtained; \c false if the caller should park.
+    **/
+    bool spin_then_lock()
+    {
+        std::uint32_t limit    = spin_limit();
+        std::uint32_t estimate = spin_estimate_.load(std::memory_order_relaxed);
+        for (std::uint32_t spins = 1; spins <= limit; ++spins)
+        {
+            detail::cpu_relax();
+            if (try_lock())
+            {
+                spin_estimate_.store(estimate + spins - estimate / 8, std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        spin_estimate_.store(estimate - (estimate + 7) / 8, std::memory_order_relaxed);
+        return false;
+    }
+
+private:
+    std::atomic<std::uint32_t> state_;
+    std::atomic<std::uint32_t> spin_estimate_; //!< 8 times the recent average number of iterations spent spinning.
+};
+
+}
+
+#endif/*__MONADIC_ADAPTIVE_MUTEX_HPP_INCLUDED__*/
@@ -13,13 +13,19 @@
 #define __MONADIC_COMPLETION_HPP_INCLUDED__
 
 #include "exceptional.hpp"
+#include "executor.hpp"
+#include "futex.hpp"
+#include "inline_function.hpp"
 #include "scope_exit.hpp"
-#include "spin_mutex.hpp"
 
-#include <functional>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
 #include <future>
-#include <memory>
 #include <mutex>
+#include <stdexcept>
 #include <thread>
 #include <utility>
 
@@ -28,6 +34,7 @@ namespace monadic
 
 template <typename T> class completion;
 template <typename T> class completion_promise;
+template <typename T> class shared_completion;
 
 template <typename TCompletion, typename F>
 struct completion_map_result;
@@ -85,8 +92,12 @@ using completion_recover_result_t = typename completion_recover_result<TCompleti
  *    has_value -> complete    [label="map, flatmap, ..."]
  *  }
  *  \enddot
+ *  
+ *  Every transition is a single atomic operation on \c completion_data::state_, so neither the \c completion nor the
+ *  \c completion_promise ever waits on the other. Whichever side moves the state to \c complete owns the callback and
+ *  the value from then on. The state is 32 bits wide so that \c completion::get can block on it with a futex.
 **/
-enum class completion_state : unsigned char
+enum class completion_state : std::uint32_t
 {
     no_value,     //!< A \c completion_promise has been created, but neither a value nor a continuation have been set.
     has_value,    //!< The \c completion_promise has been delivered and is waiting for retrieval.
@@ -96,16 +107,677 @@ enum class completion_state : unsigned char
     broken,       //!< The \c completion_promise was destroyed with an active \c completion without having set the value.
 };
 
-/** Holds data for a \c completion or \c completion_promise. **/
+/** \def MONADIC_COMPLETION_CALLBACK_CAPACITY
+ *  The number of bytes reserved inside of each \c completion_data for its callback. Continuations whose function object
+ *  fits in this space (after the \c completion_promise the continuation delivers to and its link back upstream) are
+ *  stored without allocating. The default leaves room for a functor of 40 bytes in \c completion::then and
+ *  \c completion::map.
+**/
+#ifndef MONADIC_COMPLETION_CALLBACK_CAPACITY
+#   define MONADIC_COMPLETION_CALLBACK_CAPACITY 56
+#endif
+
 template <typename T>
-struct completion_data
+struct completion_data;
+
+/** Something which takes back a \c completion_data when its last reference is dropped, instead of it being deleted (see
+ *  \c completion_pool). This is a function pointer rather than a virtual function so that the \c recycle can be
+ *  bound by whatever owns the storage without \c completion_data knowing about it.
+**/
+template <typename T>
+struct completion_data_recycler
+{
+    void (*recycle)(completion_data_recycler* self, completion_data<T>* data) noexcept;
+};
+
+/** The part of \c completion_data which does not depend on the value type. This is what lets cancellation travel up a
+ *  chain of continuations (see \c completion::disable), whose links all have different value types.
+ *  
+ *  A \c completion returned from a continuation (such as \c completion::map) has a link in \c upstream_ to the
+ *  \c completion_data the continuation is attached to. The link does not hold a reference, since the upstream data
+ *  already holds one the other way (its callback owns the promise for this data). Instead, the continuation clears the
+ *  link with \c detach_upstream when it is destroyed, and \c take_upstream only uses the upstream data if it can still
+ *  get a reference to it. While \c take_upstream is looking at the upstream data, it parks \c this in \c upstream_, so
+ *  \c detach_upstream knows to wait for it.
+**/
+struct completion_data_base
 {
-    spin_mutex                             protect_;
-    completion_state                       state_;
+    /** The operations which need to know the value type. **/
+    struct operations
+    {
+        /** Move to \c disabled, dropping the callback if there is one. This does not touch \c upstream_.
+         *  
+         *  \returns the state before disabling.
+        **/
+        completion_state (*disable)(completion_data_base* self) noexcept;
+        
+        /** Drop a reference, destroying the instance if it was the last. **/
+        void (*release)(completion_data_base* self) noexcept;
+        
+        /** Call the callback with the value, then clear the callback. The caller must have claimed both. **/
+        void (*invoke)(completion_data_base* self);
+    };
+    
+    /** The callbacks which are waiting for the outermost \c invoke_callback on this thread to get around to them. **/
+    struct run_queue
+    {
+        bool                  active;
+        completion_data_base* head;
+        completion_data_base* tail;
+        std::exception_ptr    error; //!< The first exception thrown by a callback, for the outermost call to rethrow.
+        
+        static run_queue& local() noexcept
+        {
+            static thread_local run_queue instance = { false, nullptr, nullptr, nullptr };
+            return instance;
+        }
+        
+        /** Call every queued callback (including those queued by callbacks run here), keeping the first exception. **/
+        void drain() noexcept
+        {
+            while (completion_data_base* next = head)
+            {
+                head = next->next_queued_;
+                if (!head)
+                    tail = nullptr;
+                try
+                {
+                    next->ops_->invoke(next);
+                }
+                catch (...)
+                {
+                    if (!error)
+                        error = std::current_exception();
+                }
+                next->ops_->release(next);
+            }
+        }
+    };
+    
+    std::atomic<std::size_t>               refs_;
+    std::atomic<completion_state>          state_;
+    std::atomic<std::uint32_t>             waiters_;
+    const operations*                      ops_;
+    std::atomic<completion_data_base*>     upstream_;
+    completion_data_base*                  next_queued_; //!< The next entry in the \c run_queue this instance is in.
+    
+    completion_data_base(std::size_t initial_refs, const operations* ops) :
+            refs_(initial_refs),
+            state_(completion_state::no_value),
+            waiters_(0),
+            ops_(ops),
+            upstream_(nullptr),
+            next_queued_(nullptr)
+    { }
+    
+    completion_data_base(const completion_data_base&) = delete;
+    completion_data_base& operator=(const completion_data_base&) = delete;
+    
+    /** Wake any threads blocked in \c completion::wait on \c state_. This must be called after moving \c state_ away
+     *  from \c no_value with a sequentially-consistent operation, which pairs with the sequentially-consistent
+     *  increment of \c waiters_ in the waiting thread (so either we see the waiter or the waiter sees the new state).
+    **/
+    void wake_waiters()
+    {
+        if (waiters_.load(std::memory_order_seq_cst) != 0)
+            futex::wake_all(state_);
+    }
+    
+    /** Get a new reference, unless the count has already dropped to 0 (the instance is being destroyed). **/
+    bool try_add_ref() noexcept
+    {
+        std::size_t refs = refs_.load(std::memory_order_relaxed);
+        while (refs != 0)
+        {
+            if (refs_.compare_exchange_weak(refs, refs + 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+                return true;
+        }
+        return false;
+    }
+    
+    /** Clear the link to the upstream data. If \c take_upstream is looking at it, wait for it to finish. **/
+    void detach_upstream() noexcept
+    {
+        completion_data_base* upstream = upstream_.load(std::memory_order_acquire);
+        while (upstream)
+        {
+            if (upstream == this)
+            {
+                std::this_thread::yield();
+                upstream = upstream_.load(std::memory_order_acquire);
+            }
+            else if (upstream_.compare_exchange_weak(upstream,
+                                                     nullptr,
+                                                     std::memory_order_acq_rel,
+                                                     std::memory_order_acquire
+                                                    )
+                    )
+            {
+                return;
+            }
+        }
+    }
+    
+    /** Clear the link to the upstream data and return it with a reference held (or \c nullptr if there is none). **/
+    completion_data_base* take_upstream() noexcept
+    {
+        completion_data_base* upstream = upstream_.load(std::memory_order_acquire);
+        while (true)
+        {
+            // If another thread is already taking it, that thread will do the cancelling.
+            if (!upstream || upstream == this)
+                return nullptr;
+            if (upstream_.compare_exchange_weak(upstream, this, std::memory_order_acq_rel, std::memory_order_acquire))
+                break;
+        }
+        
+        bool alive = upstream->try_add_ref();
+        upstream_.store(nullptr, std::memory_order_release);
+        return alive ? upstream : nullptr;
+    }
+    
+    /** Check if an instance which was in \a prev when it was disabled could still have a live link upstream. Once a
+     *  value has been delivered, the continuation which delivered it is free to go away without clearing the link (see
+     *  \c completion_upstream_link::dismiss), so the link must not be followed.
+    **/
+    static bool still_upstream(completion_state prev) noexcept
+    {
+        return prev == completion_state::no_value || prev == completion_state::has_callback;
+    }
+    
+    /** Call the callback, which the calling thread has claimed along with the value. Continuations complete the promise
+     *  for the next link from inside of their callback, so calling each callback directly would recurse once per link
+     *  and a long enough chain would overflow the stack. Instead, only the outermost call on a thread calls its
+     *  callback directly; nested calls go into the thread's \c run_queue (holding a reference, since the continuation
+     *  which completed the promise is about to let go of it) and the outermost call runs them once its own callback
+     *  returns. Stack usage does not depend on the length of the chain, and every callback has run by the time the
+     *  outermost call returns.
+     *
+     *  If callbacks throw, the rest of the queue still runs and the first exception is rethrown at the end.
+     *
+     *  A callback which blocks waiting for a value (with \c completion::get or \c completion::wait) would wait forever
+     *  if that value's delivery were sitting in the queue behind it, so the blocking functions call \c run_pending
+     *  first.
+    **/
+    void invoke_callback()
+    {
+        run_queue& queue = run_queue::local();
+        if (queue.active)
+        {
+            refs_.fetch_add(1, std::memory_order_relaxed);
+            next_queued_ = nullptr;
+            if (queue.tail)
+                queue.tail->next_queued_ = this;
+            else
+                queue.head = this;
+            queue.tail = this;
+            return;
+        }
+        
+        queue.active = true;
+        try
+        {
+            ops_->invoke(this);
+        }
+        catch (...)
+        {
+            queue.error = std::current_exception();
+        }
+        queue.drain();
+        queue.active = false;
+        if (queue.error)
+        {
+            std::exception_ptr error = std::move(queue.error);
+            queue.error = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+    
+    /** Run the callbacks queued on this thread by \c invoke_callback, if it is inside of one. This is called before
+     *  blocking, since the value being waited for might be in the queue. Exceptions are kept for the outermost
+     *  \c invoke_callback to rethrow, as they would be had the callbacks run later.
+    **/
+    static void run_pending() noexcept
+    {
+        run_queue& queue = run_queue::local();
+        if (queue.active)
+            queue.drain();
+    }
+    
+    /** Disable this instance and every instance upstream of it. This walks the chain in a loop instead of recursing,
+     *  so a long chain can not overflow the stack.
+     *
+     *  \returns \c true if this stopped a value from being delivered to this instance; \c false if one already had
+     *    been (or this instance was already disabled).
+    **/
+    bool cancel() noexcept
+    {
+        if (!still_upstream(ops_->disable(this)))
+            return false;
+        
+        for (completion_data_base* upstream = take_upstream(); upstream; )
+        {
+            completion_data_base* next = still_upstream(upstream->ops_->disable(upstream)) ? upstream->take_upstream()
+                                                                                            : nullptr;
+            upstream->ops_->release(upstream);
+            upstream = next;
+        }
+        return true;
+    }
+};
+
+/** Holds data for a \c completion or \c completion_promise. The data carries its own reference count, which is managed
+ *  by \c completion_data_ptr -- this keeps a \c completion down to a single pointer and means the only allocation for a
+ *  \c completion_promise is the \c completion_data itself.
+**/
+template <typename T>
+struct completion_data :
+        completion_data_base
+{
+    using callback_type = inline_function<void (exceptional<T>&&), MONADIC_COMPLETION_CALLBACK_CAPACITY>;
+    
+    completion_data_recycler<T>*           recycler_;
     exceptional<T>                         value_;
-    std::function<void (exceptional<T>&&)> callback_;
+    callback_type                          callback_;
+    
+    /** Create an instance in the \c no_value state with the given initial reference count. If a \a recycler is given,
+     *  it is handed this instance when the last reference is dropped; otherwise, the instance must have been allocated
+     *  with \c new.
+    **/
+    explicit completion_data(std::size_t initial_refs = 0, completion_data_recycler<T>* recycler = nullptr) :
+            completion_data_base(initial_refs, &ops),
+            recycler_(recycler ? recycler : &deleter)
+    { }
+    
+    /** Move to \c disabled. If a callback was waiting, the exchange makes it ours -- the promise can no longer claim
+     *  it.
+     *  
+     *  \returns the state before disabling.
+    **/
+    completion_state disable() noexcept
+    {
+        completion_state prev = state_.exchange(completion_state::disabled, std::memory_order_seq_cst);
+        if (prev == completion_state::has_callback)
+            callback_ = nullptr;
+        else if (prev == completion_state::no_value)
+            wake_waiters();
+        return prev;
+    }
+    
+    /** Drop a reference, destroying (or recycling) this instance if it was the last. **/
+    void release() noexcept
+    {
+        // If we hold the only reference, nobody else can be touching the count, so we can skip the atomic decrement.
+        // The exception is while a continuation is attached: \c take_upstream can get a new reference at any time.
+        if ((state_.load(std::memory_order_relaxed) != completion_state::has_callback
+             && refs_.load(std::memory_order_acquire) == 1
+            )
+           || refs_.fetch_sub(1, std::memory_order_acq_rel) == 1
+           )
+        {
+            recycler_->recycle(recycler_, this);
+        }
+    }
+    
+private:
+    static completion_state disable_impl(completion_data_base* self) noexcept
+    {
+        return static_cast<completion_data*>(self)->disable();
+    }
+    
+    static void release_impl(completion_data_base* self) noexcept
+    {
+        static_cast<completion_data*>(self)->release();
+    }
+    
+    static void invoke_impl(completion_data_base* self)
+    {
+        completion_data* data = static_cast<completion_data*>(self);
+        auto clear_callback = on_scope_exit([data] { data->callback_ = nullptr; });
+        data->callback_(std::move(data->value_));
+    }
+    
+    static void delete_impl(completion_data_recycler<T>*, completion_data* self) noexcept
+    {
+        delete self;
+    }
+    
+    static const operations ops;
+    
+    /** The recycler of instances which were allocated with \c new. Always going through a recycler, rather than
+     *  deciding between recycling and \c delete here, keeps the compiler from seeing a \c delete of a
+     *  \c completion_data which lives inside of something else (such as a coroutine frame).
+    **/
+    static completion_data_recycler<T> deleter;
+};
+
+template <typename T>
+const completion_data_base::operations completion_data<T>::ops = { &completion_data<T>::disable_impl,
+                                                                    &completion_data<T>::release_impl,
+                                                                    &completion_data<T>::invoke_impl
+                                                                  };
+
+template <typename T>
+completion_data_recycler<T> completion_data<T>::deleter = { &completion_data<T>::delete_impl };
+
+/** An intrusive, reference-counting pointer to a \c completion_data. It behaves like an \c std::shared_ptr, but the
+ *  count lives inside of the pointed-to \c completion_data, so there is no separate control block.
+**/
+template <typename T>
+class completion_data_ptr
+{
+public:
+    using element_type = completion_data<T>;
+    
+public:
+    completion_data_ptr() noexcept :
+            ptr_(nullptr)
+    { }
+    
+    /** Take a reference to \a ptr, which must have been allocated with \c new (or have a \c recycler_). **/
+    explicit completion_data_ptr(element_type* ptr) noexcept :
+            ptr_(ptr)
+    {
+        if (ptr_)
+            ptr_->refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    /** Take over a reference to \a ptr which has already been counted (as in a freshly-created \c completion_data
+     *  whose count was initialized to 1), skipping the atomic increment.
+    **/
+    completion_data_ptr(element_type* ptr, const std::adopt_lock_t&) noexcept :
+            ptr_(ptr)
+    { }
+    
+    completion_data_ptr(const completion_data_ptr& src) noexcept :
+            completion_data_ptr(src.ptr_)
+    { }
+    
+    completion_data_ptr(completion_data_ptr&& src) noexcept :
+            ptr_(src.ptr_)
+    {
+        src.ptr_ = nullptr;
+    }
+    
+    completion_data_ptr& operator=(completion_data_ptr src) noexcept
+    {
+        std::swap(ptr_, src.ptr_);
+        return *this;
+    }
+    
+    ~completion_data_ptr() noexcept
+    {
+        if (ptr_)
+            ptr_->release();
+    }
+    
+    element_type* get() const noexcept
+    {
+        return ptr_;
+    }
+    
+    element_type* operator->() const noexcept
+    {
+        return ptr_;
+    }
+    
+    element_type& operator*() const noexcept
+    {
+        return *ptr_;
+    }
+    
+    explicit operator bool() const noexcept
+    {
+        return ptr_ != nullptr;
+    }
+    
+private:
+    element_type* ptr_;
 };
 
+/** Allocate a fresh \c completion_data in the \c no_value state. **/
+template <typename T>
+completion_data_ptr<T> make_completion_data()
+{
+    return completion_data_ptr<T>(new completion_data<T>(1), std::adopt_lock);
+}
+
+namespace detail
+{
+
+/** Owned by a continuation: clears the link from the data of the continuation's promise back to the data the
+ *  continuation is attached to (see \c completion_data_base) when the continuation goes away. It must be declared after
+ *  the promise, so that it is destroyed before the promise can let go of the data.
+**/
+class completion_upstream_link
+{
+public:
+    explicit completion_upstream_link(completion_data_base* downstream) noexcept :
+            downstream_(downstream)
+    { }
+    
+    completion_upstream_link(completion_upstream_link&& src) noexcept :
+            downstream_(src.downstream_)
+    {
+        src.downstream_ = nullptr;
+    }
+    
+    completion_upstream_link(const completion_upstream_link&) = delete;
+    completion_upstream_link& operator=(const completion_upstream_link&) = delete;
+    
+    ~completion_upstream_link() noexcept
+    {
+        reset();
+    }
+    
+    void reset() noexcept
+    {
+        if (downstream_)
+        {
+            downstream_->detach_upstream();
+            downstream_ = nullptr;
+        }
+    }
+    
+    /** Let go of the link without clearing it. This is only safe once a value has been delivered to the downstream
+     *  data, since \c completion_data_base::cancel stops following the link at that point.
+    **/
+    void dismiss() noexcept
+    {
+        downstream_ = nullptr;
+    }
+    
+private:
+    completion_data_base* downstream_;
+};
+
+/** The callback a continuation installs: it delivers the result of calling \c step_ to \c promise_. The \c Step turns
+ *  an <tt>exceptional&lt;T&gt;</tt> into an <tt>exceptional&lt;TResult&gt;</tt> without throwing, so a failure is
+ *  passed along by moving its \c std::exception_ptr instead of rethrowing it. This is a named type instead of a lambda
+ *  so that a move-only \c Step can be moved into it. If the \c completion for \c promise_ has been disabled, the step
+ *  is skipped entirely.
+**/
+template <typename T, typename TResult, typename Step>
+struct completion_continuation
+{
+    completion_promise<TResult> promise_;
+    Step                        step_;
+    completion_upstream_link    link_;
+    
+    void operator()(exceptional<T>&& result)
+    {
+        // Clearing the link is an extra atomic operation on every hop, so skip it if the value made it downstream.
+        if (!promise_.is_cancelled() && promise_.complete(step_(std::move(result))))
+            link_.dismiss();
+    }
+};
+
+/** The task a continuation on an executor hands to that executor: run \c step_ on the delivered \c value_ and deliver
+ *  the result to \c promise_.
+**/
+template <typename T, typename TResult, typename Step>
+struct completion_executor_task
+{
+    completion_promise<TResult> promise_;
+    Step                        step_;
+    exceptional<T>              value_;
+    
+    void operator()()
+    {
+        if (!promise_.is_cancelled())
+            promise_.complete(step_(std::move(value_)));
+    }
+};
+
+/** The callback a continuation on an executor installs: instead of running \c step_ inline, it packages the step and
+ *  the delivered value into a \c completion_executor_task and gives it to \c executor_.
+**/
+template <typename T, typename TResult, typename Step, typename Executor>
+struct completion_executor_continuation
+{
+    completion_promise<TResult> promise_;
+    Step                        step_;
+    Executor*                   executor_;
+    completion_upstream_link    link_;
+    
+    void operator()(exceptional<T>&& result)
+    {
+        // The value is here, so there is nothing upstream left to cancel -- and promise_ is about to be moved away. If
+        // the promise has been cancelled, the task checks for it before running the step.
+        link_.reset();
+        using task_type = completion_executor_task<T, TResult, Step>;
+        executor_->execute(task_type { std::move(promise_), std::move(step_), std::move(result) });
+    }
+};
+
+/** The step for \c completion::via: deliver the value as-is. **/
+struct completion_identity_step
+{
+    template <typename T>
+    exceptional<T> operator()(exceptional<T>&& result) const noexcept
+    {
+        return std::move(result);
+    }
+};
+
+/** The step for \c completion::then: call \c func_ and capture its result (or whatever it throws). **/
+template <typename Func>
+struct completion_try_step
+{
+    Func func_;
+    
+    template <typename T>
+    auto operator()(exceptional<T>&& result)
+            -> decltype(monadic::try_to(std::declval<Func&>(), std::move(result)))
+    {
+        return monadic::try_to(func_, std::move(result));
+    }
+};
+
+/** The step for \c completion::map: call \c func_ with the value if there is one. **/
+template <typename Func>
+struct completion_map_step
+{
+    Func func_;
+    
+    template <typename T>
+    auto operator()(exceptional<T>&& result)
+            -> decltype(std::move(result).map(std::declval<Func&>()))
+    {
+        return std::move(result).map(func_);
+    }
+};
+
+/** The step for \c completion::recover: call \c func_ with the exception if there is one. **/
+template <typename Func>
+struct completion_recover_step
+{
+    Func func_;
+    
+    template <typename T>
+    auto operator()(exceptional<T>&& result)
+            -> decltype(std::move(result).recover(std::declval<Func&>()))
+    {
+        return std::move(result).recover(func_);
+    }
+};
+
+/** The step for \c completion::pipe: run each of the \c Steps in turn, feeding the result of one into the next. The
+ *  whole pipeline is a single function object, so it takes a single continuation.
+**/
+template <typename... Steps>
+struct completion_pipe_step;
+
+template <typename Step>
+struct completion_pipe_step<Step>
+{
+    Step step_;
+    
+    template <typename T>
+    auto operator()(exceptional<T>&& result)
+            -> decltype(std::declval<Step&>()(std::move(result)))
+    {
+        return step_(std::move(result));
+    }
+};
+
+template <typename Step, typename... Rest>
+struct completion_pipe_step<Step, Rest...>
+{
+    Step                          first_;
+    completion_pipe_step<Rest...> rest_;
+    
+    template <typename T>
+    auto operator()(exceptional<T>&& result)
+            -> decltype(std::declval<completion_pipe_step<Rest...>&>()(std::declval<Step&>()(std::move(result))))
+    {
+        return rest_(first_(std::move(result)));
+    }
+};
+
+/** The value type of the \c exceptional a \c Step produces from an <tt>exceptional&lt;T&gt;</tt>. **/
+template <typename Step, typename T>
+using completion_step_result_t = typename decltype(std::declval<Step&>()(std::declval<exceptional<T>>()))::value_type;
+
+template <typename... Stages>
+using completion_pipe_step_t = completion_pipe_step<typename std::decay<Stages>::type...>;
+
+template <typename Step>
+completion_pipe_step<typename std::decay<Step>::type> make_completion_pipe_step(Step&& step)
+{
+    return { std::forward<Step>(step) };
+}
+
+template <typename Step, typename... Rest>
+completion_pipe_step<typename std::decay<Step>::type, typename std::decay<Rest>::type...>
+make_completion_pipe_step(Step&& step, Rest&&... rest)
+{
+    return { std::forward<Step>(step), make_completion_pipe_step(std::forward<Rest>(rest)...) };
+}
+
+}
+
+/** A stage of \c completion::pipe which works like \c completion::map. **/
+template <typename Func>
+detail::completion_map_step<typename std::decay<Func>::type> map(Func&& func)
+{
+    return { std::forward<Func>(func) };
+}
+
+/** A stage of \c completion::pipe which works like \c completion::recover. **/
+template <typename Func>
+detail::completion_recover_step<typename std::decay<Func>::type> recover(Func&& func)
+{
+    return { std::forward<Func>(func) };
+}
+
+/** A stage of \c completion::pipe which works like \c completion::then. **/
+template <typename Func>
+detail::completion_try_step<typename std::decay<Func>::type> then(Func&& func)
+{
+    return { std::forward<Func>(func) };
+}
+
 /** A \c completion is a monadic version of a \c std::future. It can \e mostly be used as a drop-in replacement for a
  *  \c std::future, with the added benefit of having functions like \c map and \c recover.
 **/
@@ -120,7 +792,7 @@ public:
     /** Get the current state of this instance. **/
     completion_state state() const
     {
-        return impl_->state_;
+        return impl_->state_.load(std::memory_order_acquire);
     }
     
     /** Call a given \a func with an <tt>exceptional&lt;T&gt;</tt> when this \c completion is delivered (in either
@@ -131,15 +803,15 @@ public:
     template <typename Func>
     void on_complete(Func&& func)
     {
-        unique_lock lock(impl_->protect_);
-        if (impl_->state_ == completion_state::no_value)
+        completion_state state = impl_->state_.load(std::memory_order_acquire);
+        if (state == completion_state::no_value)
         {
             impl_->callback_ = std::forward<Func>(func);
-            impl_->state_    = completion_state::has_callback;
+            publish_callback("invalid state to call completion::on_complete");
         }
-        else if (impl_->state_ == completion_state::has_value)
+        else if (state == completion_state::has_value)
         {
-            auto completer = on_scope_exit([this] { impl_->state_ = completion_state::complete; });
+            mark_complete();
             std::forward<Func>(func)(std::move(impl_->value_));
         }
         else
@@ -154,26 +826,116 @@ public:
      *  
      *  \note
      *  This is \e not the intended use for a \c completion and only exists for convenient compatibility with
-     *  \c std::future. While the majority of \c completion functions are implemented using spin locks, this function is
-     *  expected to block, so it relies on \c std::promise and \c std::future, which are slow by comparison.
+     *  \c std::future. The calling thread parks directly on the state of this completion (using a futex on Linux), so
+     *  no other allocation or synchronization object is needed.
+     *  
+     *  \throws std::logic_error if a continuation has already been attached or this completion is disabled.
     **/
     T get()
     {
-        std::promise<exceptional<T>> promise;
-        on_complete([&promise] (exceptional<T>&& src) { promise.set_value(std::move(src)); });
-        return promise.get_future().get().get();
+        wait();
+        if (impl_->state_.load(std::memory_order_acquire) != completion_state::has_value)
+            throw std::logic_error("invalid state to call completion::get");
+        
+        auto completer = on_scope_exit([this] { mark_complete(); });
+        return std::move(impl_->value_).get();
+    }
+    
+    /** Block until the value of this completion has been delivered (or it is disabled). This does not consume the
+     *  value -- it is still available for \c get or a continuation.
+     *  
+     *  \throws std::logic_error if a continuation has already been attached, since the value goes straight to it and
+     *                          this completion never holds it.
+    **/
+    void wait() const
+    {
+        completion_state state = impl_->state_.load(std::memory_order_acquire);
+        if (state == completion_state::has_callback)
+            throw std::logic_error("invalid state to call completion::wait");
+        if (state != completion_state::no_value)
+            return;
+        
+        completion_data_base::run_pending();
+        impl_->waiters_.fetch_add(1, std::memory_order_seq_cst);
+        auto unregister = on_scope_exit([this] { impl_->waiters_.fetch_sub(1, std::memory_order_relaxed); });
+        while (impl_->state_.load(std::memory_order_seq_cst) == completion_state::no_value)
+            futex::wait(impl_->state_, completion_state::no_value);
+    }
+    
+    /** Block until the value of this completion has been delivered or \a duration has passed. Like \c wait, this does
+     *  not consume the value.
+     *  
+     *  \returns \c std::future_status::ready if the value was delivered; \c std::future_status::timeout if it was not.
+     *  \throws std::logic_error if a continuation has already been attached, like \c wait.
+    **/
+    template <typename TRep, typename TPeriod>
+    std::future_status wait_for(const std::chrono::duration<TRep, TPeriod>& duration) const
+    {
+        return wait_until(std::chrono::steady_clock::now() + duration);
+    }
+    
+    /** Block until the value of this completion has been delivered or the \a expiry_time has been reached. Like
+     *  \c wait, this does not consume the value.
+     *  
+     *  \returns \c std::future_status::ready if the value was delivered; \c std::future_status::timeout if it was not.
+     *  \throws std::logic_error if a continuation has already been attached, like \c wait.
+    **/
+    template <typename TClock, typename TDuration>
+    std::future_status wait_until(const std::chrono::time_point<TClock, TDuration>& expiry_time) const
+    {
+        completion_state state = impl_->state_.load(std::memory_order_acquire);
+        if (state == completion_state::has_callback)
+            throw std::logic_error("invalid state to call completion::wait_until");
+        if (state != completion_state::no_value)
+            return std::future_status::ready;
+        
+        completion_data_base::run_pending();
+        impl_->waiters_.fetch_add(1, std::memory_order_seq_cst);
+        auto unregister = on_scope_exit([this] { impl_->waiters_.fetch_sub(1, std::memory_order_relaxed); });
+        while (impl_->state_.load(std::memory_order_seq_cst) == completion_state::no_value)
+        {
+            auto remaining = expiry_time - TClock::now();
+            if (remaining <= decltype(remaining)::zero())
+                return std::future_status::timeout;
+            futex::wait_for(impl_->state_, completion_state::no_value, remaining);
+        }
+        return std::future_status::ready;
     }
     
     /** Disables this \c completion. It cannot be un-disabled! This is useful for notifying the thread fulfilling the
      *  promise that the receiver no longer cares about the value and is free to abandon processing.
+     *  
+     *  If this \c completion came from a continuation (such as \c map or \c then_on), the \c completion the
+     *  continuation was attached to is disabled too, and so on up the chain. Continuations which have not run yet are
+     *  dropped without running, and the \c completion_promise at the head of the chain sees \c is_cancelled.
+     *
+     *  \returns \c true if this stopped a value from being delivered; \c false if a value had already been delivered
+     *    (any callback given to \c on_complete will still be called with it) or this was already disabled.
     **/
-    void disable()
+    bool disable()
     {
-        unique_lock lock(impl_->protect_);
-        impl_->state_ = completion_state::disabled;
-        impl_->callback_ = nullptr;
+        return impl_->cancel();
     }
-    
+
+    /** Get a \c completion which is delivered the same value as this one, unless \a timeout passes first, in which case
+     *  it fails with a \c completion_timeout and this \c completion is disabled. This \c completion is consumed.
+     *
+     *  \param timer The \c timer_wheel (or anything with the same \c within) which keeps track of the deadline.
+     *
+     *  \see timer_wheel::within
+    **/
+    template <typename Timer, typename TRep, typename TPeriod>
+    completion<T> within(Timer& timer, const std::chrono::duration<TRep, TPeriod>& timeout)
+    {
+        return timer.within(std::move(*this), timeout);
+    }
+
+    /** Turn this \c completion into a \c shared_completion, so the value can be given to any number of continuations.
+     *  This \c completion is consumed. This is only usable with <tt>&lt;monadic/shared_completion.hpp&gt;</tt>
+     *  included.
+    **/
+    shared_completion<T> share();
+
     /** Perform the next step of the process when the value is delivered in either success or failure.
      *  
      *  \see map
@@ -183,30 +945,42 @@ public:
     auto then(Func&& func)
             -> completion<decltype(func(std::declval<exceptional<T>>()))>
     {
-        using TResultPromise = typename completion<decltype(func(std::declval<exceptional<T>>()))>::promise_type;
-        
-        unique_lock lock(impl_->protect_);
-        if (impl_->state_ == completion_state::no_value)
-        {
-            TResultPromise result_promise;
-            impl_->callback_ = [result_promise, func] (exceptional<T>&& result) mutable
-                               {
-                                   result_promise.complete(try_to(std::move(func), std::move(result)));
-                               };
-            impl_->state_ = completion_state::has_callback;
-            return result_promise.get_completion();
-        }
-        else if (impl_->state_ == completion_state::has_value)
-        {
-            TResultPromise result_promise;
-            result_promise.complete(try_to(std::move(func), std::move(impl_->value_)));
-            impl_->state_ = completion_state::complete;
-            return result_promise.get_completion();
-        }
-        else
-        {
-            throw std::logic_error("invalid state to continue a completion");
-        }
+        using result_type = decltype(func(std::declval<exceptional<T>>()));
+        using step_type   = detail::completion_try_step<typename std::decay<Func>::type>;
+        return continue_with<result_type>(step_type { std::forward<Func>(func) });
+    }
+    
+    /** Like \c then, but \a func is run by \a exec instead of inline on the thread which delivers the value (or, if the
+     *  value has already been delivered, on the thread calling this function).
+     *  
+     *  \param exec Any type satisfying the \ref executors "Executor" concept. It must outlive this continuation.
+     *  
+     *  \see then
+    **/
+    template <typename Executor, typename Func>
+    auto then_on(Executor& exec, Func&& func)
+            -> completion<decltype(func(std::declval<exceptional<T>>()))>
+    {
+        using result_type = decltype(func(std::declval<exceptional<T>>()));
+        using step_type   = detail::completion_try_step<typename std::decay<Func>::type>;
+        return continue_on<result_type>(exec, step_type { std::forward<Func>(func) });
+    }
+    
+    /** Get a \c completion which is delivered the same value as this one, but from \a exec. Continuations attached to
+     *  the returned \c completion run on \a exec, which lets the thread fulfilling the promise get back to work.
+     *  
+     *  \code
+     *  completion<response> c = send_request(...)   // delivered by the I/O thread
+     *                            .via(worker_pool)  // ...so get off of it quickly
+     *                            .map(parse_response);
+     *  \endcode
+     *  
+     *  \param exec Any type satisfying the \ref executors "Executor" concept. It must outlive this continuation.
+    **/
+    template <typename Executor>
+    completion<T> via(Executor& exec)
+    {
+        return continue_on<T>(exec, detail::completion_identity_step());
     }
     
     /** Perform the next step of the process when the value is delivered in success. The \a func is only called in the
@@ -237,8 +1011,8 @@ public:
     template <typename Func>
     completion_map_result_t<completion, Func> map(Func&& func)
     {
-        // TODO: Optimize the return when there is an exception -- currently this re-throws just to catch it inside then
-        return then([func] (exceptional<T> x) { return std::move(x).map(func).get(); });
+        using result_type = typename completion_map_result<completion, Func>::value_type;
+        return continue_with<result_type>(monadic::map(std::forward<Func>(func)));
     }
     
     /** Perform the next step of the process if the value is delivered in failure. The \a func is only called in the
@@ -289,22 +1063,211 @@ public:
     template <typename Func>
     completion_recover_result_t<completion, Func> recover(Func&& func)
     {
-        // TODO: Optimize the return when there is an exception -- currently this re-throws just to catch it inside then
-        return then([func] (exceptional<T> x) { return std::move(x).recover(func).get(); });
+        using result_type = typename completion_recover_result<completion, Func>::value_type;
+        return continue_with<result_type>(monadic::recover(std::forward<Func>(func)));
+    }
+    
+    /** Attach several steps at once: each of the \a stages (made with \c monadic::map, \c monadic::recover and
+     *  \c monadic::then) is fed the result of the one before it, and the returned \c completion is delivered the result
+     *  of the last one. It behaves the same as chaining the member functions of the same names, but the stages are
+     *  composed into a single continuation at compile time, so the whole pipeline allocates one \c completion_data
+     *  instead of one for each stage.
+     *  
+     *  \code
+     *  completion<std::string> body = fetch(url).pipe(map(decompress),
+     *                                                 map(decode_utf8),
+     *                                                 recover([] (std::exception_ptr) { return std::string(); })
+     *                                                );
+     *  \endcode
+     *  
+     *  \note
+     *  The intermediate results are not available as \c completion instances, so they can not be disabled or waited on
+     *  individually -- disabling the returned \c completion skips the whole pipeline.
+    **/
+    template <typename... Stages>
+    auto pipe(Stages&&... stages)
+            -> completion<detail::completion_step_result_t<detail::completion_pipe_step_t<Stages...>, T>>
+    {
+        using step_type   = detail::completion_pipe_step_t<Stages...>;
+        using result_type = detail::completion_step_result_t<step_type, T>;
+        return continue_with<result_type>(detail::make_completion_pipe_step(std::forward<Stages>(stages)...));
+    }
+    
+    /** Like \c map, but \a func is run by \a exec.
+     *  
+     *  \see map
+     *  \see then_on
+    **/
+    template <typename Executor, typename Func>
+    completion_map_result_t<completion, Func> map_on(Executor& exec, Func&& func)
+    {
+        using result_type = typename completion_map_result<completion, Func>::value_type;
+        return continue_on<result_type>(exec, monadic::map(std::forward<Func>(func)));
+    }
+    
+    /** Like \c recover, but \a func is run by \a exec.
+     *  
+     *  \see recover
+     *  \see then_on
+    **/
+    template <typename Executor, typename Func>
+    completion_recover_result_t<completion, Func> recover_on(Executor& exec, Func&& func)
+    {
+        using result_type = typename completion_recover_result<completion, Func>::value_type;
+        return continue_on<result_type>(exec, monadic::recover(std::forward<Func>(func)));
     }
     
 private:
     template <typename U>
-    friend class completion_promise;
+    friend class completion;
     
-    using unique_lock = std::unique_lock<spin_mutex>;
+    template <typename U>
+    friend class completion_promise;
     
-    completion(std::shared_ptr<completion_data<T>> impl) :
+    completion(completion_data_ptr<T> impl) :
             impl_(std::move(impl))
     { }
     
+    /** Attach a \a step which turns the delivered <tt>exceptional&lt;T&gt;</tt> into an
+     *  <tt>exceptional&lt;TResult&gt;</tt> without throwing. The result of the \a step is delivered to the returned
+     *  \c completion. This is the common implementation of \c then, \c map and \c recover.
+    **/
+    template <typename TResult, typename Step>
+    completion<TResult> continue_with(Step&& step)
+    {
+        completion_state state = impl_->state_.load(std::memory_order_acquire);
+        if (state == completion_state::no_value)
+        {
+            completion_promise<TResult> result_promise;
+            auto result = result_promise.get_completion();
+            completion_data_base* result_data = result_promise.impl_.get();
+            result_data->upstream_.store(impl_.get(), std::memory_order_relaxed);
+            using callback_type = detail::completion_continuation<T, TResult, typename std::decay<Step>::type>;
+            impl_->callback_ = callback_type { std::move(result_promise),
+                                               std::forward<Step>(step),
+                                               detail::completion_upstream_link(result_data)
+                                             };
+            publish_callback("invalid state to continue a completion");
+            return result;
+        }
+        else if (state == completion_state::has_value)
+        {
+            mark_complete();
+            completion_promise<TResult> result_promise;
+            result_promise.complete(step(std::move(impl_->value_)));
+            return result_promise.get_completion();
+        }
+        else
+        {
+            throw std::logic_error("invalid state to continue a completion");
+        }
+    }
+    
+    /** Like \c continue_with, but the \a step is run by \a exec. **/
+    template <typename TResult, typename Executor, typename Step>
+    completion<TResult> continue_on(Executor& exec, Step&& step)
+    {
+        using step_type     = typename std::decay<Step>::type;
+        using callback_type = detail::completion_executor_continuation<T, TResult, step_type, Executor>;
+        
+        completion_promise<TResult> result_promise;
+        auto result = result_promise.get_completion();
+        completion_data_base* result_data = result_promise.impl_.get();
+        result_data->upstream_.store(impl_.get(), std::memory_order_relaxed);
+        on_complete(callback_type { std::move(result_promise),
+                                    std::forward<Step>(step),
+                                    &exec,
+                                    detail::completion_upstream_link(result_data)
+                                  }
+                   );
+        return result;
+    }
+    
+    /** Mark the value as retrieved. Only the thread which saw \c has_value may call this. **/
+    void mark_complete()
+    {
+        impl_->state_.store(completion_state::complete, std::memory_order_release);
+    }
+    
+    /** Publish the callback which was just written to \c impl_->callback_ by moving from \c no_value to
+     *  \c has_callback. If the value was delivered while the callback was being written, the transition fails and the
+     *  callback is called here instead.
+     *  
+     *  \throws std::logic_error with \a error_message if this \c completion was disabled in the meantime.
+    **/
+    void publish_callback(const char* error_message)
+    {
+        completion_state state = completion_state::no_value;
+        if (impl_->state_.compare_exchange_strong(state,
+                                                  completion_state::has_callback,
+                                                  std::memory_order_acq_rel,
+                                                  std::memory_order_acquire
+                                                 )
+           )
+            return;
+        
+        if (state != completion_state::has_value)
+        {
+            impl_->callback_ = nullptr;
+            throw std::logic_error(error_message);
+        }
+        
+        mark_complete();
+        impl_->invoke_callback();
+    }
+    
+private:
+    completion_data_ptr<T> impl_;
+};
+
+/** Lets a producer check whether the receiver of a \c completion still wants the value, without being tied to the type
+ *  of the \c completion_promise. Get one from \c completion_promise::get_cancellation_token. A default-constructed
+ *  token is never cancelled.
+**/
+class completion_cancellation_token
+{
+public:
+    completion_cancellation_token() noexcept :
+            data_(nullptr)
+    { }
+    
+    completion_cancellation_token(const completion_cancellation_token& src) noexcept :
+            data_(src.data_)
+    {
+        if (data_)
+            data_->refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    completion_cancellation_token& operator=(completion_cancellation_token src) noexcept
+    {
+        std::swap(data_, src.data_);
+        return *this;
+    }
+    
+    ~completion_cancellation_token() noexcept
+    {
+        if (data_)
+            data_->ops_->release(data_);
+    }
+    
+    /** \see completion_promise::is_cancelled **/
+    bool is_cancelled() const
+    {
+        return data_ && data_->state_.load(std::memory_order_acquire) == completion_state::disabled;
+    }
+    
 private:
-    std::shared_ptr<completion_data<T>> impl_;
+    template <typename U>
+    friend class completion_promise;
+    
+    explicit completion_cancellation_token(completion_data_base* data) noexcept :
+            data_(data)
+    {
+        data_->refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+private:
+    completion_data_base* data_;
 };
 
 /** A \c completion_promise provides the promise of a delivery of some value to a single \c completion -- fulfilling the
@@ -316,7 +1279,7 @@ class completion_promise
 public:
     /** Create a promise value. **/
     completion_promise() :
-            completion_promise(std::make_shared<completion_data<T>>())
+            completion_promise(make_completion_data<T>())
     { }
     
     /** Create a promise with the given location to store data \a impl. The provided \c completion_data must be uniquely
@@ -324,9 +1287,9 @@ public:
      *  
      *  \note
      *  This constructor exists to enable bulk allocation of \c completion_data instances in non-critical sections of
-     *  code (as memory allocation can be expensive).
+     *  code (as memory allocation can be expensive). \c completion_pool does exactly that.
     **/
-    explicit completion_promise(std::shared_ptr<completion_data<T>> impl) :
+    explicit completion_promise(completion_data_ptr<T> impl) :
             impl_(std::move(impl))
     { }
     
@@ -336,36 +1299,86 @@ public:
         return completion<T>(impl_);
     }
     
-    /** Deliver a \a value to this completion. If the associated \c completion has a callback, it is called inline. **/
-    template <typename U>
-    void complete(exceptional<U> value)
+    /** Deliver a \a value to this completion. If the associated \c completion has a callback, it is called inline --
+     *  unless this is called from inside of another callback, in which case it is called once that one returns (see
+     *  \c completion_data_base::invoke_callback). Either way, every callback has run before the outermost \c complete
+     *  on the thread returns.
+     *  
+     *  An \c exceptional with a typed error (such as <tt>exceptional&lt;T, std::error_code&gt;</tt>) is converted, so
+     *  the \c completion is delivered the \c std::exception_ptr the error would have thrown.
+     *  
+     *  \returns \c true if the value was delivered or \c false if the \c completion has been disabled.
+    **/
+    template <typename U, typename E>
+    bool complete(exceptional<U, E> value)
     {
-        unique_lock lock(impl_->protect_);
-        if (impl_->state_ == completion_state::no_value)
-        {
-            impl_->value_ = std::move(value);
-            impl_->state_ = completion_state::has_value;
-        }
-        else if (impl_->state_ == completion_state::has_callback)
-        {
-            auto completer = on_scope_exit([this]
-                                           {
-                                               impl_->state_ = completion_state::complete;
-                                               impl_->callback_ = nullptr;
-                                           }
-                                          );
-            impl_->callback_(std::move(value));
-        }
-        else if (impl_->state_ == completion_state::disabled)
-        {
-            // do nothing...
-        }
-        else
-        {
+        completion_state state = impl_->state_.load(std::memory_order_acquire);
+        if (state != completion_state::no_value
+           && state != completion_state::has_callback
+           && state != completion_state::disabled
+           )
             throw std::logic_error("invalid state for completing a completion_promise");
+        
+        // Nobody reads value_ until they see has_value, so it is safe to write before the transition.
+        impl_->value_ = std::move(value);
+        while (true)
+        {
+            if (state == completion_state::no_value)
+            {
+                if (impl_->state_.compare_exchange_weak(state,
+                                                        completion_state::has_value,
+                                                        std::memory_order_seq_cst,
+                                                        std::memory_order_acquire
+                                                       )
+                   )
+                {
+                    impl_->wake_waiters();
+                    return true;
+                }
+            }
+            else if (state == completion_state::has_callback)
+            {
+                // Claim the callback -- this can fail if the completion is disabled at the same time.
+                if (impl_->state_.compare_exchange_weak(state,
+                                                        completion_state::complete,
+                                                        std::memory_order_acq_rel,
+                                                        std::memory_order_acquire
+                                                       )
+                   )
+                {
+                    impl_->invoke_callback();
+                    return true;
+                }
+            }
+            else if (state == completion_state::disabled)
+            {
+                // do nothing...
+                return false;
+            }
+            else
+            {
+                throw std::logic_error("invalid state for completing a completion_promise");
+            }
         }
     }
     
+    /** Deliver \a value like \c complete, but if the \c completion has been disabled, give the value back in \a value
+     *  instead of dropping it. This is for producers which can put an undelivered value to other use (such as
+     *  \c completion_channel, which hands it to the next receiver).
+     *  
+     *  \returns \c true if the value was delivered (leaving \a value moved-from) or \c false if the \c completion has
+     *           been disabled (leaving \a value as it was).
+    **/
+    bool try_complete(exceptional<T>& value)
+    {
+        if (complete(std::move(value)))
+            return true;
+        
+        // A disabled completion never reads value_, so it is still ours to take back.
+        value = std::move(impl_->value_);
+        return false;
+    }
+    
     /** Call \c complete with a successful value. **/
     template <typename... U>
     void set_value(U&&... args)
@@ -379,14 +1392,29 @@ public:
         complete(exceptional<T>::failure(std::move(ex)));
     }
     
+    /** Check if the receiver has disabled the \c completion -- directly or by disabling a \c completion further down a
+     *  chain of continuations. If it has, there is no point in computing the value (\c complete will quietly drop it).
+     *  This is a single atomic load, so long-running producers can poll it as often as they like.
+    **/
+    bool is_cancelled() const
+    {
+        return impl_->state_.load(std::memory_order_acquire) == completion_state::disabled;
+    }
+    
+    /** Get a token which can be used to check \c is_cancelled without access to this promise (for example, by a worker
+     *  which is only given the token).
+    **/
+    completion_cancellation_token get_cancellation_token() const
+    {
+        return completion_cancellation_token(impl_.get());
+    }
+    
 private:
     template <typename U>
     friend class completion;
     
-    using unique_lock = std::unique_lock<spin_mutex>;
-    
 private:
-    std::shared_ptr<completion_data<T>> impl_;
+    completion_data_ptr<T> impl_;
 };
 
 }
@@ -0,0 +1,663 @@
+/** \file
+ *  Header file for \c completion_channel.
+ *
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __MONADIC_COMPLETION_CHANNEL_HPP_INCLUDED__
+#define __MONADIC_COMPLETION_CHANNEL_HPP_INCLUDED__
+
+#include "completion.hpp"
+#include "exceptional.hpp"
+#include "scope_exit.hpp"
+#include "spin_mutex.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace monadic
+{
+
+/** The failure delivered to a \c completion_channel::send on a closed channel, and to receivers of a channel which was
+ *  closed without a reason once it has been drained.
+**/
+class completion_channel_closed :
+        public std::runtime_error
+{
+public:
+    completion_channel_closed() :
+            std::runtime_error("completion_channel is closed")
+    { }
+};
+
+namespace detail
+{
+
+/** A bounded multi-producer, multi-consumer ring of \c T. Every cell carries a sequence number saying which lap of the
+ *  ring it is ready for, so producers and consumers only contend on their own position counter and never take a lock.
+ *  This is Dmitry Vyukov's bounded MPMC queue, with the addition of \c try_pop_n, which claims a run of ready cells
+ *  with a single compare-and-swap.
+ *
+ *  The sequence numbers are published and read sequentially-consistently, so that \c completion_channel can pair them
+ *  with its counts of waiting senders and receivers (either the waiter sees the cell or the other side sees the
+ *  waiter). *
+ *  There is deliberately no single-producer, single-consumer variant. Even with one sending and one receiving thread,
+ *  the ring has more than one producer: \c completion_channel::pump moves the values of parked senders into it from
+ *  whichever thread gets there first, while the sender keeps pushing directly. With a single thread on each end the
+ *  compare-and-swaps here are uncontended, so an SPSC ring would save little and would need a channel which could
+ *  only be used by one sender and one receiver.
+**/
+template <typename T>
+class channel_ring
+{
+public:
+    explicit channel_ring(std::size_t capacity) :
+            mask_(capacity - 1),
+            cells_(new cell[capacity]),
+            enqueue_pos_(0),
+            dequeue_pos_(0)
+    {
+        for (std::size_t idx = 0; idx < capacity; ++idx)
+            cells_[idx].sequence.store(idx, std::memory_order_relaxed);
+    }
+
+    channel_ring(const channel_ring&) = delete;
+    channel_ring& operator=(const channel_ring&) = delete;
+
+    ~channel_ring() noexcept
+    {
+        try_pop_n([] (T&&) { }, capacity());
+    }
+
+    std::size_t capacity() const
+    {
+        return mask_ + 1;
+    }
+
+    /** Move \a value into the ring if there is room. \a value is left alone if there is not.
+     *
+     *  \returns \c true if \a value was added.
+    **/
+    bool try_push(T& value)
+    {
+        std::size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        cell*       target;
+        while (true)
+        {
+            target = &cells_[pos & mask_];
+            std::size_t seq = target->sequence.load(std::memory_order_seq_cst);
+            if (seq == pos)
+            {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (seq < pos)
+            {
+                // The cell still holds the value from the previous lap -- the ring is full.
+                return false;
+            }
+            else
+            {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+
+        new (target->address()) T(std::move(value));
+        target->sequence.store(pos + 1, std::memory_order_seq_cst);
+        return true;
+    }
+
+    /** Remove up to \a max_count values from the ring, handing each one to \a sink in order.
+     *
+     *  \returns the number of values removed, which is 0 if the ring is empty.
+    **/
+    template <typename FSink>
+    std::size_t try_pop_n(FSink&& sink, std::size_t max_count)
+    {
+        if (max_count == 0)
+            return 0;
+
+        std::size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        std::size_t count;
+        while (true)
+        {
+            // Count how many cells in a row are ready, then claim all of them at once.
+            count = 0;
+            std::size_t seq = 0;
+            while (count < max_count)
+            {
+                seq = cells_[(pos + count) & mask_].sequence.load(std::memory_order_seq_cst);
+                if (seq != pos + count + 1)
+                    break;
+                ++count;
+            }
+
+            if (count > 0)
+            {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed))
+                    break;
+            }
+            else if (seq < pos + 1)
+            {
+                // The first cell has not been filled for this lap -- the ring is empty.
+                return 0;
+            }
+            else
+            {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+
+        for (std::size_t idx = 0; idx < count; ++idx)
+        {
+            cell& source = cells_[(pos + idx) & mask_];
+            T*    value  = static_cast<T*>(source.address());
+            sink(std::move(*value));
+            value->~T();
+            source.sequence.store(pos + idx + mask_ + 1, std::memory_order_seq_cst);
+        }
+        return count;
+    }
+
+private:
+    struct cell
+    {
+        std::atomic<std::size_t>                                   sequence;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+        void* address()
+        {
+            return &storage;
+        }
+    };
+
+private:
+    std::size_t              mask_;
+    std::unique_ptr<cell[]>  cells_;
+    char                     padding0_[64]; // keep the producers' counter off of the consumers' cache line
+    std::atomic<std::size_t> enqueue_pos_;
+    char                     padding1_[64];
+    std::atomic<std::size_t> dequeue_pos_;
+    char                     padding2_[64];
+};
+
+}
+
+/** A bounded, multi-producer, multi-consumer channel of values, which is the streaming counterpart of a \c completion:
+ *  where a \c completion is delivered a single value, a channel carries any number of them. Both ends are
+ *  asynchronous -- \c receive returns a \c completion which is delivered once a value arrives and \c send returns one
+ *  which is delivered once there was room for the value, so a fast producer which waits on its sends is slowed to the
+ *  pace of its consumers instead of filling memory.
+ *
+ *  Values travel through a lock-free ring. As long as the ring is neither full nor empty, sending and receiving only
+ *  touch the ring; a lock is only taken to park a sender or receiver which has to wait, and to hand values to parked
+ *  ones. Values sent by a single thread are received in the order they were sent, including sends which had to wait
+ *  for room. \c receive_n takes up to \c n values at once for the cost of a single ring operation and a single
+ *  \c completion, which is the way to get the most out of a busy channel.
+ *
+ *  Closing a channel stops new sends. Receivers still get every value which was sent before it was closed; after that,
+ *  they are delivered a failure -- the reason given to \c close or a \c completion_channel_closed. Like any other
+ *  failure, it can be handled with \c completion::recover.
+ *
+ *  \code
+ *  completion_channel<log_record> records(1024);
+ *
+ *  // producer
+ *  records.send(make_record(line))
+ *         .then([] (exceptional<void> sent) { ... });
+ *
+ *  // consumer
+ *  records.receive_n(64)
+ *         .map([] (std::vector<log_record> batch) { ship(batch); });
+ *  \endcode
+ *
+ *  \note
+ *  Every \c send and \c receive allocates the \c completion it returns. When the caller has nothing to do while it
+ *  waits, \c try_send and \c try_receive do not.
+**/
+template <typename T>
+class completion_channel
+{
+    static_assert(!std::is_void<T>::value, "completion_channel can not carry void");
+
+public:
+    using value_type = T;
+
+public:
+    /** Create a channel with room for \a capacity values, rounded up to a power of two (and at least 2).
+     *
+     *  \throws std::invalid_argument if \a capacity is 0.
+    **/
+    explicit completion_channel(std::size_t capacity) :
+            ring_(round_capacity(capacity)),
+            senders_waiting_(0),
+            receivers_waiting_(0),
+            returned_waiting_(0),
+            closed_(false)
+    { }
+
+    completion_channel(const completion_channel&) = delete;
+    completion_channel& operator=(const completion_channel&) = delete;
+
+    /** Close the channel. Sends which are still waiting for room are failed. **/
+    ~completion_channel() noexcept
+    {
+        close();
+    }
+
+    /** The number of values which fit in the channel before a sender has to wait. **/
+    std::size_t capacity() const
+    {
+        return ring_.capacity();
+    }
+
+    /** Send \a value through the channel. The returned \c completion is delivered once the value is in the channel --
+     *  immediately if there is room. If the channel is closed (or is closed while this send is waiting for room), it is
+     *  delivered a \c completion_channel_closed failure instead. Disabling the returned \c completion while it is still
+     *  waiting withdraws the value.
+    **/
+    completion<void> send(T value)
+    {
+        completion_promise<void> promise;
+        auto result = promise.get_completion();
+        if (closed_.load(std::memory_order_acquire))
+        {
+            promise.set_exception(std::make_exception_ptr(completion_channel_closed()));
+        }
+        else if (senders_waiting_.load(std::memory_order_seq_cst) == 0 && ring_.try_push(value))
+        {
+            if (receivers_waiting_.load(std::memory_order_seq_cst) != 0)
+                pump();
+            promise.set_value();
+        }
+        else
+        {
+            std::unique_lock<spin_mutex> lock(protect_);
+            if (closed_.load(std::memory_order_relaxed))
+            {
+                lock.unlock();
+                promise.set_exception(std::make_exception_ptr(completion_channel_closed()));
+                return result;
+            }
+            senders_.push_back(waiting_sender { std::move(value), std::move(promise) });
+            senders_waiting_.fetch_add(1, std::memory_order_seq_cst);
+            lock.unlock();
+            pump();
+        }
+        return result;
+    }
+
+    /** Send \a value if there is room for it right now, without allocating anything.
+     *
+     *  \returns \c true if \a value was moved into the channel; \c false (leaving \a value untouched) if the channel is
+     *           full, closed or has senders waiting ahead of this one.
+    **/
+    bool try_send(T& value)
+    {
+        if (closed_.load(std::memory_order_acquire)
+           || senders_waiting_.load(std::memory_order_seq_cst) != 0
+           || !ring_.try_push(value)
+           )
+            return false;
+
+        if (receivers_waiting_.load(std::memory_order_seq_cst) != 0)
+            pump();
+        return true;
+    }
+
+    /** Receive the next value. The returned \c completion is delivered as soon as one is available, or with a failure
+     *  once the channel is closed and empty. Disabling it while it is still waiting gives up its place in line without
+     *  taking a value.
+    **/
+    completion<T> receive()
+    {
+        completion_promise<T> promise;
+        auto result = promise.get_completion();
+        // The popped value is moved straight into this slot, so there is never a placeholder to assign over.
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type slot;
+        if (receivers_waiting_.load(std::memory_order_seq_cst) == 0
+           && returned_waiting_.load(std::memory_order_seq_cst) == 0
+           && ring_.try_pop_n([&slot] (T&& x) { new (&slot) T(std::move(x)); }, 1) != 0
+           )
+        {
+            T&   value   = *static_cast<T*>(static_cast<void*>(&slot));
+            auto destroy = on_scope_exit([&value] { value.~T(); });
+            if (senders_waiting_.load(std::memory_order_seq_cst) != 0)
+                pump();
+            promise.set_value(std::move(value));
+        }
+        else
+        {
+            park(waiting_receiver(std::move(promise)));
+        }
+        return result;
+    }
+
+    /** Receive between 1 and \a max_count values at once. The returned \c completion is delivered as soon as at least
+     *  one value is available, with as many as are available at that moment (up to \a max_count), or with a failure
+     *  once the channel is closed and empty.
+     *
+     *  \throws std::invalid_argument if \a max_count is 0.
+    **/
+    completion<std::vector<T>> receive_n(std::size_t max_count)
+    {
+        if (max_count == 0)
+            throw std::invalid_argument("completion_channel::receive_n requires a max_count of at least 1");
+
+        completion_promise<std::vector<T>> promise;
+        auto result = promise.get_completion();
+        std::vector<T> values;
+        if (receivers_waiting_.load(std::memory_order_seq_cst) == 0
+           && returned_waiting_.load(std::memory_order_seq_cst) == 0
+           && pop_into(values, max_count) != 0
+           )
+        {
+            if (senders_waiting_.load(std::memory_order_seq_cst) != 0)
+                pump();
+            promise.set_value(std::move(values));
+        }
+        else
+        {
+            park(waiting_receiver(max_count, std::move(promise)));
+        }
+        return result;
+    }
+
+    /** Receive a value if one is available right now, without allocating anything.
+     *
+     *  \returns \c true if a value was moved into \a out; \c false if the channel is empty or has receivers waiting
+     *           ahead of this one.
+    **/
+    bool try_receive(T& out)
+    {
+        if (receivers_waiting_.load(std::memory_order_seq_cst) != 0)
+            return false;
+
+        if (returned_waiting_.load(std::memory_order_seq_cst) != 0)
+        {
+            std::lock_guard<spin_mutex> lock(protect_);
+            if (!receivers_.empty())
+                return false;
+            if (!returned_.empty())
+            {
+                out = std::move(returned_.front());
+                returned_.pop_front();
+                returned_waiting_.fetch_sub(1, std::memory_order_seq_cst);
+                return true;
+            }
+        }
+
+        if (ring_.try_pop_n([&out] (T&& x) { out = std::move(x); }, 1) == 0)
+            return false;
+
+        if (senders_waiting_.load(std::memory_order_seq_cst) != 0)
+            pump();
+        return true;
+    }
+
+    /** Close the channel. Further sends fail with \c completion_channel_closed, as do sends which are still waiting
+     *  for room. Receivers get the values which are already in the channel; once it is empty, they are delivered
+     *  \a reason (or \c completion_channel_closed if there is none). Closing a closed channel does nothing.
+     *
+     *  \note
+     *  A send which is running at the same time as \c close might still get its value in after the receivers waiting
+     *  at the time have been failed. That value can still be taken by a later receive.
+    **/
+    void close(std::exception_ptr reason = nullptr)
+    {
+        std::deque<waiting_sender> failed;
+        {
+            std::lock_guard<spin_mutex> lock(protect_);
+            if (closed_.load(std::memory_order_relaxed))
+                return;
+
+            close_reason_ = reason ? std::move(reason) : std::make_exception_ptr(completion_channel_closed());
+            closed_.store(true, std::memory_order_seq_cst);
+            failed.swap(senders_);
+            senders_waiting_.fetch_sub(failed.size(), std::memory_order_seq_cst);
+        }
+
+        for (auto& sender : failed)
+            sender.promise.set_exception(std::make_exception_ptr(completion_channel_closed()));
+        pump();
+    }
+
+    /** Check if \c close has been called. **/
+    bool is_closed() const
+    {
+        return closed_.load(std::memory_order_acquire);
+    }
+
+private:
+    struct waiting_sender
+    {
+        T                        value;
+        completion_promise<void> promise;
+    };
+
+    /** A parked \c receive (\c max_count of 0) or \c receive_n. Only the promise for the matching kind is set. **/
+    struct waiting_receiver
+    {
+        std::size_t                        max_count;
+        completion_promise<T>              one;
+        completion_promise<std::vector<T>> many;
+
+        explicit waiting_receiver(completion_promise<T>&& promise) :
+                max_count(0),
+                one(std::move(promise)),
+                many(completion_data_ptr<std::vector<T>>())
+        { }
+
+        waiting_receiver(std::size_t max_count, completion_promise<std::vector<T>>&& promise) :
+                max_count(max_count),
+                one(completion_data_ptr<T>()),
+                many(std::move(promise))
+        { }
+
+        bool is_cancelled() const
+        {
+            return max_count == 0 ? one.is_cancelled() : many.is_cancelled();
+        }
+
+        void fail(const std::exception_ptr& reason)
+        {
+            if (max_count == 0)
+                one.set_exception(reason);
+            else
+                many.set_exception(reason);
+        }
+    };
+
+private:
+    static std::size_t round_capacity(std::size_t capacity)
+    {
+        if (capacity == 0)
+            throw std::invalid_argument("completion_channel capacity must be at least 1");
+
+        // The ring needs at least two cells: with one, a filled cell looks the same as an empty one on the next lap.
+        std::size_t rounded = 2;
+        while (rounded < capacity)
+            rounded *= 2;
+        return rounded;
+    }
+
+    std::size_t pop_into(std::vector<T>& values, std::size_t max_count)
+    {
+        // There can never be more than a ring's worth at once, which also covers callers passing a huge max_count.
+        values.reserve(std::min(max_count, ring_.capacity()));
+        return ring_.try_pop_n([&values] (T&& x) { values.push_back(std::move(x)); }, max_count);
+    }
+
+    void park(waiting_receiver&& receiver)
+    {
+        {
+            std::lock_guard<spin_mutex> lock(protect_);
+            receivers_.push_back(std::move(receiver));
+            receivers_waiting_.fetch_add(1, std::memory_order_seq_cst);
+        }
+        // A value might have arrived before we were counted (or be sitting behind receivers ahead of us).
+        pump();
+    }
+
+    /** Move values from waiting senders into the ring and from the ring to waiting receivers until neither can go any
+     *  further. The promises are delivered outside of the lock, so continuations never run while it is held.
+    **/
+    void pump()
+    {
+        bool progress = true;
+        while (progress)
+        {
+            progress = false;
+            if (senders_waiting_.load(std::memory_order_seq_cst) != 0)
+                progress = admit_sender() || progress;
+            if (receivers_waiting_.load(std::memory_order_seq_cst) != 0)
+                progress = serve_receiver() || progress;
+        }
+    }
+
+    /** Move the value of the first waiting sender into the ring.
+     *
+     *  \returns \c true if a sender was taken off of the wait list.
+    **/
+    bool admit_sender()
+    {
+        std::unique_lock<spin_mutex> lock(protect_);
+        if (senders_.empty())
+            return false;
+
+        waiting_sender& front = senders_.front();
+        bool withdrawn = front.promise.is_cancelled();
+        if (!withdrawn && !ring_.try_push(front.value))
+            return false;
+
+        completion_promise<void> promise(std::move(front.promise));
+        senders_.pop_front();
+        senders_waiting_.fetch_sub(1, std::memory_order_seq_cst);
+        lock.unlock();
+
+        if (!withdrawn)
+            promise.set_value();
+        return true;
+    }
+
+    /** Take up to \a max_count values for a receiver: first any which were given back by a disabled receiver (which
+     *  were sent before anything still in the ring), then from the ring. Must be called with \c protect_ held.
+    **/
+    std::size_t take_locked(std::vector<T>& values, std::size_t max_count)
+    {
+        std::size_t count = 0;
+        while (count < max_count && !returned_.empty())
+        {
+            values.push_back(std::move(returned_.front()));
+            returned_.pop_front();
+            ++count;
+        }
+        returned_waiting_.fetch_sub(count, std::memory_order_seq_cst);
+        return count + (count < max_count ? pop_into(values, max_count - count) : 0);
+    }
+
+    /** Put \a values, which were taken for a receiver which turned out to be disabled, back at the front of the
+     *  line.
+    **/
+    void give_back(std::vector<T>&& values)
+    {
+        std::lock_guard<spin_mutex> lock(protect_);
+        for (auto iter = values.rbegin(); iter != values.rend(); ++iter)
+            returned_.push_front(std::move(*iter));
+        returned_waiting_.fetch_add(values.size(), std::memory_order_seq_cst);
+    }
+
+    /** Give values to the first waiting receiver or, if the channel is closed and empty, fail every waiting receiver.
+     *
+     *  The receiver can be disabled at any point until its promise is delivered, which happens after the lock is
+     *  released (so its continuation does not run under the lock). If that happens, the values it was given are put
+     *  back in front of everything else, for the next receiver.
+     *
+     *  \returns \c true if a receiver was taken off of the wait list.
+    **/
+    bool serve_receiver()
+    {
+        std::unique_lock<spin_mutex> lock(protect_);
+        if (receivers_.empty())
+            return false;
+
+        waiting_receiver& front = receivers_.front();
+        if (front.is_cancelled())
+        {
+            waiting_receiver dropped(std::move(front));
+            receivers_.pop_front();
+            receivers_waiting_.fetch_sub(1, std::memory_order_seq_cst);
+            return true;
+        }
+
+        std::vector<T> values;
+        if (take_locked(values, front.max_count == 0 ? 1 : front.max_count) == 0)
+        {
+            if (!closed_.load(std::memory_order_seq_cst) || !senders_.empty())
+                return false;
+
+            std::deque<waiting_receiver> failed;
+            failed.swap(receivers_);
+            receivers_waiting_.fetch_sub(failed.size(), std::memory_order_seq_cst);
+            std::exception_ptr reason = close_reason_;
+            lock.unlock();
+
+            for (auto& receiver : failed)
+                receiver.fail(reason);
+            return false;
+        }
+
+        waiting_receiver receiver(std::move(front));
+        receivers_.pop_front();
+        receivers_waiting_.fetch_sub(1, std::memory_order_seq_cst);
+        lock.unlock();
+
+        if (receiver.max_count == 0)
+        {
+            auto one = exceptional<T>::success(std::move(values.front()));
+            if (!receiver.one.try_complete(one))
+            {
+                values.front() = std::move(one).get();
+                give_back(std::move(values));
+            }
+        }
+        else
+        {
+            auto many = exceptional<std::vector<T>>::success(std::move(values));
+            if (!receiver.many.try_complete(many))
+                give_back(std::move(many).get());
+        }
+        return true;
+    }
+
+private:
+    detail::channel_ring<T>      ring_;
+    std::atomic<std::size_t>     senders_waiting_;
+    std::atomic<std::size_t>     receivers_waiting_;
+    std::atomic<std::size_t>     returned_waiting_; //!< The size of \c returned_, for checking without the lock.
+    std::atomic<bool>            closed_;
+    spin_mutex                   protect_;
+    std::deque<waiting_sender>   senders_;
+    std::deque<waiting_receiver> receivers_;
+    std::deque<T>                returned_; //!< Values taken for a receiver which was disabled before they got to it.
+    std::exception_ptr           close_reason_;
+};
+
+}
+
+#endif/*__MONADIC_COMPLETION_CHANNEL_HPP_INCLUDED__*/
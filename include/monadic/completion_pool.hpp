@@ -0,0 +1,414 @@
+/** \file
+ *  Header file for \c completion_pool.
+ *
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __MONADIC_COMPLETION_POOL_HPP_INCLUDED__
+#define __MONADIC_COMPLETION_POOL_HPP_INCLUDED__
+
+#include "completion.hpp"
+#include "spin_mutex.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace monadic
+{
+
+namespace detail
+{
+
+/** The numbers \c completion_pool_thread_index hands out. A number is taken back when its thread exits, and the lowest
+ *  free number is always handed out first, so the numbers stay as small as the count of live threads allows.
+**/
+class completion_pool_thread_indices
+{
+public:
+    static std::size_t acquire()
+    {
+        completion_pool_thread_indices& self = instance();
+        std::lock_guard<std::mutex> lock(self.protect_);
+        if (self.free_.empty())
+        {
+            // Make room for every number handed out so far, so release never has to allocate.
+            self.free_.reserve(self.next_ + 1);
+            return self.next_++;
+        }
+
+        std::pop_heap(self.free_.begin(), self.free_.end(), std::greater<std::size_t>());
+        std::size_t index = self.free_.back();
+        self.free_.pop_back();
+        return index;
+    }
+
+    static void release(std::size_t index) noexcept
+    {
+        completion_pool_thread_indices& self = instance();
+        std::lock_guard<std::mutex> lock(self.protect_);
+        self.free_.push_back(index);
+        std::push_heap(self.free_.begin(), self.free_.end(), std::greater<std::size_t>());
+    }
+
+private:
+    completion_pool_thread_indices() :
+            next_(0)
+    { }
+
+    static completion_pool_thread_indices& instance()
+    {
+        // Never destroyed, since threads can still exit (and give their number back) during static destruction.
+        static completion_pool_thread_indices* self = new completion_pool_thread_indices();
+        return *self;
+    }
+
+private:
+    std::mutex               protect_;
+    std::size_t              next_;
+    std::vector<std::size_t> free_; //!< A min-heap of the numbers given back by exited threads.
+};
+
+/** A thread's number from \c completion_pool_thread_indices, which is given back when the thread exits. **/
+struct completion_pool_thread_slot
+{
+    std::size_t index;
+
+    completion_pool_thread_slot() :
+            index(completion_pool_thread_indices::acquire())
+    { }
+
+    ~completion_pool_thread_slot() noexcept
+    {
+        completion_pool_thread_indices::release(index);
+    }
+};
+
+/** A small number identifying the calling thread, unique among the threads which are alive. **/
+inline std::size_t completion_pool_thread_index()
+{
+    static thread_local completion_pool_thread_slot slot;
+    return slot.index;
+}
+
+}
+
+/** A pool of preallocated \c completion_data instances. Promises created by \c make_promise do not allocate; when the
+ *  last \c completion or \c completion_promise referring to one of them is dropped, the instance goes back to the pool
+ *  instead of being deleted. In the steady state, a request handler which creates a promise from a pool never calls
+ *  \c malloc for it.
+ *
+ *  Each thread has a small cache of free instances inside the pool which only it touches, so allocating and recycling
+ *  take no lock at all. Behind the caches are several shards, each with its own lock: a thread whose cache runs dry
+ *  takes a batch from its shard and a thread whose cache fills up gives a batch back. A shard which runs dry takes half
+ *  of another shard's instances before resorting to allocating another slab. Each thread is given the lowest number
+ *  not in use by another live thread the first time it uses any pool; threads numbered below \c shard_count get a
+ *  cache, the rest go straight to the shards. When a thread exits, its number (and whatever it left in each pool's
+ *  cache) passes to the next thread which needs one, so the caches are not stranded when threads come and go.
+ *
+ *  \note
+ *  Only the \c completion_data for the promise itself comes from the pool -- a continuation such as \c completion::map
+ *  still allocates the data for the \c completion it returns.
+ *
+ *  \warning
+ *  The pool must outlive every \c completion and \c completion_promise created from it.
+**/
+template <typename T>
+class completion_pool :
+        private completion_data_recycler<T>
+{
+public:
+    /** Create a pool with room for \a capacity instances, allocated up front. The pool grows by another slab of about
+     *  <tt>capacity / shard_count</tt> instances whenever it runs out.
+     *
+     *  \param shard_count The number of separately-locked free lists, rounded up to a power of two. Defaults to twice
+     *                    the hardware concurrency.
+    **/
+    explicit completion_pool(std::size_t capacity, std::size_t shard_count = default_shard_count()) :
+            completion_data_recycler<T>{ &completion_pool::recycle_impl },
+            slab_size_(std::max<std::size_t>(16, capacity / std::max<std::size_t>(shard_count, 1))),
+            capacity_(0)
+    {
+        // Round up to a power of two so picking a thread's shard is a mask instead of a division.
+        std::size_t rounded = 1;
+        while (rounded < shard_count)
+            rounded *= 2;
+        shard_count = rounded;
+
+        caches_.reset(new thread_cache[shard_count]);
+        shards_.reserve(shard_count);
+        for (std::size_t idx = 0; idx < shard_count; ++idx)
+            shards_.emplace_back(new shard());
+
+        std::size_t per_shard = (capacity + shard_count - 1) / shard_count;
+        if (per_shard > 0)
+            for (auto& s : shards_)
+                add_slab(*s, per_shard);
+    }
+
+    completion_pool(const completion_pool&) = delete;
+    completion_pool& operator=(const completion_pool&) = delete;
+
+    ~completion_pool() noexcept
+    {
+        assert(free_count() == capacity() && "completion_pool destroyed with outstanding completions");
+    }
+
+    static std::size_t default_shard_count()
+    {
+        std::size_t count = std::thread::hardware_concurrency();
+        return count == 0 ? 2 : count * 2;
+    }
+
+    /** Create a \c completion_promise whose data comes from this pool. **/
+    completion_promise<T> make_promise()
+    {
+        return completion_promise<T>(allocate());
+    }
+
+    /** Get a fresh \c completion_data from this pool, suitable for the \c completion_promise constructor. **/
+    completion_data_ptr<T> allocate()
+    {
+        std::size_t         thread_index = detail::completion_pool_thread_index();
+        completion_data<T>* data;
+        if (thread_index < shards_.size())
+        {
+            thread_cache& cache = caches_[thread_index];
+            std::size_t   count = cache.count.load(std::memory_order_relaxed);
+            if (count == 0)
+                count = fill_cache(cache, shard_for(thread_index));
+            data = cache.items[--count];
+            cache.count.store(count, std::memory_order_relaxed);
+        }
+        else
+        {
+            shard& local = shard_for(thread_index);
+            std::unique_lock<spin_mutex> lock(local.protect);
+            while (local.empty())
+            {
+                lock.unlock();
+                refill(local);
+                lock.lock();
+            }
+            data = local.pop();
+        }
+
+        data->refs_.store(1, std::memory_order_relaxed);
+        return completion_data_ptr<T>(data, std::adopt_lock);
+    }
+
+    /** The total number of instances this pool has allocated. **/
+    std::size_t capacity() const
+    {
+        return capacity_.load(std::memory_order_relaxed);
+    }
+
+    /** The number of instances which are currently free. This is only a snapshot if other threads are using the
+     *  pool.
+    **/
+    std::size_t free_count() const
+    {
+        std::size_t count = 0;
+        for (std::size_t idx = 0; idx < shards_.size(); ++idx)
+        {
+            count += caches_[idx].count.load(std::memory_order_relaxed);
+            std::lock_guard<spin_mutex> lock(shards_[idx]->protect);
+            count += shards_[idx]->size;
+        }
+        return count;
+    }
+
+private:
+    /** The free instances of a single thread. Only the owning thread touches \c items; \c count is atomic so that
+     *  \c free_count can peek at it.
+    **/
+    struct thread_cache
+    {
+        static const std::size_t capacity = 32;
+
+        std::atomic<std::size_t> count;
+        completion_data<T>*      items[capacity];
+        char                     padding[64]; // keep neighboring caches off of each other's cache lines
+
+        thread_cache() :
+                count(0)
+        { }
+    };
+
+    /** A separately-locked free list. The instances are linked through \c completion_data_base::next_queued_, which a
+     *  free instance is not using (only an instance with a callback waiting to run is in a run queue), so moving
+     *  instances in and out of a shard never allocates -- in particular, giving one back from \c recycle_impl can not
+     *  fail.
+    **/
+    struct shard
+    {
+        mutable spin_mutex  protect;
+        completion_data<T>* head;
+        std::size_t         size;
+
+        shard() :
+                head(nullptr),
+                size(0)
+        { }
+
+        bool empty() const noexcept
+        {
+            return size == 0;
+        }
+
+        void push(completion_data<T>* data) noexcept
+        {
+            data->next_queued_ = head;
+            head = data;
+            ++size;
+        }
+
+        completion_data<T>* pop() noexcept
+        {
+            completion_data<T>* data = head;
+            head = static_cast<completion_data<T>*>(data->next_queued_);
+            --size;
+            return data;
+        }
+    };
+
+    shard& shard_for(std::size_t thread_index)
+    {
+        return *shards_[thread_index & (shards_.size() - 1)];
+    }
+
+    /** Move half of a cache's worth of instances from \a source into the empty \a cache.
+     *
+     *  \returns the new count of \a cache.
+    **/
+    std::size_t fill_cache(thread_cache& cache, shard& source)
+    {
+        std::unique_lock<spin_mutex> lock(source.protect);
+        while (source.empty())
+        {
+            lock.unlock();
+            refill(source);
+            lock.lock();
+        }
+
+        std::size_t count = std::min(thread_cache::capacity / 2, source.size);
+        for (std::size_t idx = 0; idx < count; ++idx)
+            cache.items[idx] = source.pop();
+        return count;
+    }
+
+    /** Make sure \a local has at least one free instance, first by taking from the other shards and then by allocating
+     *  a new slab.
+    **/
+    void refill(shard& local)
+    {
+        shard taken;
+        for (auto& s : shards_)
+        {
+            if (s.get() == &local)
+                continue;
+
+            std::unique_lock<spin_mutex> lock(s->protect, std::try_to_lock);
+            if (!lock.owns_lock() || s->empty())
+                continue;
+
+            for (std::size_t count = (s->size + 1) / 2; count > 0; --count)
+                taken.push(s->pop());
+            break;
+        }
+
+        if (taken.empty())
+        {
+            add_slab(local, slab_size_);
+        }
+        else
+        {
+            std::lock_guard<spin_mutex> lock(local.protect);
+            while (!taken.empty())
+                local.push(taken.pop());
+        }
+    }
+
+    void add_slab(shard& target, std::size_t count)
+    {
+        std::unique_ptr<completion_data<T>[]> slab(new completion_data<T>[count]);
+        completion_data<T>* first = slab.get();
+        for (std::size_t idx = 0; idx < count; ++idx)
+            first[idx].recycler_ = this;
+
+        {
+            std::lock_guard<std::mutex> lock(slabs_protect_);
+            slabs_.push_back(std::move(slab));
+        }
+
+        std::lock_guard<spin_mutex> lock(target.protect);
+        for (std::size_t idx = 0; idx < count; ++idx)
+            target.push(first + idx);
+        capacity_.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    void recycle(completion_data<T>* data) noexcept
+    {
+        std::size_t thread_index = detail::completion_pool_thread_index();
+        shard&      local        = shard_for(thread_index);
+        if (thread_index < shards_.size())
+        {
+            thread_cache& cache = caches_[thread_index];
+            std::size_t   count = cache.count.load(std::memory_order_relaxed);
+            if (count == thread_cache::capacity)
+            {
+                // Give the older half back to the shard so other threads can have it.
+                std::size_t keep = thread_cache::capacity / 2;
+                {
+                    std::lock_guard<spin_mutex> lock(local.protect);
+                    for (std::size_t idx = 0; idx < count - keep; ++idx)
+                        local.push(cache.items[idx]);
+                }
+                std::copy(cache.items + (count - keep), cache.items + count, cache.items);
+                count = keep;
+            }
+            cache.items[count] = data;
+            cache.count.store(count + 1, std::memory_order_relaxed);
+        }
+        else
+        {
+            std::lock_guard<spin_mutex> lock(local.protect);
+            local.push(data);
+        }
+    }
+
+    static void recycle_impl(completion_data_recycler<T>* self, completion_data<T>* data) noexcept
+    {
+        // Let go of the value and any leftover callback now instead of when the instance is reused.
+        data->value_.reset();
+        data->callback_ = nullptr;
+        data->waiters_.store(0, std::memory_order_relaxed);
+        data->upstream_.store(nullptr, std::memory_order_relaxed);
+        data->state_.store(completion_state::no_value, std::memory_order_relaxed);
+
+        static_cast<completion_pool*>(self)->recycle(data);
+    }
+
+private:
+    std::unique_ptr<thread_cache[]>                    caches_;
+    std::vector<std::unique_ptr<shard>>                shards_;
+    std::size_t                                        slab_size_;
+    std::atomic<std::size_t>                           capacity_;
+    std::mutex                                         slabs_protect_;
+    std::vector<std::unique_ptr<completion_data<T>[]>> slabs_;
+};
+
+}
+
+#endif/*__MONADIC_COMPLETION_POOL_HPP_INCLUDED__*/
@@ -0,0 +1,227 @@
+/** \file
+ *  Header file for C++20 coroutine support for \c completion.
+ *
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __MONADIC_COROUTINE_HPP_INCLUDED__
+#define __MONADIC_COROUTINE_HPP_INCLUDED__
+
+#include "completion.hpp"
+
+/** \def MONADIC_HAS_COROUTINES
+ *  1 if the compiler and standard library support C++20 coroutines (for example, when building with
+ *  <tt>make CXX_STANDARD="--std=c++20"</tt>); 0 if they do not. Everything in this header is only defined when this is
+ *  1, so it is safe to include unconditionally.
+**/
+#ifndef MONADIC_HAS_COROUTINES
+#   if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L && defined(__has_include)
+#       if __has_include(<coroutine>)
+#           define MONADIC_HAS_COROUTINES 1
+#       endif
+#   endif
+#endif
+#ifndef MONADIC_HAS_COROUTINES
+#   define MONADIC_HAS_COROUTINES 0
+#endif
+
+#if MONADIC_HAS_COROUTINES
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+namespace monadic
+{
+
+namespace detail
+{
+
+/** The awaiter for <tt>co_await</tt> on a \c completion. The callback installed on the \c completion stores the value
+ *  in the awaiter and resumes the coroutine directly from \c completion_promise::complete -- it is two pointers, so it
+ *  fits in the \c completion_data without allocating.
+ *
+ *  The value can be delivered while \c await_suspend is still installing the callback (or even before it, in which
+ *  case the callback is called inline). Whichever of the callback and \c await_suspend is second to flip \c ready_
+ *  continues the coroutine: the callback by resuming it or \c await_suspend by declining to suspend.
+**/
+template <typename T>
+class completion_awaiter
+{
+public:
+    explicit completion_awaiter(completion<T>&& source) :
+            source_(std::move(source)),
+            ready_(false)
+    { }
+
+    bool await_ready() const
+    {
+        return source_.state() == completion_state::has_value;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        source_.on_complete(resumer { this, handle });
+        return !ready_.exchange(true, std::memory_order_acq_rel);
+    }
+
+    T await_resume()
+    {
+        if (!ready_.load(std::memory_order_relaxed))
+            return source_.get();
+        return std::move(value_).get();
+    }
+
+private:
+    struct resumer
+    {
+        completion_awaiter*     self_;
+        std::coroutine_handle<> handle_;
+
+        void operator()(exceptional<T>&& value)
+        {
+            self_->value_ = std::move(value);
+            if (self_->ready_.exchange(true, std::memory_order_acq_rel))
+                handle_.resume();
+        }
+    };
+
+private:
+    completion<T>     source_;
+    exceptional<T>    value_;
+    std::atomic<bool> ready_;
+};
+
+/** The parts of the coroutine promise which do not depend on whether \c T is \c void. \c TPromise is the full
+ *  promise type deriving from this one.
+ *
+ *  The \c completion_data for the returned \c completion lives inside of the coroutine frame, so calling a coroutine
+ *  which returns a \c completion is a single allocation (which the compiler can sometimes elide). The frame holds a
+ *  reference to the data until the coroutine finishes; the frame is destroyed by the data's recycler when the last
+ *  reference goes away, which might be before or long after the coroutine finishes.
+**/
+template <typename T, typename TPromise>
+class completion_coroutine_promise_base :
+        private completion_data_recycler<T>
+{
+public:
+    completion_coroutine_promise_base() :
+            completion_data_recycler<T>{ &completion_coroutine_promise_base::recycle_impl },
+            data_(1, this),
+            promise_(completion_data_ptr<T>(&data_, std::adopt_lock))
+    { }
+
+    completion<T> get_return_object()
+    {
+        return promise_.get_completion();
+    }
+
+    std::suspend_never initial_suspend() const noexcept
+    {
+        return {};
+    }
+
+    /** Drop the frame's reference to the data. If nobody else has one, this destroys the frame. **/
+    struct final_awaiter
+    {
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<TPromise> handle) noexcept
+        {
+            completion_promise<T> release(std::move(handle.promise().promise_));
+        }
+
+        void await_resume() const noexcept
+        { }
+    };
+
+    final_awaiter final_suspend() const noexcept
+    {
+        return {};
+    }
+
+    void unhandled_exception()
+    {
+        promise_.set_exception(std::current_exception());
+    }
+
+private:
+    static void recycle_impl(completion_data_recycler<T>* self, completion_data<T>*) noexcept
+    {
+        auto& promise = static_cast<TPromise&>(static_cast<completion_coroutine_promise_base&>(*self));
+        std::coroutine_handle<TPromise>::from_promise(promise).destroy();
+    }
+
+protected:
+    completion_data<T>    data_;
+    completion_promise<T> promise_;
+};
+
+template <typename T>
+class completion_coroutine_promise :
+        public completion_coroutine_promise_base<T, completion_coroutine_promise<T>>
+{
+public:
+    template <typename U>
+    void return_value(U&& value)
+    {
+        this->promise_.set_value(std::forward<U>(value));
+    }
+};
+
+template <>
+class completion_coroutine_promise<void> :
+        public completion_coroutine_promise_base<void, completion_coroutine_promise<void>>
+{
+public:
+    void return_void()
+    {
+        this->promise_.set_value();
+    }
+};
+
+}
+
+/** Suspend the calling coroutine until \a source is delivered. The coroutine is resumed on the thread which delivers
+ *  the value (or continues immediately if it has already been delivered). The result of the <tt>co_await</tt> is the
+ *  value, or the exception is thrown if \a source was delivered a failure.
+ *
+ *  \code
+ *  completion<std::size_t> count_words(connection& conn)
+ *  {
+ *      std::string body = co_await conn.fetch("/document");
+ *      co_return split(body).size();
+ *  }
+ *  \endcode
+ *
+ *  Like a continuation, this consumes \a source: it can not be continued or \c get afterwards.
+**/
+template <typename T>
+detail::completion_awaiter<T> operator co_await(completion<T> source)
+{
+    return detail::completion_awaiter<T>(std::move(source));
+}
+
+}
+
+/** Allows \c completion to be used as the return type of a coroutine. The \c completion is delivered the value of
+ *  <tt>co_return</tt> or the exception which escapes the coroutine.
+**/
+template <typename T, typename... TArgs>
+struct std::coroutine_traits<monadic::completion<T>, TArgs...>
+{
+    using promise_type = monadic::detail::completion_coroutine_promise<T>;
+};
+
+#endif/*MONADIC_HAS_COROUTINES*/
+
+#endif/*__MONADIC_COROUTINE_HPP_INCLUDED__*/
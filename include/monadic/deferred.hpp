@@ -0,0 +1,216 @@
+/** \file
+ *  Header file for \c deferred.
+ *
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __MONADIC_DEFERRED_HPP_INCLUDED__
+#define __MONADIC_DEFERRED_HPP_INCLUDED__
+
+#include "completion.hpp"
+#include "exceptional.hpp"
+
+#include <type_traits>
+#include <utility>
+
+namespace monadic
+{
+
+template <typename T, typename Work>
+class deferred;
+
+namespace detail
+{
+
+/** The work of \c defer: call \c func_ and capture its result (or whatever it throws). **/
+template <typename Func>
+struct deferred_try_work
+{
+    Func func_;
+
+    auto operator()()
+            -> decltype(monadic::try_to(std::declval<Func&>()))
+    {
+        return monadic::try_to(func_);
+    }
+};
+
+/** The work of a continuation of a \c deferred: do \c work_, then feed its result through \c step_. The steps are the
+ *  same ones \c completion uses for its continuations.
+**/
+template <typename Work, typename Step>
+struct deferred_step_work
+{
+    Work work_;
+    Step step_;
+
+    auto operator()()
+            -> decltype(std::declval<Step&>()(std::declval<Work&>()()))
+    {
+        return step_(work_());
+    }
+};
+
+/** The task \c deferred::start_on hands to the executor. **/
+template <typename T, typename Work>
+struct deferred_task
+{
+    completion_promise<T> promise_;
+    Work                  work_;
+
+    void operator()()
+    {
+        if (!promise_.is_cancelled())
+            promise_.complete(work_());
+    }
+};
+
+template <typename Work>
+using deferred_work_result_t = typename decltype(std::declval<Work&>()())::value_type;
+
+template <typename Work, typename Step>
+using deferred_step_t = deferred<deferred_work_result_t<deferred_step_work<Work, Step>>,
+                                 deferred_step_work<Work, Step>
+                                >;
+
+}
+
+/** A lazy description of some work and the continuations on its result. Unlike a \c completion, nothing is shared and
+ *  nothing is allocated: a \c deferred is an ordinary value which holds the function objects it was built from, and
+ *  continuing it with \c map, \c recover or \c then returns a new \c deferred whose type includes the extra step. No
+ *  work happens until the \c deferred is consumed:
+ *
+ *   - \c run or \c get does the work on the calling thread and returns the result directly, without allocating.
+ *   - \c start does the same, but delivers the result to a new \c completion, so it can be handed to code which
+ *     expects one. Converting a \c deferred to a \c completion does this implicitly.
+ *   - \c start_on hands the work to an executor and returns a \c completion for the result. This is the only way the
+ *     work escapes the calling thread, and the only time shared state is needed.
+ *
+ *  \code
+ *  auto parsed = defer([&] { return read_file(path); })
+ *                .map(parse_config)
+ *                .recover([] (std::exception_ptr) { return config::defaults(); });
+ *
+ *  config now = std::move(parsed).get();                         // runs inline, allocates nothing
+ *  // ...or...
+ *  completion<config> later = std::move(parsed).start_on(pool);  // runs on the pool
+ *  \endcode
+ *
+ *  Every consuming function is only callable on an rvalue, since consuming a \c deferred moves its function objects
+ *  out. Copying a \c deferred (when its function objects can be copied) copies the description, so the work would be
+ *  done once for each copy which is consumed.
+ *
+ *  \tparam T    The type of value the work produces.
+ *  \tparam Work A function object taking no arguments and returning <tt>exceptional&lt;T&gt;</tt> without throwing.
+ *               This is an implementation detail -- get a \c deferred from \c defer and let \c auto spell the type.
+**/
+template <typename T, typename Work>
+class deferred
+{
+public:
+    using value_type = T;
+
+public:
+    explicit deferred(Work work) :
+            work_(std::move(work))
+    { }
+
+    /** Do the work on the calling thread and return the result, whether it succeeded or failed. **/
+    exceptional<T> run() &&
+    {
+        return work_();
+    }
+
+    /** Do the work on the calling thread and return the value (or throw the exception if it failed). **/
+    T get() &&
+    {
+        return work_().get();
+    }
+
+    /** Do the work on the calling thread and deliver the result to a new \c completion. **/
+    completion<T> start() &&
+    {
+        completion_promise<T> promise;
+        promise.complete(work_());
+        return promise.get_completion();
+    }
+
+    /** Hand the work to \a exec and return a \c completion which is delivered the result. If the returned
+     *  \c completion is disabled before \a exec gets around to the work, the work is skipped.
+     *
+     *  \param exec Any type satisfying the \ref executors "Executor" concept.
+    **/
+    template <typename Executor>
+    completion<T> start_on(Executor& exec) &&
+    {
+        completion_promise<T> promise;
+        auto result = promise.get_completion();
+        exec.execute(detail::deferred_task<T, Work> { std::move(promise), std::move(work_) });
+        return result;
+    }
+
+    /** Same as \c start. **/
+    operator completion<T>() &&
+    {
+        return std::move(*this).start();
+    }
+
+    /** \see completion::map **/
+    template <typename Func>
+    auto map(Func&& func) &&
+            -> detail::deferred_step_t<Work, detail::completion_map_step<typename std::decay<Func>::type>>
+    {
+        return continue_with(monadic::map(std::forward<Func>(func)));
+    }
+
+    /** \see completion::recover **/
+    template <typename Func>
+    auto recover(Func&& func) &&
+            -> detail::deferred_step_t<Work, detail::completion_recover_step<typename std::decay<Func>::type>>
+    {
+        return continue_with(monadic::recover(std::forward<Func>(func)));
+    }
+
+    /** \see completion::then **/
+    template <typename Func>
+    auto then(Func&& func) &&
+            -> detail::deferred_step_t<Work, detail::completion_try_step<typename std::decay<Func>::type>>
+    {
+        return continue_with(monadic::then(std::forward<Func>(func)));
+    }
+
+private:
+    template <typename Step>
+    detail::deferred_step_t<Work, Step> continue_with(Step&& step)
+    {
+        using work_type = detail::deferred_step_work<Work, Step>;
+        return detail::deferred_step_t<Work, Step>(work_type { std::move(work_), std::forward<Step>(step) });
+    }
+
+private:
+    Work work_;
+};
+
+/** Describe the work of calling \a func, without calling it yet. The resulting \c deferred produces whatever \a func
+ *  returns, or fails with whatever it throws.
+ *
+ *  \see deferred
+**/
+template <typename Func>
+auto defer(Func&& func)
+        -> deferred<detail::deferred_work_result_t<detail::deferred_try_work<typename std::decay<Func>::type>>,
+                    detail::deferred_try_work<typename std::decay<Func>::type>
+                   >
+{
+    using work_type = detail::deferred_try_work<typename std::decay<Func>::type>;
+    return deferred<detail::deferred_work_result_t<work_type>, work_type>(work_type { std::forward<Func>(func) });
+}
+
+}
+
+#endif/*__MONADIC_DEFERRED_HPP_INCLUDED__*/
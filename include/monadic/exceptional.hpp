@@ -1,6 +1,6 @@
 /** \file
  *  Header file for \c exceptional.
- *  
+ *
  *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
  *
  *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
@@ -13,14 +13,16 @@
 #define __MONADIC_EXCEPTIONAL_HPP_INCLUDED__
 
 #include <exception>
+#include <new>
 #include <stdexcept>
+#include <system_error>
 #include <type_traits>
 #include <utility>
 
 namespace monadic
 {
 
-template <typename T>
+template <typename T, typename E = std::exception_ptr>
 class exceptional;
 
 template <typename T>
@@ -29,8 +31,8 @@ struct is_exceptional_type
     using type = std::false_type;
 };
 
-template <typename T>
-struct is_exceptional_type<exceptional<T>>
+template <typename T, typename E>
+struct is_exceptional_type<exceptional<T, E>>
 {
     using type = std::true_type;
 };
@@ -38,317 +40,818 @@ struct is_exceptional_type<exceptional<T>>
 template <typename T>
 using is_exceptional = typename is_exceptional_type<T>::type;
 
-/** A type which might represent either a value or an exception.
- *  
+/** Describes how an \c exceptional treats its error type \c E. The general version treats \c E as something to
+ *  \c throw: \c get throws the error itself and functions given to \c map, \c flatmap, \c recover and \c try_to can
+ *  fail by throwing an \c E (anything else they throw passes straight through). Specialize this to change that.
+**/
+template <typename E>
+struct exceptional_error_traits
+{
+    /** Whether \c capture catches everything, which makes the operations which use it \c noexcept. **/
+    static const bool captures_all = false;
+
+    /** Check that \a error is a valid error to store (the general version accepts everything). **/
+    static void validate(const E&)
+    { }
+
+    /** Throw \a error as an exception. **/
+    [[noreturn]] static void raise(const E& error)
+    {
+        throw error;
+    }
+
+    /** Convert \a error to the \c std::exception_ptr that \c raise would throw, for converting an \c exceptional to the
+     *  <tt>exceptional&lt;T&gt;</tt> a \c completion holds.
+    **/
+    static std::exception_ptr to_exception_ptr(const E& error)
+    {
+        return std::make_exception_ptr(error);
+    }
+
+    /** Call \a func, turning any error it throws into a failed \c TResult. **/
+    template <typename TResult, typename Func>
+    static TResult capture(Func&& func) noexcept(captures_all)
+    {
+        try
+        {
+            return func();
+        }
+        catch (const E& error)
+        {
+            return TResult::failure(error);
+        }
+    }
+};
+
+/** The default error channel: anything can be thrown and is kept as-is. **/
+template <>
+struct exceptional_error_traits<std::exception_ptr>
+{
+    static const bool captures_all = true;
+
+    /** \throws std::invalid_argument if \a error is \c nullptr. **/
+    static void validate(const std::exception_ptr& error)
+    {
+        if (!error)
+            throw std::invalid_argument("exception_ptr must not be null");
+    }
+
+    [[noreturn]] static void raise(const std::exception_ptr& error)
+    {
+        std::rethrow_exception(error);
+    }
+
+    static std::exception_ptr to_exception_ptr(const std::exception_ptr& error)
+    {
+        return error;
+    }
+
+    template <typename TResult, typename Func>
+    static TResult capture(Func&& func) noexcept
+    {
+        try
+        {
+            return func();
+        }
+        catch (...)
+        {
+            return TResult::failure(std::current_exception());
+        }
+    }
+};
+
+/** Error codes travel as a \c std::system_error when thrown. **/
+template <>
+struct exceptional_error_traits<std::error_code>
+{
+    static const bool captures_all = false;
+
+    static void validate(const std::error_code&)
+    { }
+
+    [[noreturn]] static void raise(const std::error_code& error)
+    {
+        throw std::system_error(error);
+    }
+
+    static std::exception_ptr to_exception_ptr(const std::error_code& error)
+    {
+        return std::make_exception_ptr(std::system_error(error));
+    }
+
+    template <typename TResult, typename Func>
+    static TResult capture(Func&& func)
+    {
+        try
+        {
+            return func();
+        }
+        catch (const std::system_error& ex)
+        {
+            return TResult::failure(ex.code());
+        }
+    }
+};
+
+template <typename FAction, typename... TArgs>
+auto try_to(FAction&& action, TArgs&&... args) noexcept
+        -> exceptional<decltype(action(std::forward<TArgs>(args)...))>;
+
+template <typename E, typename FAction, typename... TArgs>
+auto try_to(FAction&& action, TArgs&&... args) noexcept(exceptional_error_traits<E>::captures_all)
+        -> exceptional<decltype(action(std::forward<TArgs>(args)...)), E>;
+
+namespace detail
+{
+
+enum class exceptional_kind : unsigned char
+{
+    empty,
+    value,
+    error,
+};
+
+/** What an <tt>exceptional&lt;void, E&gt;</tt> holds on success. **/
+struct exceptional_unit
+{ };
+
+/** The union which holds the value or the error of an \c exceptional, with the tag saying which. If either type is not
+ *  trivially copyable, the union's own destructor would be deleted, so this one is user-provided and does nothing
+ *  (\c exceptional_storage destroys the right member); if both are, it is left trivial.
+**/
+template <typename T, typename E, bool Trivial>
+struct exceptional_union
+{
+    union
+    {
+        E err_;
+        T val_;
+    };
+    exceptional_kind kind_;
+
+    exceptional_union() noexcept :
+            kind_(exceptional_kind::empty)
+    { }
+
+    ~exceptional_union() noexcept
+    { }
+};
+
+template <typename T, typename E>
+struct exceptional_union<T, E, true>
+{
+    union
+    {
+        E err_;
+        T val_;
+    };
+    exceptional_kind kind_;
+
+    exceptional_union() noexcept :
+            kind_(exceptional_kind::empty)
+    { }
+};
+
+template <typename T, typename E>
+struct exceptional_trivial :
+        std::integral_constant<bool, std::is_trivially_copyable<T>::value && std::is_trivially_copyable<E>::value>
+{ };
+
+/** The operations on an \c exceptional_union, shared by both kinds of \c exceptional_storage. **/
+template <typename T, typename E>
+struct exceptional_storage_base :
+        exceptional_union<T, E, exceptional_trivial<T, E>::value>
+{
+    template <typename... U>
+    void emplace_value(U&&... args)
+    {
+        new (&this->val_) T(std::forward<U>(args)...);
+        this->kind_ = exceptional_kind::value;
+    }
+
+    template <typename U>
+    void emplace_error(U&& error)
+    {
+        new (&this->err_) E(std::forward<U>(error));
+        this->kind_ = exceptional_kind::error;
+    }
+
+    /** Destroy whatever this holds, leaving it empty. **/
+    void reset() noexcept
+    {
+        if (this->kind_ == exceptional_kind::value)
+            this->val_.~T();
+        else if (this->kind_ == exceptional_kind::error)
+            this->err_.~E();
+        this->kind_ = exceptional_kind::empty;
+    }
+
+    /** Construct from \a src (which might hold a different value and error type), while this is empty. **/
+    template <typename TSource>
+    void construct_from(TSource&& src)
+    {
+        if (src.kind_ == exceptional_kind::value)
+            emplace_value(std::forward<TSource>(src).val_);
+        else if (src.kind_ == exceptional_kind::error)
+            emplace_error(convert_error(std::forward<TSource>(src).err_));
+    }
+
+    static const E& convert_error(const E& error) noexcept
+    {
+        return error;
+    }
+
+    static E&& convert_error(E&& error) noexcept
+    {
+        return std::move(error);
+    }
+
+    /** Only used to convert to \c std::exception_ptr (see \c exceptional_error_traits::to_exception_ptr). **/
+    template <typename EOther>
+    static std::exception_ptr convert_error(const EOther& error)
+    {
+        return exceptional_error_traits<EOther>::to_exception_ptr(error);
+    }
+};
+
+/** The storage for an \c exceptional: the value and the error share a union, so \c T is only ever constructed for an
+ *  instance which represents success (and does not need to be default-constructible), and the error is only touched
+ *  on failure.
+ *
+ *  When both \c T and \c E are trivially copyable, so is the storage (see the specialization below): copying it is a
+ *  plain copy of the bytes and destroying it does nothing.
+**/
+template <typename T, typename E, bool Trivial = exceptional_trivial<T, E>::value>
+struct exceptional_storage :
+        exceptional_storage_base<T, E>
+{
+    exceptional_storage() = default;
+
+    exceptional_storage(const exceptional_storage& src) noexcept(std::is_nothrow_copy_constructible<T>::value
+                                                                 && std::is_nothrow_copy_constructible<E>::value
+                                                                )
+    {
+        this->construct_from(src);
+    }
+
+    exceptional_storage(exceptional_storage&& src) noexcept(std::is_nothrow_move_constructible<T>::value
+                                                            && std::is_nothrow_move_constructible<E>::value
+                                                           )
+    {
+        this->construct_from(std::move(src));
+    }
+
+    exceptional_storage& operator=(const exceptional_storage& src)
+    {
+        if (this->kind_ == exceptional_kind::value && src.kind_ == exceptional_kind::value)
+        {
+            this->val_ = src.val_;
+        }
+        else if (this != &src)
+        {
+            this->reset();
+            this->construct_from(src);
+        }
+        return *this;
+    }
+
+    exceptional_storage& operator=(exceptional_storage&& src) noexcept(std::is_nothrow_move_constructible<T>::value
+                                                                       && std::is_nothrow_move_assignable<T>::value
+                                                                       && std::is_nothrow_move_constructible<E>::value
+                                                                      )
+    {
+        if (this->kind_ == exceptional_kind::value && src.kind_ == exceptional_kind::value)
+        {
+            this->val_ = std::move(src.val_);
+        }
+        else if (this != &src)
+        {
+            this->reset();
+            this->construct_from(std::move(src));
+        }
+        return *this;
+    }
+
+    ~exceptional_storage() noexcept
+    {
+        this->reset();
+    }
+};
+
+template <typename T, typename E>
+struct exceptional_storage<T, E, true> :
+        exceptional_storage_base<T, E>
+{ };
+
+/** Whether an <tt>exceptional&lt;U, EFrom&gt;</tt> converts to an <tt>exceptional&lt;T, ETo&gt;</tt>: the values must
+ *  convert and either the error types match or the target holds a \c std::exception_ptr.
+**/
+template <typename U, typename EFrom, typename T, typename ETo>
+struct exceptional_convertible :
+        std::integral_constant<bool,
+                               std::is_convertible<U, T>::value
+                               && (std::is_same<EFrom, ETo>::value || std::is_same<ETo, std::exception_ptr>::value)
+                              >
+{ };
+
+template <typename T, typename E>
+struct try_to
+{
+    template <typename FAction, typename... TArgs>
+    static exceptional<T, E> exec(FAction&& action, TArgs&&... args)
+            noexcept(exceptional_error_traits<E>::captures_all)
+    {
+        return exceptional_error_traits<E>::template capture<exceptional<T, E>>(
+                [&] () -> exceptional<T, E>
+                {
+                    return exceptional<T, E>::success(action(std::forward<TArgs>(args)...));
+                });
+    }
+};
+
+template <typename E>
+struct try_to<void, E>
+{
+    template <typename FAction, typename... TArgs>
+    static exceptional<void, E> exec(FAction&& action, TArgs&&... args)
+            noexcept(exceptional_error_traits<E>::captures_all)
+    {
+        return exceptional_error_traits<E>::template capture<exceptional<void, E>>(
+                [&] () -> exceptional<void, E>
+                {
+                    action(std::forward<TArgs>(args)...);
+                    return exceptional<void, E>::success();
+                });
+    }
+};
+
+}
+
+/** A type which might represent either a value or an error. By default, the error is an exception in an
+ *  \c std::exception_ptr, which can hold anything but costs an allocation (and an atomic reference count) to create.
+ *  For failures which are expected and frequent, give a cheaper error type as \c E -- an \c std::error_code or an
+ *  \c enum -- which is stored inline:
+ *
+ *  \code
+ *  exceptional<entry, std::error_code> lookup(key k)
+ *  {
+ *      if (auto* found = cache.find(k))
+ *          return exceptional<entry, std::error_code>::success(*found);
+ *      else
+ *          return exceptional<entry, std::error_code>::failure(make_error_code(std::errc::no_such_file_or_directory));
+ *  }
+ *  \endcode
+ *
+ *  How an error type is thrown and caught is described by \c exceptional_error_traits. With a typed error, functions
+ *  given to \c map, \c flatmap, \c recover and \c try_to can only fail by throwing the error type (or, for
+ *  \c std::error_code, an \c std::system_error); anything else they throw is not caught. Any <tt>exceptional&lt;T,
+ *  E&gt;</tt> converts to the <tt>exceptional&lt;T&gt;</tt> a \c completion holds, by turning the error into the
+ *  \c std::exception_ptr it would have thrown.
+ *
+ *  The value and the error share storage (a discriminated union), so an instance is only as big as the larger of the
+ *  two plus a tag, and \c T is only ever constructed for an instance which represents success -- it does not need to
+ *  be default-constructible. Copying or moving a successful instance only copies or moves the \c T; the error is only
+ *  touched on failure. When both \c T and \c E are trivially copyable (such as an \c int with an \c std::error_code),
+ *  so is the \c exceptional, and copying one is a plain copy of the bytes.
+ *
+ *  A default-constructed instance is empty: it represents neither success nor failure, and \c get throws
+ *  \c std::logic_error. It is only useful as something to assign to (such as the slot for a value which has not been
+ *  delivered yet). Continuing an empty instance with \c map, \c flatmap or \c recover gives another empty instance.
+ *
+ *  \tparam E The type of error. The default of \c std::exception_ptr can hold any exception.
+ *
  *  \see try_to
 **/
-template <typename T>
-class exceptional
+template <typename T, typename E>
+class exceptional :
+        private detail::exceptional_storage<T, E>
 {
+    using storage_type = detail::exceptional_storage<T, E>;
+    using traits_type  = exceptional_error_traits<E>;
+
 public:
     /** The type of value stored in an \c exceptional instance on success. **/
     using value_type = T;
-    
+
+    /** The type of error stored in an \c exceptional instance on failure. **/
+    using error_type = E;
+
 public:
+    /** Create an empty instance. **/
     exceptional() = default;
-    
-    /** Casting constructor for \c exceptional values. **/
-    template <typename U>
-    exceptional(exceptional<U> src,
-                typename std::enable_if<std::is_convertible<U, T>::value>::type* = nullptr
-               ) noexcept(noexcept(T(std::declval<U&&>()))) :
-            ex_(std::move(src.ex_)),
-            val_(std::move(src.val_))
-    { }
-    
+
+    exceptional(const exceptional&) = default;
+    exceptional(exceptional&&) = default;
+    exceptional& operator=(const exceptional&) = default;
+    exceptional& operator=(exceptional&&) = default;
+
+    /** Casting constructor for \c exceptional values. This also converts an instance with any error type to one with
+     *  \c std::exception_ptr, using \c exceptional_error_traits::to_exception_ptr.
+    **/
+    template <typename U, typename EOther>
+    exceptional(exceptional<U, EOther> src,
+                typename std::enable_if<detail::exceptional_convertible<U, EOther, T, E>::value>::type* = nullptr
+               ) noexcept(noexcept(T(std::declval<U&&>())) && std::is_same<E, EOther>::value)
+    {
+        this->construct_from(static_cast<detail::exceptional_storage<U, EOther>&&>(src));
+    }
+
     /** Forward the \a args to construct a value for this \c exceptional. **/
     template <typename... U>
     explicit exceptional(const std::piecewise_construct_t&, U&&... args)
-                noexcept(noexcept(T(std::forward<U>(args)...))) :
-            val_(std::forward<U>(args)...)
-    { }
-    
+                noexcept(noexcept(T(std::forward<U>(args)...)))
+    {
+        this->emplace_value(std::forward<U>(args)...);
+    }
+
     /** Create an instance with \c is_success as \c true and a value constructed in-place with \a args. **/
     template <typename... U>
     static exceptional success(U&&... args)
     {
         return exceptional(std::piecewise_construct, std::forward<U>(args)...);
     }
-    
-    /** Create an instance with \c is_success as \c false and the provided exception value \a ex.
-     *  
-     *  \throws std::invalid_argument if \a ex is \c nullptr.
+
+    /** Create an instance with \c is_success as \c false and the provided \a error.
+     *
+     *  \throws std::invalid_argument if \a error is a null \c std::exception_ptr.
     **/
-    static exceptional failure(std::exception_ptr ex)
+    static exceptional failure(E error)
     {
-        if (!ex)
-            throw std::invalid_argument("exception_ptr must not be null");
-        
+        traits_type::validate(error);
         exceptional out;
-        out.ex_ = std::move(ex);
+        out.emplace_error(std::move(error));
         return out;
     }
-    
+
     /** Check if this value represents success. If this returns \c true, \c get will not throw. **/
     bool is_success() const noexcept
     {
-        return !ex_;
+        return this->kind_ == detail::exceptional_kind::value;
     }
-    
+
     /** Check if this value represents failure. If this returns \c true, \c get will throw. **/
     bool is_failure() const noexcept
     {
-        return !!ex_;
+        return this->kind_ == detail::exceptional_kind::error;
+    }
+
+    /** Make this instance empty, destroying the value or error it held. This is cheaper than assigning an empty
+     *  instance to it.
+    **/
+    void reset() noexcept
+    {
+        storage_type::reset();
     }
-    
+
     /** Get the contained value of this instance if this instance represents success (\c is_success == \c true); throws
      *  the exception if this instance represents failure (\c is_success == \c false).
     **/
     const value_type& get() const &
     {
-        if (ex_)
-            std::rethrow_exception(ex_);
-        else
-            return val_;
+        check();
+        return this->val_;
     }
-    
+
     /** Get the contained value of this instance if this instance represents success (\c is_success == \c true); throws
      *  the exception if this instance represents failure (\c is_success == \c false).
     **/
     value_type& get() &
     {
-        if (ex_)
-            std::rethrow_exception(ex_);
-        else
-            return val_;
+        check();
+        return this->val_;
     }
-    
+
     /** Get the contained value of this instance if this instance represents success (\c is_success == \c true); throws
      *  the exception if this instance represents failure (\c is_success == \c false).
     **/
     value_type&& get() &&
     {
-        if (ex_)
-            std::rethrow_exception(ex_);
-        else
-            return std::move(val_);
+        check();
+        return std::move(this->val_);
     }
-    
+
+    /** Get the error of this instance, which must represent failure.
+     *
+     *  \throws std::logic_error if \c is_failure is \c false.
+    **/
+    const error_type& error() const
+    {
+        if (!is_failure())
+            throw std::logic_error("exceptional does not hold an error");
+        return this->err_;
+    }
+
     /** Invoke the provided \a action if this instance represents success and return a new instance with the result of
-     *  \a action. If this instance is not successful, return a new instance with the exception. If invoking \a action
-     *  throws, the result will also be a failure.
+     *  \a action. If this instance is not successful, return a new instance with the error. If invoking \a action
+     *  throws (an error, for a typed \c E), the result will also be a failure.
     **/
     template <typename FAction>
-    auto map(FAction&& action) const & noexcept
-            -> exceptional<decltype(action(std::declval<const value_type&>()))>;
-    
+    auto map(FAction&& action) const & noexcept(traits_type::captures_all)
+            -> exceptional<decltype(action(std::declval<const value_type&>())), E>
+    {
+        using result_type = exceptional<decltype(action(std::declval<const value_type&>())), E>;
+        if (is_success())
+            return try_to<E>(std::forward<FAction>(action), this->val_);
+        else
+            return pass_on<result_type>(*this);
+    }
+
     /** Invoke the provided \a action if this instance represents success and return a new instance with the result of
-     *  \a action. If this instance is not successful, return a new instance with the exception. If invoking \a action
-     *  throws, the result will also be a failure.
+     *  \a action. If this instance is not successful, return a new instance with the error. If invoking \a action
+     *  throws (an error, for a typed \c E), the result will also be a failure.
     **/
     template <typename FAction>
-    auto map(FAction&& action) & noexcept
-            -> exceptional<decltype(action(std::declval<value_type&>()))>;
-    
+    auto map(FAction&& action) & noexcept(traits_type::captures_all)
+            -> exceptional<decltype(action(std::declval<value_type&>())), E>
+    {
+        using result_type = exceptional<decltype(action(std::declval<value_type&>())), E>;
+        if (is_success())
+            return try_to<E>(std::forward<FAction>(action), this->val_);
+        else
+            return pass_on<result_type>(*this);
+    }
+
     /** Invoke the provided \a action if this instance represents success and return a new instance with the result of
-     *  \a action. If this instance is not successful, return a new instance with the exception. If invoking \a action
-     *  throws, the result will also be a failure.
+     *  \a action. If this instance is not successful, return a new instance with the error. If invoking \a action
+     *  throws (an error, for a typed \c E), the result will also be a failure.
     **/
     template <typename FAction>
-    auto map(FAction&& action) && noexcept
-            -> exceptional<decltype(action(std::declval<value_type&&>()))>;
-    
-    /** Similar to \c map, but useful if your provided \a action returns an <tt>exceptional&lt;U&gt;</tt>. In this case,
-     *  the result is automatically flattened from <tt>exceptional&lt;exceptional&lt;U&gt;&gt;</tt> (if you had used
-     *  \c map).
+    auto map(FAction&& action) && noexcept(traits_type::captures_all)
+            -> exceptional<decltype(action(std::declval<value_type&&>())), E>
+    {
+        using result_type = exceptional<decltype(action(std::declval<value_type&&>())), E>;
+        if (is_success())
+            return try_to<E>(std::forward<FAction>(action), std::move(this->val_));
+        else
+            return pass_on<result_type>(std::move(*this));
+    }
+
+    /** Similar to \c map, but useful if your provided \a action returns an <tt>exceptional&lt;U, E&gt;</tt>. In this
+     *  case, the result is automatically flattened from <tt>exceptional&lt;exceptional&lt;U, E&gt;, E&gt;</tt> (if you
+     *  had used \c map).
     **/
     template <typename FAction>
-    auto flatmap(FAction&& action) const & noexcept
+    auto flatmap(FAction&& action) const & noexcept(traits_type::captures_all)
             -> decltype(action(std::declval<const value_type&>()))
     {
-        static_assert(is_exceptional<decltype(action(std::declval<const value_type&>()))>::value,
-                      "function for flatmap must return an exceptional<U>"
-                     );
-        return map(std::forward<FAction>(action)).get();
+        using result_type = decltype(action(std::declval<const value_type&>()));
+        static_assert(is_exceptional<result_type>::value, "function for flatmap must return an exceptional<U>");
+        if (is_success())
+            return traits_type::template capture<result_type>([&] () -> result_type { return action(this->val_); });
+        else
+            return pass_on<result_type>(*this);
     }
-    
-    /** Similar to \c map, but useful if your provided \a action returns an <tt>exceptional&lt;U&gt;</tt>. In this case,
-     *  the result is automatically flattened from <tt>exceptional&lt;exceptional&lt;U&gt;&gt;</tt> (if you had used
-     *  \c map).
+
+    /** Similar to \c map, but useful if your provided \a action returns an <tt>exceptional&lt;U, E&gt;</tt>. In this
+     *  case, the result is automatically flattened from <tt>exceptional&lt;exceptional&lt;U, E&gt;, E&gt;</tt> (if you
+     *  had used \c map).
     **/
     template <typename FAction>
-    auto flatmap(FAction&& action) & noexcept
+    auto flatmap(FAction&& action) & noexcept(traits_type::captures_all)
             -> decltype(action(std::declval<value_type&>()))
     {
-        static_assert(is_exceptional<decltype(action(std::declval<value_type&>()))>::value,
-                      "function for flatmap must return an exceptional<U>"
-                     );
-        return map(std::forward<FAction>(action)).get();
+        using result_type = decltype(action(std::declval<value_type&>()));
+        static_assert(is_exceptional<result_type>::value, "function for flatmap must return an exceptional<U>");
+        if (is_success())
+            return traits_type::template capture<result_type>([&] () -> result_type { return action(this->val_); });
+        else
+            return pass_on<result_type>(*this);
     }
-    
-    /** Similar to \c map, but useful if your provided \a action returns an <tt>exceptional&lt;U&gt;</tt>. In this case,
-     *  the result is automatically flattened from <tt>exceptional&lt;exceptional&lt;U&gt;&gt;</tt> (if you had used
-     *  \c map).
+
+    /** Similar to \c map, but useful if your provided \a action returns an <tt>exceptional&lt;U, E&gt;</tt>. In this
+     *  case, the result is automatically flattened from <tt>exceptional&lt;exceptional&lt;U, E&gt;, E&gt;</tt> (if you
+     *  had used \c map).
     **/
     template <typename FAction>
-    auto flatmap(FAction&& action) & noexcept
+    auto flatmap(FAction&& action) && noexcept(traits_type::captures_all)
             -> decltype(action(std::declval<value_type&&>()))
     {
-        static_assert(is_exceptional<decltype(action(std::declval<value_type&&>()))>::value,
-                      "function for flatmap must return an exceptional<U>"
-                     );
-        return map(std::forward<FAction>(action)).get();
+        using result_type = decltype(action(std::declval<value_type&&>()));
+        static_assert(is_exceptional<result_type>::value, "function for flatmap must return an exceptional<U>");
+        if (is_success())
+            return traits_type::template capture<result_type>([&] () -> result_type
+                                                              {
+                                                                  return action(std::move(this->val_));
+                                                              });
+        else
+            return pass_on<result_type>(std::move(*this));
     }
-    
+
     /** Call some \a action if this instance is not success (the opposite of \c map).
-     *  
-     *  \param action is some function which is given an \c std::exception_ptr and returns a value. It is only called if
-     *                \c is_success is \c false.
+     *
+     *  \param action is some function which is given the \c error_type and returns a value. It is only called if
+     *                \c is_failure is \c true.
      *  \returns An instance with a copy of the value in this one if \c is_success is \c true; an instance with the
      *           result of calling \a action if \c is_success if \c false and it returns in success; otherwise, the
-     *           result will have the exception thrown from \a action.
+     *           result will have the error thrown from \a action.
     **/
     template <typename FAction>
-    auto recover(FAction&& action) const & noexcept
-            -> exceptional<typename std::common_type<T, decltype(action(std::exception_ptr()))>::type>;
-    
+    auto recover(FAction&& action) const & noexcept(traits_type::captures_all)
+            -> exceptional<typename std::common_type<T, decltype(action(std::declval<const E&>()))>::type, E>
+    {
+        using result_type = exceptional<typename std::common_type<T, decltype(action(std::declval<const E&>()))>::type,
+                                        E
+                                       >;
+        if (is_failure())
+            return try_to<E>(std::forward<FAction>(action), this->err_);
+        else
+            return traits_type::template capture<result_type>([this] () -> result_type { return *this; });
+    }
+
     /** Call some \a action if this instance is not success (the opposite of \c map).
-     *  
-     *  \param action is some function which is given an \c std::exception_ptr and returns a value. It is only called if
-     *                \c is_success is \c false.
-     *  \returns An instance with a copy of the value in this one if \c is_success is \c true; an instance with the
-     *           result of calling \a action if \c is_success if \c false and it returns in success; otherwise, the
-     *           result will have the exception thrown from \a action.
+     *
+     *  \param action is some function which is given the \c error_type and returns a value. It is only called if
+     *                \c is_failure is \c true.
+     *  \returns An instance with the value in this one if \c is_success is \c true; an instance with the result of
+     *           calling \a action if \c is_success if \c false and it returns in success; otherwise, the result will
+     *           have the error thrown from \a action.
     **/
     template <typename FAction>
-    auto recover(FAction&& action) && noexcept
-            -> exceptional<typename std::common_type<T, decltype(action(std::exception_ptr()))>::type>;
-    
+    auto recover(FAction&& action) && noexcept(traits_type::captures_all)
+            -> exceptional<typename std::common_type<T, decltype(action(std::declval<const E&>()))>::type, E>
+    {
+        using result_type = exceptional<typename std::common_type<T, decltype(action(std::declval<const E&>()))>::type,
+                                        E
+                                       >;
+        if (is_failure())
+            return try_to<E>(std::forward<FAction>(action), static_cast<const E&>(this->err_));
+        else
+            return traits_type::template capture<result_type>([this] () -> result_type { return std::move(*this); });
+    }
+
 private:
-    template <typename U>
+    template <typename U, typename EOther>
     friend class exceptional;
-    
-private:
-    std::exception_ptr ex_;
-    value_type         val_;
+
+    /** Throw the error if this represents failure (or \c std::logic_error if this is empty). **/
+    void check() const
+    {
+        if (this->kind_ != detail::exceptional_kind::value)
+        {
+            if (this->kind_ == detail::exceptional_kind::error)
+                traits_type::raise(this->err_);
+            else
+                throw std::logic_error("exceptional is empty");
+        }
+    }
+
+    /** Get a \c TResult with the error in \a src (which does not represent success), or an empty one if \a src is
+     *  empty.
+    **/
+    template <typename TResult, typename TSelf>
+    static TResult pass_on(TSelf&& src)
+    {
+        TResult out;
+        out.reset();
+        if (src.kind_ == detail::exceptional_kind::error)
+            out.emplace_error(std::forward<TSelf>(src).err_);
+        return out;
+    }
 };
 
-template <>
-class exceptional<void>
+/** An \c exceptional with nothing to hold on success. Unlike the general version, a default-constructed instance
+ *  represents success.
+**/
+template <typename E>
+class exceptional<void, E> :
+        private detail::exceptional_storage<detail::exceptional_unit, E>
 {
+    using storage_type = detail::exceptional_storage<detail::exceptional_unit, E>;
+    using traits_type  = exceptional_error_traits<E>;
+
+public:
+    using value_type = void;
+    using error_type = E;
+
 public:
     exceptional() noexcept
-    { }
-    
+    {
+        this->emplace_value();
+    }
+
     exceptional(const std::piecewise_construct_t&) noexcept
-    { }
-    
+    {
+        this->emplace_value();
+    }
+
+    exceptional(const exceptional&) = default;
+    exceptional(exceptional&&) = default;
+    exceptional& operator=(const exceptional&) = default;
+    exceptional& operator=(exceptional&&) = default;
+
+    /** Convert an instance with any error type to one with \c std::exception_ptr. **/
+    template <typename EOther>
+    exceptional(exceptional<void, EOther> src,
+                typename std::enable_if<!std::is_same<E, EOther>::value
+                                        && std::is_same<E, std::exception_ptr>::value
+                                       >::type* = nullptr
+               )
+    {
+        this->construct_from(static_cast<detail::exceptional_storage<detail::exceptional_unit, EOther>&&>(src));
+    }
+
     /** Create an empty, successful instance. **/
     static exceptional success()
     {
         return exceptional();
     }
-    
-    /** Create an instance with \c is_success as \c false and the provided exception value \a ex.
-     *  
-     *  \throws std::invalid_argument if \a ex is \c nullptr.
+
+    /** Create an instance with \c is_success as \c false and the provided \a error.
+     *
+     *  \throws std::invalid_argument if \a error is a null \c std::exception_ptr.
     **/
-    static exceptional failure(std::exception_ptr ex)
+    static exceptional failure(E error)
     {
-        if (!ex)
-            throw std::invalid_argument("exception_ptr must not be null");
+        traits_type::validate(error);
         exceptional out;
-        out.ex_ = std::move(ex);
+        out.reset();
+        out.emplace_error(std::move(error));
         return out;
     }
-    
-    /** Throws an exception if this instance represents failure; does nothing if this represents success. **/
+
+    /** Throws the error if this instance represents failure; does nothing if this represents success. **/
     void get() const
     {
-        if (ex_)
-            std::rethrow_exception(ex_);
+        if (this->kind_ == detail::exceptional_kind::error)
+            traits_type::raise(this->err_);
     }
-    
+
     /** Check if this value represents success. If this returns \c true, \c get will not throw. **/
     bool is_success() const noexcept
     {
-        return !ex_;
+        return this->kind_ == detail::exceptional_kind::value;
     }
-    
+
     /** Check if this value represents failure. If this returns \c true, \c get will throw. **/
     bool is_failure() const noexcept
     {
-        return !!ex_;
+        return this->kind_ == detail::exceptional_kind::error;
     }
-    
+
+    /** Make this instance empty, destroying the value or error it held. This is cheaper than assigning an empty
+     *  instance to it.
+    **/
+    void reset() noexcept
+    {
+        storage_type::reset();
+    }
+
+    /** Get the error of this instance, which must represent failure.
+     *
+     *  \throws std::logic_error if \c is_failure is \c false.
+    **/
+    const error_type& error() const
+    {
+        if (!is_failure())
+            throw std::logic_error("exceptional does not hold an error");
+        return this->err_;
+    }
+
     template <typename FAction>
-    auto map(FAction&& action) const noexcept
-            -> exceptional<decltype(action())>;
-    
+    auto map(FAction&& action) const noexcept(traits_type::captures_all)
+            -> exceptional<decltype(action()), E>
+    {
+        if (is_failure())
+            return exceptional<decltype(action()), E>::failure(this->err_);
+        else
+            return try_to<E>(std::forward<FAction>(action));
+    }
+
     template <typename FAction>
-    auto flatmap(FAction&& action) const noexcept
+    auto flatmap(FAction&& action) const noexcept(traits_type::captures_all)
             -> decltype(action())
     {
-        static_assert(is_exceptional<decltype(action())>::value, "function for flatmap must return an exceptional<U>");
-        return map(std::forward<FAction>(action)).get();
+        using result_type = decltype(action());
+        static_assert(is_exceptional<result_type>::value, "function for flatmap must return an exceptional<U>");
+        if (is_failure())
+            return result_type::failure(this->err_);
+        else
+            return traits_type::template capture<result_type>([&] () -> result_type { return action(); });
     }
-    
+
     /** Call some \a action if this instance is not success.
-     *  
-     *  \param action is some function which is given an \c std::exception_ptr and returns \c void. It is only called if
+     *
+     *  \param action is some function which is given the \c error_type and returns \c void. It is only called if
      *                \c is_success is \c false.
      *  \returns An instance that has \c is_success as \c true if \c is_success is \c true or \a action did not throw an
-     *           exception; otherwise, the result will have the exception thrown from \a action.
+     *           error; otherwise, the result will have the error thrown from \a action.
     **/
     template <typename FAction>
-    auto recover(FAction&& action) const noexcept -> exceptional<void>;
-    
-private:
-    std::exception_ptr ex_;
-};
-
-namespace detail
-{
-
-template <typename T>
-struct try_to
-{
-    template <typename FAction, typename... TArgs>
-    static exceptional<T> exec(FAction&& action, TArgs&&... args) noexcept
+    auto recover(FAction&& action) const noexcept(traits_type::captures_all) -> exceptional<void, E>
     {
-        try
-        {
-            return exceptional<T>::success(action(std::forward<TArgs>(args)...));
-        }
-        catch (...)
-        {
-            return exceptional<T>::failure(std::current_exception());
-        }
+        if (is_success())
+            return *this;
+        else
+            return try_to<E>(std::forward<FAction>(action), this->err_);
     }
-};
 
-template <>
-struct try_to<void>
-{
-    template <typename FAction, typename... TArgs>
-    static exceptional<void> exec(FAction&& action, TArgs&&... args) noexcept
-    {
-        try
-        {
-            action(std::forward<TArgs>(args)...);
-            return exceptional<void>::success();
-        }
-        catch (...)
-        {
-            return exceptional<void>::failure(std::current_exception());
-        }
-    }
+private:
+    template <typename U, typename EOther>
+    friend class exceptional;
 };
 
-}
-
 /** Attempt to execute an \a action with the given \a args.
- *  
+ *
  *  \returns On success, the \c exceptional will have the result of the function. On failure, the returned value will be
  *   filled with an exception.
 **/
@@ -356,104 +859,23 @@ template <typename FAction, typename... TArgs>
 auto try_to(FAction&& action, TArgs&&... args) noexcept
         -> exceptional<decltype(action(std::forward<TArgs>(args)...))>
 {
-    return detail::try_to<decltype(action(std::forward<TArgs>(args)...))>
+    return detail::try_to<decltype(action(std::forward<TArgs>(args)...)), std::exception_ptr>
                      ::exec(std::forward<FAction>(action), std::forward<TArgs>(args)...);
 }
 
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Implementation                                                                                                     //
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-template <typename T>
-template <typename FAction>
-auto exceptional<T>::map(FAction&& action) const & noexcept
-        -> exceptional<decltype(action(std::declval<const value_type&>()))>
-{
-    if (ex_)
-        return exceptional<decltype(action(get()))>::failure(ex_);
-    else
-        return try_to(std::forward<FAction>(action), get());
-}
-
-template <typename T>
-template <typename FAction>
-auto exceptional<T>::map(FAction&& action) & noexcept
-        -> exceptional<decltype(action(std::declval<value_type&>()))>
-{
-    if (ex_)
-        return exceptional<decltype(action(get()))>::failure(ex_);
-    else
-        return try_to(std::forward<FAction>(action), get());
-}
-
-template <typename T>
-template <typename FAction>
-auto exceptional<T>::map(FAction&& action) && noexcept
-        -> exceptional<decltype(action(std::declval<value_type&&>()))>
-{
-    if (ex_)
-        return exceptional<decltype(action(get()))>::failure(ex_);
-    else
-        return try_to(std::forward<FAction>(action), std::move(val_));
-}
-
-template <typename FAction>
-auto exceptional<void>::map(FAction&& action) const noexcept
-        -> exceptional<decltype(action())>
-{
-    if (ex_)
-        return exceptional<decltype(action())>::failure(ex_);
-    else
-        return try_to(std::forward<FAction>(action));
-}
-
-template <typename T>
-template <typename FAction>
-auto exceptional<T>::recover(FAction&& action) const & noexcept
-        -> exceptional<typename std::common_type<T, decltype(action(std::exception_ptr()))>::type>
-{
-    using result_type = exceptional<typename std::common_type<T, decltype(action(std::exception_ptr()))>::type>;
-    
-    try
-    {
-        if (is_success())
-            return *this;
-        else
-            return result_type::success(std::forward<FAction>(action)(ex_));
-    }
-    catch (...)
-    {
-        return result_type::failure(std::current_exception());
-    }
-}
-
-template <typename T>
-template <typename FAction>
-auto exceptional<T>::recover(FAction&& action) && noexcept
-        -> exceptional<typename std::common_type<T, decltype(action(std::exception_ptr()))>::type>
-{
-    using result_type = exceptional<typename std::common_type<T, decltype(action(std::exception_ptr()))>::type>;
-    
-    try
-    {
-        if (is_success())
-            return std::move(*this);
-        else
-            return result_type::success(std::forward<FAction>(action)(ex_));
-    }
-    catch (...)
-    {
-        return result_type::failure(std::current_exception());
-    }
-}
-
-template <typename FAction>
-auto exceptional<void>::recover(FAction&& action) const noexcept -> exceptional<void>
+/** Attempt to execute an \a action with the given \a args, capturing errors of type \c E (as described by
+ *  \c exceptional_error_traits) -- anything else \a action throws passes through.
+ *
+ *  \code
+ *  exceptional<int, std::error_code> x = try_to<std::error_code>(parse_port, text);  // catches std::system_error
+ *  \endcode
+**/
+template <typename E, typename FAction, typename... TArgs>
+auto try_to(FAction&& action, TArgs&&... args) noexcept(exceptional_error_traits<E>::captures_all)
+        -> exceptional<decltype(action(std::forward<TArgs>(args)...)), E>
 {
-    if (is_success())
-        return *this;
-    else
-        return try_to([this, &action] { std::forward<FAction>(action)(ex_); });
+    return detail::try_to<decltype(action(std::forward<TArgs>(args)...)), E>
+                     ::exec(std::forward<FAction>(action), std::forward<TArgs>(args)...);
 }
 
 }
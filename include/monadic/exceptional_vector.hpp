@@ -0,0 +1,401 @@
+/** \file
+ *  Header file for \c exceptional_vector.
+ *
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __MONADIC_EXCEPTIONAL_VECTOR_HPP_INCLUDED__
+#define __MONADIC_EXCEPTIONAL_VECTOR_HPP_INCLUDED__
+
+#include "exceptional.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace monadic
+{
+
+namespace detail
+{
+
+/** The position of the lowest set bit of \a bits, which must not be 0. **/
+inline unsigned count_trailing_zeros(std::uint64_t bits) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return unsigned(__builtin_ctzll(bits));
+#else
+    unsigned count = 0;
+    for (; !(bits & 1); bits >>= 1)
+        ++count;
+    return count;
+#endif
+}
+
+}
+
+/** A sequence of <tt>exceptional&lt;T, E&gt;</tt> laid out as a structure of arrays, for batches where most elements
+ *  succeed. The values are kept contiguously in one array, a bitmap records which elements succeeded, and the errors
+ *  of the elements which failed are kept in a sparse table sorted by position. Compared to a
+ *  <tt>std::vector&lt;exceptional&lt;T&gt;&gt;</tt>, the values are not interleaved with an error and a tag, so bulk
+ *  operations touch only the memory they need and \c map over a run of successful elements is a plain loop over an
+ *  array, which the compiler can vectorize.
+ *
+ *  \code
+ *  exceptional_vector<double> scores;
+ *  for (const row& r : batch)
+ *      scores.push_back(try_to(score, r));
+ *
+ *  auto adjusted = scores.map([] (double x) { return x * weight; })
+ *                        .recover([] (const std::exception_ptr&) { return 0.0; });
+ *  \endcode
+ *
+ *  A failed element still has a slot in the value array, which holds a value-initialized \c T, so \c T must be
+ *  default-constructible. Functions given to \c map are only ever called on successful elements.
+ *
+ *  \tparam E The error type, as in \c exceptional.
+**/
+template <typename T, typename E = std::exception_ptr>
+class exceptional_vector
+{
+public:
+    using value_type   = T;
+    using error_type   = E;
+    using element_type = exceptional<T, E>;
+    using size_type    = std::size_t;
+
+    static_assert(!std::is_void<T>::value, "exceptional_vector does not support void");
+
+public:
+    exceptional_vector() = default;
+
+    /** Create a vector of \a count successful elements which are all \a value. **/
+    explicit exceptional_vector(size_type count, const T& value = T()) :
+            values_(count, value),
+            success_(word_count(count), ~std::uint64_t(0))
+    {
+        clear_tail();
+    }
+
+    size_type size() const noexcept
+    {
+        return values_.size();
+    }
+
+    bool empty() const noexcept
+    {
+        return values_.empty();
+    }
+
+    void reserve(size_type capacity)
+    {
+        values_.reserve(capacity);
+        success_.reserve(word_count(capacity));
+    }
+
+    void clear() noexcept
+    {
+        values_.clear();
+        success_.clear();
+        errors_.clear();
+    }
+
+    /** Append a successful element. **/
+    void push_back(T value)
+    {
+        grow();
+        values_.push_back(std::move(value));
+        set_success(values_.size() - 1);
+    }
+
+    /** Append a failed element. **/
+    void push_failure(E error)
+    {
+        exceptional_error_traits<E>::validate(error);
+        grow();
+        values_.emplace_back();
+        try
+        {
+            errors_.emplace_back(values_.size() - 1, std::move(error));
+        }
+        catch (...)
+        {
+            // Do not leave an element which is neither a success nor a failure.
+            values_.pop_back();
+            throw;
+        }
+    }
+
+    /** Append an element, which might represent success or failure.
+     *
+     *  \throws std::invalid_argument if \a element is empty.
+    **/
+    void push_back(element_type element)
+    {
+        if (element.is_success())
+            push_back(std::move(element).get());
+        else if (element.is_failure())
+            push_failure(element.error());
+        else
+            throw std::invalid_argument("exceptional_vector can not hold an empty exceptional");
+    }
+
+    /** Check if the element at \a idx represents success. **/
+    bool is_success(size_type idx) const noexcept
+    {
+        return (success_[idx / 64] >> (idx % 64)) & 1;
+    }
+
+    /** Get the element at \a idx as an \c exceptional. **/
+    element_type operator[](size_type idx) const
+    {
+        if (is_success(idx))
+            return element_type::success(values_[idx]);
+        else
+            return element_type::failure(error(idx));
+    }
+
+    /** Get the value of the element at \a idx, which must represent success; if it represents failure, the error is
+     *  thrown (as \c exceptional::get would).
+    **/
+    const T& get(size_type idx) const
+    {
+        if (!is_success(idx))
+            exceptional_error_traits<E>::raise(error(idx));
+        return values_[idx];
+    }
+
+    /** Get the error of the element at \a idx.
+     *
+     *  \throws std::logic_error if the element represents success.
+    **/
+    const E& error(size_type idx) const
+    {
+        auto iter = std::lower_bound(errors_.begin(), errors_.end(), idx,
+                                     [] (const error_entry& entry, size_type x) { return entry.first < x; }
+                                    );
+        if (iter == errors_.end() || iter->first != idx)
+            throw std::logic_error("exceptional_vector element does not hold an error");
+        return iter->second;
+    }
+
+    /** The values, in a contiguous array of \c size elements. The values of failed elements are value-initialized. **/
+    const T* values() const noexcept
+    {
+        return values_.data();
+    }
+
+    size_type success_count() const noexcept
+    {
+        return size() - errors_.size();
+    }
+
+    size_type failure_count() const noexcept
+    {
+        return errors_.size();
+    }
+
+    /** Get a vector with the result of calling \a func on the value of every successful element, in the same positions.
+     *  Failed elements keep their error. If \a func throws on an element (an error, for a typed \c E), that element
+     *  fails with what it threw.
+     *
+     *  Each block of 64 elements which all succeeded is mapped with a plain loop over the value array; blocks with
+     *  failures in them visit only their successful elements.
+     *
+     *  \see exceptional::map
+    **/
+    template <typename FAction>
+    auto map(FAction&& action) const
+            -> exceptional_vector<typename std::decay<decltype(action(std::declval<const T&>()))>::type, E>
+    {
+        using result_value = typename std::decay<decltype(action(std::declval<const T&>()))>::type;
+        using result_type  = exceptional_vector<result_value, E>;
+
+        result_type out;
+        out.values_.resize(size());
+        out.success_ = success_;
+
+        std::vector<error_entry> failed;
+        const T*      in  = values_.data();
+        result_value* dst = out.values_.data();
+        for (size_type word = 0; word < success_.size(); ++word)
+        {
+            std::uint64_t bits  = success_[word];
+            size_type     first = word * 64;
+            size_type     count = std::min<size_type>(64, size() - first);
+            if (bits == full_word(count))
+            {
+                size_type idx = first;
+                while (idx < first + count)
+                {
+                    try
+                    {
+                        for (; idx < first + count; ++idx)
+                            dst[idx] = action(in[idx]);
+                    }
+                    catch (...)
+                    {
+                        failed.emplace_back(idx, current_error());
+                        out.clear_success(idx);
+                        ++idx;
+                    }
+                }
+            }
+            else
+            {
+                while (bits)
+                {
+                    size_type idx = first + size_type(detail::count_trailing_zeros(bits));
+                    bits &= bits - 1;
+                    try
+                    {
+                        dst[idx] = action(in[idx]);
+                    }
+                    catch (...)
+                    {
+                        failed.emplace_back(idx, current_error());
+                        out.clear_success(idx);
+                    }
+                }
+            }
+        }
+
+        out.errors_ = merge_errors(errors_, std::move(failed));
+        return out;
+    }
+
+    /** Get a vector where every failed element is replaced by the result of calling \a action with its error. If
+     *  \a action throws (an error, for a typed \c E), the element fails with that instead. This only visits the failed
+     *  elements.
+     *
+     *  \see exceptional::recover
+    **/
+    template <typename FAction>
+    exceptional_vector recover(FAction&& action) const &
+    {
+        exceptional_vector out(*this);
+        out.recover_in_place(std::forward<FAction>(action));
+        return out;
+    }
+
+    /** \see recover **/
+    template <typename FAction>
+    exceptional_vector recover(FAction&& action) &&
+    {
+        recover_in_place(std::forward<FAction>(action));
+        return std::move(*this);
+    }
+
+private:
+    template <typename U, typename EOther>
+    friend class exceptional_vector;
+
+    using error_entry = std::pair<size_type, E>;
+
+    static size_type word_count(size_type count) noexcept
+    {
+        return (count + 63) / 64;
+    }
+
+    static std::uint64_t full_word(size_type count) noexcept
+    {
+        return count == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << count) - 1;
+    }
+
+    /** Make room in the bitmap for one more element. **/
+    void grow()
+    {
+        if (values_.size() % 64 == 0)
+            success_.push_back(0);
+    }
+
+    void set_success(size_type idx) noexcept
+    {
+        success_[idx / 64] |= std::uint64_t(1) << (idx % 64);
+    }
+
+    void clear_success(size_type idx) noexcept
+    {
+        success_[idx / 64] &= ~(std::uint64_t(1) << (idx % 64));
+    }
+
+    void clear_tail() noexcept
+    {
+        if (!success_.empty())
+            success_.back() &= full_word(size() - (success_.size() - 1) * 64);
+    }
+
+    /** Get the error for the exception currently being handled, or rethrow it if it is not an \c E. **/
+    static E current_error()
+    {
+        return exceptional_error_traits<E>::template capture<exceptional<char, E>>(
+                [] () -> exceptional<char, E> { throw; }
+            ).error();
+    }
+
+    /** Merge two tables of errors which are each sorted by position (and have no positions in common). **/
+    static std::vector<error_entry> merge_errors(const std::vector<error_entry>& existing,
+                                                 std::vector<error_entry>&&      added
+                                                )
+    {
+        if (added.empty())
+            return existing;
+
+        std::vector<error_entry> out;
+        out.reserve(existing.size() + added.size());
+        std::merge(existing.begin(), existing.end(),
+                   std::make_move_iterator(added.begin()), std::make_move_iterator(added.end()),
+                   std::back_inserter(out),
+                   [] (const error_entry& a, const error_entry& b) { return a.first < b.first; }
+                  );
+        return out;
+    }
+
+    /** Replace the failed elements with what \a action recovers them to. If \a action throws something which is not an
+     *  \c E, it propagates and \c *this is left as it was, since nothing is changed until every element is done.
+    **/
+    template <typename FAction>
+    void recover_in_place(FAction&& action)
+    {
+        std::vector<std::pair<size_type, T>> recovered;
+        std::vector<error_entry>             still_failed;
+        for (const error_entry& entry : errors_)
+        {
+            try
+            {
+                recovered.emplace_back(entry.first, action(entry.second));
+            }
+            catch (...)
+            {
+                still_failed.emplace_back(entry.first, current_error());
+            }
+        }
+
+        for (auto& item : recovered)
+        {
+            values_[item.first] = std::move(item.second);
+            set_success(item.first);
+        }
+        errors_ = std::move(still_failed);
+    }
+
+private:
+    std::vector<T>             values_;
+    std::vector<std::uint64_t> success_; //!< Bit \c i of word \c i/64 is set if element \c i succeeded.
+    std::vector<error_entry>   errors_;  //!< The errors of the failed elements, sorted by position.
+};
+
+}
+
+#endif/*__MONADIC_EXCEPTIONAL_VECTOR_HPP_INCLUDED__*/
@@ -0,0 +1,99 @@
+/** \file
+ *  Header file for \c inline_executor and \c executor_ref.
+ *  
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __MONADIC_EXECUTOR_HPP_INCLUDED__
+#define __MONADIC_EXECUTOR_HPP_INCLUDED__
+
+#include "inline_function.hpp"
+
+#include <type_traits>
+#include <utility>
+
+namespace monadic
+{
+
+/** \page executors Executors
+ *  
+ *  An \e executor is anything which can run a task. Functions like \c completion::then_on and \c completion::via take
+ *  any type which satisfies the \c Executor concept:
+ *  
+ *  \code
+ *  struct Executor
+ *  {
+ *      // Run the nullary function object task (a move-constructible type) exactly once, now or at some later point,
+ *      // on whatever thread this executor chooses.
+ *      template <typename F>
+ *      void execute(F&& task);
+ *  };
+ *  \endcode
+ *  
+ *  Executors are always taken by reference -- it is up to the caller to keep the executor alive until every task given
+ *  to it has run. The library provides \c inline_executor and \c work_stealing_pool; wrap any executor in an
+ *  \c executor_ref to pass it through an interface which can not be a template.
+**/
+
+/** The type-erased task type used by \c executor_ref. There is enough space for a \c completion continuation (the
+ *  promise, a small function object and the delivered value) to be stored without allocating.
+**/
+using executor_task = inline_function<void (), 64>;
+
+/** An executor which runs every task immediately on the calling thread. Continuations scheduled with this executor
+ *  behave exactly like the ones without an executor.
+**/
+struct inline_executor
+{
+    template <typename F>
+    void execute(F&& task)
+    {
+        std::forward<F>(task)();
+    }
+};
+
+/** A non-owning, type-erased reference to some executor. This is useful for holding a user-supplied executor whose type
+ *  is not known at compile time. Tasks are converted to \c executor_task before being handed to the referenced
+ *  executor.
+**/
+class executor_ref
+{
+public:
+    /** Create a reference to \a exec, which must outlive this instance and every copy of it. **/
+    template <typename Executor,
+              typename = typename std::enable_if<!std::is_same<typename std::decay<Executor>::type,
+                                                               executor_ref
+                                                              >::value
+                                                >::type
+             >
+    executor_ref(Executor& exec) noexcept :
+            target_(&exec),
+            execute_(&execute_impl<Executor>)
+    { }
+    
+    template <typename F>
+    void execute(F&& task)
+    {
+        execute_(target_, executor_task(std::forward<F>(task)));
+    }
+    
+private:
+    template <typename Executor>
+    static void execute_impl(void* target, executor_task&& task)
+    {
+        static_cast<Executor*>(target)->execute(std::move(task));
+    }
+    
+private:
+    void* target_;
+    void  (*execute_)(void* target, executor_task&& task);
+};
+
+}
+
+#endif/*__MONADIC_EXECUTOR_HPP_INCLUDED__*/
@@ -0,0 +1,128 @@
+/** \file
+ *  Header file for the \c futex functions.
+ *  
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __MONADIC_FUTEX_HPP_INCLUDED__
+#define __MONADIC_FUTEX_HPP_INCLUDED__
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <thread>
+
+#if defined(__linux__)
+#   include <linux/futex.h>
+#   include <sys/syscall.h>
+#   include <time.h>
+#   include <unistd.h>
+#endif
+
+namespace monadic
+{
+
+/** Functions for parking a thread on the value of a 32-bit atomic word. On Linux, these are thin wrappers around the
+ *  \c futex system call; on other platforms, waiting falls back to sleeping in short increments, which is correct but
+ *  not nearly as efficient.
+ *  
+ *  The word must be an \c std::atomic of some 4-byte type (such as \c std::uint32_t or an \c enum with that as its
+ *  underlying type), which has the same representation as the raw value.
+**/
+namespace futex
+{
+
+namespace detail
+{
+
+template <typename T>
+int* word_address(std::atomic<T>& word)
+{
+    static_assert(sizeof(std::atomic<T>) == sizeof(int), "futex words must be 32 bits");
+    return reinterpret_cast<int*>(&word);
+}
+
+template <typename T>
+int raw_value(T value)
+{
+    static_assert(sizeof(T) == sizeof(int), "futex words must be 32 bits");
+    int out;
+    std::memcpy(&out, &value, sizeof out);
+    return out;
+}
+
+}
+
+/** Block the calling thread while \a word holds \a expected. This can return spuriously, so callers must always check
+ *  the value of \a word in a loop.
+**/
+template <typename T>
+void wait(std::atomic<T>& word, T expected)
+{
+#if defined(__linux__)
+    ::syscall(SYS_futex, detail::word_address(word), FUTEX_WAIT_PRIVATE, detail::raw_value(expected), nullptr);
+#else
+    if (word.load(std::memory_order_acquire) == expected)
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+#endif
+}
+
+/** Block the calling thread while \a word holds \a expected or until \a timeout has elapsed. Like \c wait, this can
+ *  return spuriously.
+**/
+template <typename T, typename TRep, typename TPeriod>
+void wait_for(std::atomic<T>& word, T expected, const std::chrono::duration<TRep, TPeriod>& timeout)
+{
+    auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count();
+    if (nanos <= 0)
+        return;
+
+#if defined(__linux__)
+    struct timespec spec;
+    spec.tv_sec  = time_t(nanos / 1000000000);
+    spec.tv_nsec = long(nanos % 1000000000);
+    ::syscall(SYS_futex, detail::word_address(word), FUTEX_WAIT_PRIVATE, detail::raw_value(expected), &spec);
+#else
+    if (word.load(std::memory_order_acquire) == expected)
+        std::this_thread::sleep_for(std::min(std::chrono::nanoseconds(nanos), std::chrono::nanoseconds(50000)));
+#endif
+}
+
+/** Wake up to \a count threads blocked in \c wait or \c wait_for on \a word. **/
+template <typename T>
+void wake(std::atomic<T>& word, int count)
+{
+#if defined(__linux__)
+    ::syscall(SYS_futex, detail::word_address(word), FUTEX_WAKE_PRIVATE, count);
+#else
+    static_cast<void>(word);
+    static_cast<void>(count);
+#endif
+}
+
+/** Wake a single thread blocked on \a word. **/
+template <typename T>
+void wake_one(std::atomic<T>& word)
+{
+    wake(word, 1);
+}
+
+/** Wake every thread blocked on \a word. **/
+template <typename T>
+void wake_all(std::atomic<T>& word)
+{
+    wake(word, INT_MAX);
+}
+
+}
+
+}
+
+#endif/*__MONADIC_FUTEX_HPP_INCLUDED__*/
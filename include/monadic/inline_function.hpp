@@ -0,0 +1,272 @@
+/** \file
+ *  Header file for \c inline_function.
+ *  
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __MONADIC_INLINE_FUNCTION_HPP_INCLUDED__
+#define __MONADIC_INLINE_FUNCTION_HPP_INCLUDED__
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace monadic
+{
+
+template <typename FSignature, std::size_t Capacity = 48>
+class inline_function;
+
+template <typename T>
+struct is_inline_function_type
+{
+    using type = std::false_type;
+};
+
+template <typename FSignature, std::size_t Capacity>
+struct is_inline_function_type<inline_function<FSignature, Capacity>>
+{
+    using type = std::true_type;
+};
+
+template <typename T>
+using is_inline_function = typename is_inline_function_type<typename std::decay<T>::type>::type;
+
+/** A move-only, type-erased function wrapper similar to \c std::function. Any function object which fits into
+ *  \c Capacity bytes (and can be moved without throwing) is stored inside of the \c inline_function itself, so wrapping
+ *  it does not allocate. Larger function objects still work, but are stored on the heap.
+ *  
+ *  Unlike \c std::function, the wrapped function object does not need to be copyable, so it can capture things like
+ *  \c std::unique_ptr or a \c completion_promise by move.
+ *  
+ *  \tparam FSignature The signature of the function, such as <tt>void (int)</tt>.
+ *  \tparam Capacity   The number of bytes of inline storage.
+**/
+template <typename R, typename... TArgs, std::size_t Capacity>
+class inline_function<R (TArgs...), Capacity>
+{
+public:
+    using result_type = R;
+    
+    /** Will a function object of type \c F be stored inline (without allocating)? **/
+    template <typename F>
+    struct stores_inline :
+            std::integral_constant<bool,    sizeof(F) <= Capacity
+                                         && alignof(F) <= alignof(std::max_align_t)
+                                         && std::is_nothrow_move_constructible<F>::value
+                                  >
+    { };
+    
+public:
+    /** Create an empty instance. **/
+    inline_function() noexcept :
+            ops_(nullptr)
+    { }
+    
+    /** Create an empty instance. **/
+    inline_function(std::nullptr_t) noexcept :
+            ops_(nullptr)
+    { }
+    
+    /** Create an instance wrapping \a func. **/
+    template <typename F,
+              typename = typename std::enable_if<!is_inline_function<F>::value>::type
+             >
+    inline_function(F&& func) :
+            ops_(nullptr)
+    {
+        emplace(std::forward<F>(func));
+    }
+    
+    inline_function(inline_function&& src) noexcept :
+            ops_(src.ops_)
+    {
+        if (ops_)
+        {
+            ops_->move(&storage_, &src.storage_);
+            src.ops_ = nullptr;
+        }
+    }
+    
+    inline_function(const inline_function&) = delete;
+    inline_function& operator=(const inline_function&) = delete;
+    
+    inline_function& operator=(inline_function&& src) noexcept
+    {
+        if (this != &src)
+        {
+            reset();
+            if (src.ops_)
+            {
+                src.ops_->move(&storage_, &src.storage_);
+                ops_ = src.ops_;
+                src.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+    
+    inline_function& operator=(std::nullptr_t) noexcept
+    {
+        reset();
+        return *this;
+    }
+    
+    template <typename F,
+              typename = typename std::enable_if<!is_inline_function<F>::value>::type
+             >
+    inline_function& operator=(F&& func)
+    {
+        reset();
+        emplace(std::forward<F>(func));
+        return *this;
+    }
+    
+    ~inline_function() noexcept
+    {
+        reset();
+    }
+    
+    /** Check if this instance holds a function. **/
+    explicit operator bool() const noexcept
+    {
+        return ops_ != nullptr;
+    }
+    
+    /** Call the wrapped function.
+     *  
+     *  \throws std::bad_function_call if this instance is empty.
+    **/
+    R operator()(TArgs... args)
+    {
+        if (!ops_)
+            throw std::bad_function_call();
+        return ops_->invoke(&storage_, std::forward<TArgs>(args)...);
+    }
+    
+private:
+    using storage_type = typename std::aligned_storage<Capacity, alignof(std::max_align_t)>::type;
+    
+    struct operations
+    {
+        R    (*invoke)(storage_type* self, TArgs&&... args);
+        void (*move)(storage_type* dest, storage_type* src) noexcept;
+        void (*destroy)(storage_type* self) noexcept;
+    };
+    
+    template <typename F>
+    struct inline_operations
+    {
+        static R invoke(storage_type* self, TArgs&&... args)
+        {
+            return (*reinterpret_cast<F*>(self))(std::forward<TArgs>(args)...);
+        }
+        
+        static void move(storage_type* dest, storage_type* src) noexcept
+        {
+            F& src_func = *reinterpret_cast<F*>(src);
+            new (dest) F(std::move(src_func));
+            src_func.~F();
+        }
+        
+        static void destroy(storage_type* self) noexcept
+        {
+            reinterpret_cast<F*>(self)->~F();
+        }
+        
+        static const operations instance;
+    };
+    
+    template <typename F>
+    struct heap_operations
+    {
+        static F*& pointer(storage_type* self) noexcept
+        {
+            return *reinterpret_cast<F**>(self);
+        }
+        
+        static R invoke(storage_type* self, TArgs&&... args)
+        {
+            return (*pointer(self))(std::forward<TArgs>(args)...);
+        }
+        
+        static void move(storage_type* dest, storage_type* src) noexcept
+        {
+            new (dest) F*(pointer(src));
+        }
+        
+        static void destroy(storage_type* self) noexcept
+        {
+            delete pointer(self);
+        }
+        
+        static const operations instance;
+    };
+    
+    template <typename F>
+    void emplace(F&& func)
+    {
+        using func_type = typename std::decay<F>::type;
+        emplace_impl<func_type>(std::forward<F>(func), stores_inline<func_type>());
+    }
+    
+    template <typename FDecayed, typename F>
+    void emplace_impl(F&& func, std::true_type)
+    {
+        new (&storage_) FDecayed(std::forward<F>(func));
+        ops_ = &inline_operations<FDecayed>::instance;
+    }
+    
+    template <typename FDecayed, typename F>
+    void emplace_impl(F&& func, std::false_type)
+    {
+        static_assert(sizeof(FDecayed*) <= Capacity, "inline_function must have space for at least a pointer");
+        new (&storage_) FDecayed*(new FDecayed(std::forward<F>(func)));
+        ops_ = &heap_operations<FDecayed>::instance;
+    }
+    
+    void reset() noexcept
+    {
+        if (ops_)
+        {
+            ops_->destroy(&storage_);
+            ops_ = nullptr;
+        }
+    }
+    
+private:
+    storage_type      storage_;
+    const operations* ops_;
+};
+
+template <typename R, typename... TArgs, std::size_t Capacity>
+template <typename F>
+const typename inline_function<R (TArgs...), Capacity>::operations
+inline_function<R (TArgs...), Capacity>::inline_operations<F>::instance =
+{
+    &inline_function<R (TArgs...), Capacity>::inline_operations<F>::invoke,
+    &inline_function<R (TArgs...), Capacity>::inline_operations<F>::move,
+    &inline_function<R (TArgs...), Capacity>::inline_operations<F>::destroy,
+};
+
+template <typename R, typename... TArgs, std::size_t Capacity>
+template <typename F>
+const typename inline_function<R (TArgs...), Capacity>::operations
+inline_function<R (TArgs...), Capacity>::heap_operations<F>::instance =
+{
+    &inline_function<R (TArgs...), Capacity>::heap_operations<F>::invoke,
+    &inline_function<R (TArgs...), Capacity>::heap_operations<F>::move,
+    &inline_function<R (TArgs...), Capacity>::heap_operations<F>::destroy,
+};
+
+}
+
+#endif/*__MONADIC_INLINE_FUNCTION_HPP_INCLUDED__*/
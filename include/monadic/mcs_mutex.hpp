@@ -0,0 +1,209 @@
+/** \file
+ *  Header file for \c mcs_mutex.
+ *
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __MONADIC_MCS_MUTEX_HPP_INCLUDED__
+#define __MONADIC_MCS_MUTEX_HPP_INCLUDED__
+
+#include "spin_mutex.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <new>
+
+namespace monadic
+{
+
+namespace detail
+{
+
+/** A waiter's entry in the queue of an \c mcs_mutex. It is aligned to a cache line, so a waiter spinning on its own
+ *  \c locked flag does not share that line with anyone but the thread which will hand it the lock. Plain \c new does
+ *  not respect extended alignment in C++11, so nodes are only created and destroyed by \c mcs_node_cache.
+**/
+struct alignas(64) mcs_node
+{
+    std::atomic<mcs_node*> next;
+    std::atomic<bool>      locked;
+    mcs_node*              next_free; //!< The next node in the owning thread's \c mcs_node_cache.
+    void*                  block;     //!< The allocation this node was placed in.
+};
+
+static_assert(sizeof(mcs_node) == 64, "mcs_node must fill exactly one cache line");
+
+/** Each thread's spare \c mcs_node instances. A thread needs one node for every \c mcs_mutex it holds or is waiting
+ *  for, and a node is back in the cache as soon as \c unlock returns, so in the steady state a thread allocates one
+ *  node (plus one for every lock it holds at the same time) and never again.
+**/
+class mcs_node_cache
+{
+public:
+    mcs_node_cache() :
+            free_(nullptr)
+    { }
+
+    ~mcs_node_cache() noexcept
+    {
+        while (free_)
+        {
+            mcs_node* next = free_->next_free;
+            destroy(free_);
+            free_ = next;
+        }
+    }
+
+    static mcs_node_cache& local()
+    {
+        static thread_local mcs_node_cache instance;
+        return instance;
+    }
+
+    mcs_node* acquire()
+    {
+        mcs_node* node = free_;
+        if (node)
+            free_ = node->next_free;
+        else
+            node = create();
+        return node;
+    }
+
+    void release(mcs_node* node) noexcept
+    {
+        node->next_free = free_;
+        free_ = node;
+    }
+
+private:
+    /** Allocate a node on its own cache line: over-allocate by the alignment and place the node at the first aligned
+     *  address in the block.
+    **/
+    static mcs_node* create()
+    {
+        void*          block   = ::operator new(sizeof(mcs_node) + alignof(mcs_node) - 1);
+        std::uintptr_t address = (reinterpret_cast<std::uintptr_t>(block) + alignof(mcs_node) - 1)
+                               & ~std::uintptr_t(alignof(mcs_node) - 1);
+        mcs_node*      node    = new (reinterpret_cast<void*>(address)) mcs_node();
+        node->block = block;
+        return node;
+    }
+
+    static void destroy(mcs_node* node) noexcept
+    {
+        void* block = node->block;
+        node->~mcs_node();
+        ::operator delete(block);
+    }
+
+private:
+    mcs_node* free_;
+};
+
+}
+
+/** A fair, queue-based spin lock (Mellor-Crummey and Scott). Waiters form a linked list through \c detail::mcs_node
+ *  entries and each one spins on the flag in its own node, which only its predecessor writes to when handing over the
+ *  lock. Taking and handing over the lock therefore only moves the cache lines of the two threads involved, instead of
+ *  invalidating a word every waiter is reading (as with \c spin_mutex and \c ticket_mutex). Like \c ticket_mutex,
+ *  threads get the lock in the order they asked for it, which has the same cost when the threads outnumber the cores.
+ *
+ *  The nodes come from a small per-thread cache (\c detail::mcs_node_cache) and the node of the current owner is kept
+ *  in the mutex, so this is a drop-in \c Lockable type (\c lock, \c try_lock and \c unlock) which does not need the
+ *  caller to provide a node. There is no \c try_lock_for: a waiter can not leave the middle of the queue.
+**/
+class mcs_mutex
+{
+public:
+    mcs_mutex() :
+            tail_(nullptr),
+            owner_(nullptr)
+    { }
+
+    mcs_mutex(const mcs_mutex&) = delete;
+    mcs_mutex(mcs_mutex&&)      = delete;
+    mcs_mutex& operator=(const mcs_mutex&) = delete;
+    mcs_mutex& operator=(mcs_mutex&&)      = delete;
+
+    /** Attempt to lock this mutex without waiting. This only succeeds if nobody holds the lock or is waiting for it.
+     *
+     *  \returns \c true if the lock was obtained; \c false if it was not.
+    **/
+    bool try_lock()
+    {
+        if (tail_.load(std::memory_order_relaxed) != nullptr)
+            return false;
+
+        auto&             cache    = detail::mcs_node_cache::local();
+        detail::mcs_node* self     = cache.acquire();
+        detail::mcs_node* expected = nullptr;
+        self->next.store(nullptr, std::memory_order_relaxed);
+        if (tail_.compare_exchange_strong(expected, self, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            owner_ = self;
+            return true;
+        }
+        else
+        {
+            cache.release(self);
+            return false;
+        }
+    }
+
+    /** Join the end of the queue and wait for the previous thread in it to hand over the lock. **/
+    void lock()
+    {
+        detail::mcs_node* self = detail::mcs_node_cache::local().acquire();
+        self->next.store(nullptr, std::memory_order_relaxed);
+        self->locked.store(true, std::memory_order_relaxed);
+
+        detail::mcs_node* prev = tail_.exchange(self, std::memory_order_acq_rel);
+        if (prev)
+        {
+            prev->next.store(self, std::memory_order_release);
+            detail::spin_backoff backoff;
+            while (self->locked.load(std::memory_order_acquire))
+                backoff.pause();
+        }
+        owner_ = self;
+    }
+
+    /** Hand the lock to the next thread in the queue (if there is one), with a release guarantee. This must be called
+     *  from the thread which locked the mutex.
+    **/
+    void unlock()
+    {
+        detail::mcs_node* self = owner_;
+        detail::mcs_node* next = self->next.load(std::memory_order_acquire);
+        if (!next)
+        {
+            detail::mcs_node* expected = self;
+            if (tail_.compare_exchange_strong(expected, nullptr, std::memory_order_release, std::memory_order_relaxed))
+            {
+                detail::mcs_node_cache::local().release(self);
+                return;
+            }
+
+            // Another thread has swapped itself in as the tail, but has not linked itself to us yet.
+            detail::spin_backoff backoff;
+            while (!(next = self->next.load(std::memory_order_acquire)))
+                backoff.pause();
+        }
+        next->locked.store(false, std::memory_order_release);
+        detail::mcs_node_cache::local().release(self);
+    }
+
+private:
+    std::atomic<detail::mcs_node*> tail_;
+    detail::mcs_node*              owner_; //!< The node of the thread holding the lock. Only the owner touches this.
+};
+
+}
+
+#endif/*__MONADIC_MCS_MUTEX_HPP_INCLUDED__*/
@@ -0,0 +1,377 @@
+/** \file
+ *  Header file for \c parallel_for, \c parallel_map and \c parallel_reduce.
+ *
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __MONADIC_PARALLEL_HPP_INCLUDED__
+#define __MONADIC_PARALLEL_HPP_INCLUDED__
+
+#include "completion.hpp"
+#include "exceptional.hpp"
+#include "when.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace monadic
+{
+
+namespace detail
+{
+
+/** The number of tasks worth giving to \a exec at once: its \c size() if it has one (like \c work_stealing_pool), or
+ *  unbounded if it does not.
+**/
+template <typename Executor>
+auto executor_concurrency(const Executor& exec, int)
+        -> decltype(std::size_t(exec.size()))
+{
+    return std::max<std::size_t>(1, exec.size());
+}
+
+template <typename Executor>
+std::size_t executor_concurrency(const Executor&, long)
+{
+    return std::size_t(-1);
+}
+
+/** The state shared by every task of a parallel algorithm over \c count_ elements starting at \c first_, which is split
+ *  into chunks of \c grain_ elements.
+ *
+ *  Chunks are not assigned to tasks up front. Every task claims the next unclaimed chunk from \c next_ until there are
+ *  none left, so a task which starts early (or runs on a less-loaded thread) takes more of the work and a task which
+ *  starts after everything is claimed returns immediately. Each chunk writes only its own part of the results and then
+ *  counts down \c remaining_; the acquire-release countdown publishes every part to the thread which brings it to zero,
+ *  which calls \c Derived::finish to deliver the result.
+**/
+template <typename Derived, typename TIter>
+struct parallel_state_base
+{
+    std::atomic<std::size_t> refs_;
+    std::atomic<std::size_t> next_;
+    std::atomic<std::size_t> remaining_;
+    TIter                    first_;
+    std::size_t              count_;
+    std::size_t              grain_;
+    std::size_t              chunk_count_;
+
+    parallel_state_base(TIter first, std::size_t count, std::size_t grain) :
+            refs_(1),
+            next_(0),
+            remaining_((count + grain - 1) / grain),
+            first_(first),
+            count_(count),
+            grain_(grain),
+            chunk_count_((count + grain - 1) / grain)
+    { }
+
+    void run()
+    {
+        auto& self = static_cast<Derived&>(*this);
+        for (std::size_t chunk = next_.fetch_add(1, std::memory_order_relaxed);
+             chunk < chunk_count_;
+             chunk = next_.fetch_add(1, std::memory_order_relaxed)
+            )
+        {
+            std::size_t begin = chunk * grain_;
+            std::size_t end   = std::min(count_, begin + grain_);
+            self.run_chunk(chunk, begin, end);
+            if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                self.finish();
+        }
+    }
+};
+
+template <typename State>
+struct parallel_task
+{
+    when_state_ref<State> state_;
+
+    void operator()()
+    {
+        state_->run();
+    }
+};
+
+/** Pick the grain for \a count elements over \a exec: \a grain if it was given, otherwise enough for about four chunks
+ *  per thread, which leaves room to balance uneven chunks without paying for a task per element.
+**/
+template <typename Executor>
+std::size_t parallel_grain(const Executor& exec, std::size_t count, std::size_t grain)
+{
+    if (grain != 0)
+        return grain;
+
+    std::size_t threads = std::min<std::size_t>(executor_concurrency(exec, 0),
+                                                std::max<std::size_t>(1, std::thread::hardware_concurrency())
+                                               );
+    return std::max<std::size_t>(1, count / (4 * threads));
+}
+
+/** Give \a exec enough tasks to run every chunk of \a state: one per chunk, but no more than \a exec has threads. **/
+template <typename Executor, typename State>
+void parallel_start(Executor& exec, const when_state_ref<State>& state)
+{
+    if (state->chunk_count_ == 0)
+    {
+        state->finish();
+        return;
+    }
+
+    std::size_t tasks = std::min(state->chunk_count_, executor_concurrency(exec, 0));
+    for (std::size_t idx = 0; idx < tasks; ++idx)
+        exec.execute(parallel_task<State> { state.share() });
+}
+
+template <typename TIter, typename Func>
+struct parallel_for_state :
+        parallel_state_base<parallel_for_state<TIter, Func>, TIter>
+{
+    Func                            func_;
+    std::vector<std::exception_ptr> errors_; //!< The first error of each chunk.
+    completion_promise<void>        promise_;
+
+    parallel_for_state(TIter first, std::size_t count, std::size_t grain, Func&& func) :
+            parallel_state_base<parallel_for_state, TIter>(first, count, grain),
+            func_(std::move(func)),
+            errors_(this->chunk_count_)
+    { }
+
+    void run_chunk(std::size_t chunk, std::size_t begin, std::size_t end)
+    {
+        TIter iter = this->first_ + begin;
+        for (std::size_t idx = begin; idx < end; ++idx, ++iter)
+        {
+            try
+            {
+                func_(*iter);
+            }
+            catch (...)
+            {
+                if (!errors_[chunk])
+                    errors_[chunk] = std::current_exception();
+            }
+        }
+    }
+
+    void finish()
+    {
+        for (const auto& error : errors_)
+        {
+            if (error)
+            {
+                promise_.set_exception(error);
+                return;
+            }
+        }
+        promise_.set_value();
+    }
+};
+
+template <typename TIter, typename Func, typename TResult>
+struct parallel_map_state :
+        parallel_state_base<parallel_map_state<TIter, Func, TResult>, TIter>
+{
+    Func                                                   func_;
+    std::vector<exceptional<TResult>>                      results_;
+    completion_promise<std::vector<exceptional<TResult>>>  promise_;
+
+    parallel_map_state(TIter first, std::size_t count, std::size_t grain, Func&& func) :
+            parallel_state_base<parallel_map_state, TIter>(first, count, grain),
+            func_(std::move(func)),
+            results_(count)
+    { }
+
+    void run_chunk(std::size_t, std::size_t begin, std::size_t end)
+    {
+        TIter iter = this->first_ + begin;
+        for (std::size_t idx = begin; idx < end; ++idx, ++iter)
+            results_[idx] = monadic::try_to(func_, *iter);
+    }
+
+    void finish()
+    {
+        promise_.set_value(std::move(results_));
+    }
+};
+
+/** Check if \c Func can combine two partial results of type \c T, as \c parallel_reduce needs it to. **/
+template <typename T, typename Func, typename = void>
+struct parallel_reduce_combines :
+        std::false_type
+{ };
+
+template <typename T, typename Func>
+struct parallel_reduce_combines<T, Func,
+                                decltype(void(std::declval<T&>() = std::declval<Func&>()(std::declval<T>(),
+                                                                                         std::declval<T>())))
+                               > :
+        std::true_type
+{ };
+
+template <typename TIter, typename T, typename Func>
+struct parallel_reduce_state :
+        parallel_state_base<parallel_reduce_state<TIter, T, Func>, TIter>
+{
+    T                           init_;
+    Func                        func_;
+    std::vector<exceptional<T>> partials_; //!< The reduction of each chunk.
+    completion_promise<T>       promise_;
+
+    parallel_reduce_state(TIter first, std::size_t count, std::size_t grain, T&& init, Func&& func) :
+            parallel_state_base<parallel_reduce_state, TIter>(first, count, grain),
+            init_(std::move(init)),
+            func_(std::move(func)),
+            partials_(this->chunk_count_)
+    { }
+
+    void run_chunk(std::size_t chunk, std::size_t begin, std::size_t end)
+    {
+        partials_[chunk] = monadic::try_to([this, begin, end]
+                                           {
+                                               TIter iter = this->first_ + begin;
+                                               T     acc(*iter);
+                                               for (std::size_t idx = begin + 1; idx < end; ++idx)
+                                                   acc = func_(std::move(acc), *++iter);
+                                               return acc;
+                                           }
+                                          );
+    }
+
+    void finish()
+    {
+        promise_.complete(monadic::try_to([this]
+                                          {
+                                              T acc(std::move(init_));
+                                              for (auto& partial : partials_)
+                                                  acc = func_(std::move(acc), std::move(partial).get());
+                                              return acc;
+                                          }
+                                         )
+                         );
+    }
+};
+
+}
+
+/** Call \a func on every element of the range <tt>[first, last)</tt> on \a exec, \a grain elements at a time.
+ *
+ *  The range is split into chunks of \a grain consecutive elements. The chunks are handed out to the tasks given to
+ *  \a exec as they ask for work (there are no more tasks than \a exec has threads, if it says how many it has), so
+ *  the threads which are free take more of the chunks. The elements of a chunk are visited in order on a single
+ *  thread.
+ *
+ *  \param first, last A range of random-access iterators, which must stay valid until the returned \c completion is
+ *                     delivered.
+ *  \param grain The number of elements in each chunk. If 0, the grain is picked to make about four chunks per thread.
+ *               Pick a larger grain when \a func is cheap, so the cost of claiming a chunk is spread over more
+ *               elements.
+ *  \returns a \c completion which is delivered once \a func has been called on every element. If \a func throws on
+ *           any element, the other elements are still visited and the \c completion fails with the exception thrown
+ *           for the lowest-positioned element which failed.
+ *
+ *  \code
+ *  parallel_for(pool, images.begin(), images.end(), [] (image& img) { img.normalize(); })
+ *      .then([] (exceptional<void> done) { ... });
+ *  \endcode
+**/
+template <typename Executor, typename TIter, typename Func>
+completion<void> parallel_for(Executor& exec, TIter first, TIter last, Func&& func, std::size_t grain = 0)
+{
+    using state_type = detail::parallel_for_state<TIter, typename std::decay<Func>::type>;
+
+    std::size_t count = std::size_t(std::distance(first, last));
+    detail::when_state_ref<state_type> state(new state_type(first, count, detail::parallel_grain(exec, count, grain),
+                                                            typename std::decay<Func>::type(std::forward<Func>(func))
+                                                           )
+                                            );
+    auto result = state->promise_.get_completion();
+    detail::parallel_start(exec, state);
+    return result;
+}
+
+/** Get the result of calling \a func on every element of the range <tt>[first, last)</tt> on \a exec, \a grain
+ *  elements at a time. The elements are split up like with \c parallel_for.
+ *
+ *  \returns a \c completion which is delivered the results in the same order as the range, each as an \c exceptional,
+ *           so a failure on one element does not hide the results of the others (like \c when_all).
+ *
+ *  \code
+ *  parallel_map(pool, rows.begin(), rows.end(), score)
+ *      .map([] (std::vector<exceptional<double>> scores) { ... });
+ *  \endcode
+**/
+template <typename Executor, typename TIter, typename Func>
+auto parallel_map(Executor& exec, TIter first, TIter last, Func&& func, std::size_t grain = 0)
+        -> completion<std::vector<exceptional<typename std::decay<decltype(func(*first))>::type>>>
+{
+    using value_type = typename std::decay<decltype(func(*first))>::type;
+    using state_type = detail::parallel_map_state<TIter, typename std::decay<Func>::type, value_type>;
+
+    std::size_t count = std::size_t(std::distance(first, last));
+    detail::when_state_ref<state_type> state(new state_type(first, count, detail::parallel_grain(exec, count, grain),
+                                                            typename std::decay<Func>::type(std::forward<Func>(func))
+                                                           )
+                                            );
+    auto result = state->promise_.get_completion();
+    detail::parallel_start(exec, state);
+    return result;
+}
+
+/** Combine every element of the range <tt>[first, last)</tt> and \a init with \a func on \a exec, \a grain elements
+ *  at a time. The elements are split up like with \c parallel_for.
+ *
+ *  Each chunk is reduced on its own, starting from its first element, and the results of the chunks are then combined
+ *  in order, starting from \a init. Like \c std::reduce, this means \a func must be associative and callable as both
+ *  <tt>func(T, element)</tt> and <tt>func(T, T)</tt>, but it does not need to be commutative. \c T must also be
+ *  constructible from an element, since that is what each chunk starts from. To reduce elements of another type, map
+ *  them to \c T first (with \c parallel_map or an iterator adaptor).
+ *
+ *  \returns a \c completion which is delivered the combined value. If \a func throws, the \c completion fails with the
+ *           exception thrown in the lowest-positioned chunk which failed.
+ *
+ *  \code
+ *  parallel_reduce(pool, latencies.begin(), latencies.end(), 0.0, [] (double total, double x) { return total + x; });
+ *  \endcode
+**/
+template <typename Executor, typename TIter, typename T, typename Func>
+auto parallel_reduce(Executor& exec, TIter first, TIter last, T&& init, Func&& func, std::size_t grain = 0)
+        -> completion<typename std::decay<T>::type>
+{
+    using value_type = typename std::decay<T>::type;
+    using state_type = detail::parallel_reduce_state<TIter, value_type, typename std::decay<Func>::type>;
+
+    static_assert(std::is_constructible<value_type, typename std::iterator_traits<TIter>::reference>::value,
+                  "parallel_reduce starts each chunk from its first element, so T must be constructible from one"
+                 );
+    static_assert(detail::parallel_reduce_combines<value_type, typename std::decay<Func>::type>::value,
+                  "parallel_reduce combines the results of chunks with func(T, T), so func must accept that"
+                 );
+
+    std::size_t count = std::size_t(std::distance(first, last));
+    detail::when_state_ref<state_type> state(new state_type(first, count, detail::parallel_grain(exec, count, grain),
+                                                            value_type(std::forward<T>(init)),
+                                                            typename std::decay<Func>::type(std::forward<Func>(func))
+                                                           )
+                                            );
+    auto result = state->promise_.get_completion();
+    detail::parallel_start(exec, state);
+    return result;
+}
+
+}
+
+#endif/*__MONADIC_PARALLEL_HPP_INCLUDED__*/
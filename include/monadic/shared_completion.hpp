@@ -0,0 +1,357 @@
+/** \file
+ *  Header file for \c shared_completion.
+ *
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __MONADIC_SHARED_COMPLETION_HPP_INCLUDED__
+#define __MONADIC_SHARED_COMPLETION_HPP_INCLUDED__
+
+#include "completion.hpp"
+#include "exceptional.hpp"
+#include "futex.hpp"
+#include "inline_function.hpp"
+#include "when.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <utility>
+
+namespace monadic
+{
+
+namespace detail
+{
+
+/** The shared state behind every copy of a \c shared_completion.
+ *
+ *  Continuations which arrive before the value are pushed onto \c waiters_, an intrusive Treiber stack of
+ *  heap-allocated nodes. Delivering the value swaps the stack for the \c delivered marker, which both hands the stack
+ *  to the delivering thread and tells every later subscriber that \c value_ can be read directly -- that fast path is a
+ *  single acquire load, with no allocation and no read-modify-write.
+**/
+template <typename T>
+struct shared_completion_state
+{
+    using callback_type = inline_function<void (const exceptional<T>&), 48>;
+
+    struct waiter
+    {
+        waiter*       next;
+        callback_type callback;
+    };
+
+    std::atomic<std::size_t>   refs_;
+    std::atomic<waiter*>       waiters_;
+    std::atomic<std::uint32_t> ready_;   //!< 1 once \c value_ is set. This is the word \c wait blocks on.
+    std::atomic<std::uint32_t> blocked_; //!< The number of threads blocked in \c wait.
+    exceptional<T>             value_;
+
+    shared_completion_state() :
+            refs_(1),
+            waiters_(nullptr),
+            ready_(0),
+            blocked_(0)
+    { }
+
+    ~shared_completion_state() noexcept
+    {
+        // If the value never arrived, the continuations are dropped without being called.
+        waiter* node = waiters_.load(std::memory_order_acquire);
+        while (node && node != delivered())
+        {
+            waiter* next = node->next;
+            delete node;
+            node = next;
+        }
+    }
+
+    /** The marker in \c waiters_ once the value has been delivered. It is never dereferenced. **/
+    waiter* delivered() const noexcept
+    {
+        return reinterpret_cast<waiter*>(const_cast<shared_completion_state*>(this));
+    }
+
+    bool is_ready() const noexcept
+    {
+        return waiters_.load(std::memory_order_acquire) == delivered();
+    }
+
+    template <typename Func>
+    void subscribe(Func&& func)
+    {
+        waiter* head = waiters_.load(std::memory_order_acquire);
+        if (head == delivered())
+        {
+            func(static_cast<const exceptional<T>&>(value_));
+            return;
+        }
+
+        waiter* node = new waiter { head, callback_type(std::forward<Func>(func)) };
+        while (!waiters_.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_acquire))
+        {
+            if (node->next == delivered())
+            {
+                // The value arrived while we were allocating.
+                auto deleter = on_scope_exit([node] { delete node; });
+                node->callback(value_);
+                return;
+            }
+        }
+    }
+
+    /** Set the value and call every continuation which is waiting for it, in the order they were attached. If any of
+     *  them throw, the rest are still called and the first exception is rethrown afterwards.
+    **/
+    void deliver(exceptional<T>&& value)
+    {
+        value_ = std::move(value);
+        waiter* stack = waiters_.exchange(delivered(), std::memory_order_acq_rel);
+
+        ready_.store(1, std::memory_order_seq_cst);
+        if (blocked_.load(std::memory_order_seq_cst) != 0)
+            futex::wake_all(ready_);
+
+        // The stack is newest-first; reverse it so continuations run in the order they were attached.
+        waiter* queue = nullptr;
+        while (stack)
+        {
+            waiter* next = stack->next;
+            stack->next = queue;
+            queue = stack;
+            stack = next;
+        }
+
+        std::exception_ptr error;
+        while (queue)
+        {
+            waiter* next = queue->next;
+            try
+            {
+                queue->callback(value_);
+            }
+            catch (...)
+            {
+                if (!error)
+                    error = std::current_exception();
+            }
+            delete queue;
+            queue = next;
+        }
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    void wait() const
+    {
+        if (ready_.load(std::memory_order_acquire) != 0)
+            return;
+
+        completion_data_base::run_pending();
+        auto& self = const_cast<shared_completion_state&>(*this);
+        self.blocked_.fetch_add(1, std::memory_order_seq_cst);
+        auto unregister = on_scope_exit([&self] { self.blocked_.fetch_sub(1, std::memory_order_relaxed); });
+        while (self.ready_.load(std::memory_order_seq_cst) == 0)
+            futex::wait(self.ready_, std::uint32_t(0));
+    }
+};
+
+/** The callback on the source \c completion of a \c shared_completion. **/
+template <typename T>
+struct shared_completion_source_callback
+{
+    when_state_ref<shared_completion_state<T>> state_;
+
+    void operator()(exceptional<T>&& value)
+    {
+        state_->deliver(std::move(value));
+    }
+};
+
+template <typename T, typename TResult, typename Func>
+struct shared_completion_map
+{
+    completion_promise<TResult> promise_;
+    Func                        func_;
+
+    void operator()(const exceptional<T>& value)
+    {
+        promise_.complete(value.map(func_));
+    }
+};
+
+template <typename T, typename TResult, typename Func>
+struct shared_completion_then
+{
+    completion_promise<TResult> promise_;
+    Func                        func_;
+
+    void operator()(const exceptional<T>& value)
+    {
+        promise_.complete(monadic::try_to(func_, value));
+    }
+};
+
+template <typename T>
+struct shared_completion_copy
+{
+    completion_promise<T> promise_;
+
+    void operator()(const exceptional<T>& value)
+    {
+        promise_.complete(value);
+    }
+};
+
+template <typename T>
+struct shared_completion_get_result
+{
+    using type = const T&;
+};
+
+template <>
+struct shared_completion_get_result<void>
+{
+    using type = void;
+};
+
+}
+
+/** A \c completion with any number of consumers. Where a \c completion hands its value to a single continuation, a
+ *  \c shared_completion keeps the value and gives every continuation a <tt>const T&amp;</tt> to the same instance --
+ *  the value is never copied (unless you ask for a copy with \c get_completion). Copies of a \c shared_completion are
+ *  handles to the same shared state, so they can be handed out freely.
+ *
+ *  \code
+ *  shared_completion<config> current = load_config().share();
+ *
+ *  current.map([] (const config& cfg) { return open_database(cfg.db); });
+ *  current.map([] (const config& cfg) { return start_listener(cfg.port); });
+ *  \endcode
+ *
+ *  Continuations attached before the value arrives are kept in a lock-free intrusive list (one allocation each) and
+ *  run by the thread which delivers the value, in the order they were attached. Continuations attached afterwards run
+ *  immediately on the calling thread, which only costs a single atomic load before calling them.
+ *
+ *  If the source \c completion is never delivered (because its promise was dropped or it was disabled), waiting
+ *  continuations are never called and \c get blocks forever.
+**/
+template <typename T>
+class shared_completion
+{
+public:
+    using value_type = T;
+
+public:
+    /** Take over \a source, which must not have a continuation attached already. **/
+    explicit shared_completion(completion<T> source) :
+            state_(new detail::shared_completion_state<T>())
+    {
+        source.on_complete(detail::shared_completion_source_callback<T> { state_.share() });
+    }
+
+    shared_completion(const shared_completion& src) noexcept :
+            state_(src.state_.share())
+    { }
+
+    shared_completion(shared_completion&&) noexcept = default;
+
+    shared_completion& operator=(shared_completion src) noexcept
+    {
+        std::swap(state_, src.state_);
+        return *this;
+    }
+
+    /** Check if the value (or failure) has been delivered. **/
+    bool is_ready() const noexcept
+    {
+        return state_->is_ready();
+    }
+
+    /** Call \a func with a <tt>const exceptional&lt;T&gt;&amp;</tt> once the value is delivered. If it already has
+     *  been, \a func is called immediately.
+    **/
+    template <typename Func>
+    void on_complete(Func&& func)
+    {
+        state_->subscribe(std::forward<Func>(func));
+    }
+
+    /** Get a \c completion of the result of calling \a func with the value (as a <tt>const T&amp;</tt>) if it is
+     *  delivered in success. A failure passes through without calling \a func.
+     *
+     *  \see completion::map
+    **/
+    template <typename Func>
+    auto map(Func&& func)
+            -> completion<typename decltype(std::declval<const exceptional<T>&>().map(func))::value_type>
+    {
+        using result_type = typename decltype(std::declval<const exceptional<T>&>().map(func))::value_type;
+        using step_type   = detail::shared_completion_map<T, result_type, typename std::decay<Func>::type>;
+        completion_promise<result_type> promise;
+        auto result = promise.get_completion();
+        on_complete(step_type { std::move(promise), std::forward<Func>(func) });
+        return result;
+    }
+
+    /** Get a \c completion of the result of calling \a func with the <tt>const exceptional&lt;T&gt;&amp;</tt> once it
+     *  is delivered, in either success or failure.
+     *
+     *  \see completion::then
+    **/
+    template <typename Func>
+    auto then(Func&& func)
+            -> completion<decltype(func(std::declval<const exceptional<T>&>()))>
+    {
+        using result_type = decltype(func(std::declval<const exceptional<T>&>()));
+        using step_type   = detail::shared_completion_then<T, result_type, typename std::decay<Func>::type>;
+        completion_promise<result_type> promise;
+        auto result = promise.get_completion();
+        on_complete(step_type { std::move(promise), std::forward<Func>(func) });
+        return result;
+    }
+
+    /** Get an ordinary \c completion which is delivered a copy of the value. **/
+    completion<T> get_completion()
+    {
+        completion_promise<T> promise;
+        auto result = promise.get_completion();
+        on_complete(detail::shared_completion_copy<T> { std::move(promise) });
+        return result;
+    }
+
+    /** Block until the value has been delivered. **/
+    void wait() const
+    {
+        state_->wait();
+    }
+
+    /** Block until the value has been delivered and return a reference to it, which lives as long as any copy of this
+     *  \c shared_completion. If it was delivered in failure, the exception is thrown.
+    **/
+    typename detail::shared_completion_get_result<T>::type get() const
+    {
+        wait();
+        return static_cast<const exceptional<T>&>(state_->value_).get();
+    }
+
+private:
+    detail::when_state_ref<detail::shared_completion_state<T>> state_;
+};
+
+template <typename T>
+shared_completion<T> completion<T>::share()
+{
+    return shared_completion<T>(std::move(*this));
+}
+
+}
+
+#endif/*__MONADIC_SHARED_COMPLETION_HPP_INCLUDED__*/
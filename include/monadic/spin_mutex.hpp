@@ -14,12 +14,70 @@
 
 #include <atomic>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
 
 namespace monadic
 {
 
+namespace detail
+{
+
+/** Tell the processor that we are in a spin-wait loop. On x86 this is \c pause, which keeps the waiting core from
+ *  flooding the memory system with speculative loads and hands its pipeline to a sibling hyperthread; on ARM it is
+ *  \c yield. Elsewhere, it does nothing.
+**/
+inline void cpu_relax() noexcept
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+/** Exponential backoff for spin-wait loops. Each call to \c pause waits twice as many \c cpu_relax rounds as the last
+ *  one, up to \c max_relax_rounds; after that, every \c pause yields the thread to the OS scheduler, since a lock which
+ *  is still held after that long probably belongs to a thread which is not running.
+**/
+class spin_backoff
+{
+public:
+    static const std::uint32_t max_relax_rounds = 64;
+
+public:
+    spin_backoff() noexcept :
+            rounds_(1)
+    { }
+
+    void pause() noexcept
+    {
+        if (rounds_ <= max_relax_rounds)
+        {
+            for (std::uint32_t idx = 0; idx < rounds_; ++idx)
+                cpu_relax();
+            rounds_ *= 2;
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    std::uint32_t rounds_;
+};
+
+}
+
 /** A mutex type which spins on an atomic bool instead of relying on OS functions. When your work unit takes less time
  *  than your OS's quantum and your lock has low contention, a spin mutex can be faster than a regular mutex.
+ *  
+ *  Waiting is done with test-and-test-and-set: a waiter only watches the flag with plain loads (which are served from
+ *  its own cache while the lock is held) and only attempts to take the lock once it sees the flag clear, so waiters do
+ *  not steal the cache line from the owner while it works. Between checks, waiters back off exponentially with a
+ *  processor pause hint and eventually yield to the OS (see \c detail::spin_backoff).
 **/
 class spin_mutex
 {
@@ -36,20 +94,16 @@ public:
     spin_mutex& operator=(const spin_mutex&) = delete;
     spin_mutex& operator=(spin_mutex&&)      = delete;
     
-    /** Attempt to lock this mutex. When the lock is acquired, there is a sequentially-consistent guarantee. If the lock
-     *  is not acquired, there is no memory ordering guarantee.
+    /** Attempt to lock this mutex. When the lock is acquired, there is an acquire guarantee (pairing with the release
+     *  in \c unlock). If the lock is not acquired, there is no memory ordering guarantee. If the lock is visibly held,
+     *  this does not write to the flag at all.
      *  
      *  \returns \c true if the lock was obtained; \c false if it was not (someone else holds the lock).
     **/
     bool try_lock()
     {
-        bool hopeful_val = false;
-        return std::atomic_compare_exchange_strong_explicit(&locked,
-                                                            &hopeful_val,
-                                                            true,
-                                                            std::memory_order_seq_cst,
-                                                            std::memory_order_relaxed
-                                                           );
+        return !locked.load(std::memory_order_relaxed)
+            && !locked.exchange(true, std::memory_order_acquire);
     }
     
     /** Attempt to acquire the lock on this mutex until the specified \a expiry_time. If the given time is in the past,
@@ -64,12 +118,14 @@ public:
     template <typename TClock, typename TDuration>
     bool try_lock_until(const std::chrono::time_point<TClock, TDuration>& expiry_time)
     {
-        do
+        detail::spin_backoff backoff;
+        while (!try_lock())
         {
-            if (try_lock())
-                return true;
-        } while (TClock::now() < expiry_time);
-        return false;
+            if (!(TClock::now() < expiry_time))
+                return false;
+            backoff.pause();
+        }
+        return true;
     }
     
     /** Attempt to acquire the lock on this mutex for the specified \a duration.
@@ -87,29 +143,41 @@ public:
     
     /** Attempt to acquire the lock for the specified number of \a spins.
      *  
-     *  \param spins The number of times to call \c try_lock before giving up.
+     *  \param spins The number of times to call \c try_lock before giving up. Consecutive attempts are separated by an
+     *    exponentially growing backoff, so this waits for longer than \a spins iterations of a tight loop would.
      *  
      *  \returns \c true if the lock was obtained; \c false if it was not (someone else holds the lock).
     **/
     bool try_lock_spins(std::size_t spins)
     {
+        detail::spin_backoff backoff;
         while (spins --> 0)
+        {
             if (try_lock())
                 return true;
+            if (spins > 0)
+                backoff.pause();
+        }
         return false;
     }
     
-    /** Repeatedly attempt to acquire a lock on this mutex in a while loop. **/
+    /** Acquire a lock on this mutex, spinning (with backoff) until it is available. **/
     void lock()
     {
-        while (!try_lock())
-            continue;
+        detail::spin_backoff backoff;
+        while (locked.exchange(true, std::memory_order_acquire))
+        {
+            do
+            {
+                backoff.pause();
+            } while (locked.load(std::memory_order_relaxed));
+        }
     }
     
-    /** Unlock this mutex. There is no checking that you actually own the mutex. **/
+    /** Unlock this mutex, with a release guarantee. There is no checking that you actually own the mutex. **/
     void unlock()
     {
-        locked.store(false, std::memory_order_seq_cst);
+        locked.store(false, std::memory_order_release);
     }
     
     /** Get a pointer to the atomic variable that backs this mutex. Please do not edit it. **/
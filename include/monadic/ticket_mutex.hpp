@@ -0,0 +1,97 @@
+/** \file
+ *  Header file for \c ticket_mutex.
+ *
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __MONADIC_TICKET_MUTEX_HPP_INCLUDED__
+#define __MONADIC_TICKET_MUTEX_HPP_INCLUDED__
+
+#include "spin_mutex.hpp"
+
+#include <atomic>
+#include <cstdint>
+
+namespace monadic
+{
+
+/** A fair spin lock: threads get the lock in the order they asked for it. \c lock takes a ticket from \c next_ and
+ *  waits until \c serving_ reaches it; \c unlock moves \c serving_ on to the next ticket. Unlike \c spin_mutex, no
+ *  thread can be starved by others which keep grabbing the lock ahead of it.
+ *
+ *  Every waiter still watches the same word, so each hand-off invalidates it in every waiter's cache; on machines with
+ *  many cores, \c mcs_mutex scales better. Waiters back off in proportion to how far back in line they are, which
+ *  keeps the ones at the back from reading the word while there is no chance it is their turn.
+ *
+ *  Fairness has a cost when there are more waiting threads than cores: the lock can only go to the thread next in
+ *  line, so if that thread is not running, nobody gets the lock until the scheduler gets around to it. Use
+ *  \c adaptive_mutex or \c std::mutex if the threads using the lock may outnumber the cores.
+ *
+ *  This is a \c Lockable type (\c lock, \c try_lock and \c unlock). There is no \c try_lock_for: a thread which took a
+ *  ticket can not give it back, so a timed wait could only be done by retrying \c try_lock, which is not fair.
+**/
+class ticket_mutex
+{
+public:
+    ticket_mutex() :
+            next_(0),
+            serving_(0)
+    { }
+
+    ticket_mutex(const ticket_mutex&) = delete;
+    ticket_mutex(ticket_mutex&&)      = delete;
+    ticket_mutex& operator=(const ticket_mutex&) = delete;
+    ticket_mutex& operator=(ticket_mutex&&)      = delete;
+
+    /** Attempt to lock this mutex without waiting. This only succeeds if nobody holds the lock or is waiting for it.
+     *
+     *  \returns \c true if the lock was obtained; \c false if it was not.
+    **/
+    bool try_lock()
+    {
+        // The previous owner released the lock through serving_, not next_, so that is the load which needs acquire.
+        std::uint32_t ticket = serving_.load(std::memory_order_acquire);
+        return next_.compare_exchange_strong(ticket, ticket + 1, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+
+    /** Take a ticket and wait for it to be served. **/
+    void lock()
+    {
+        std::uint32_t ticket = next_.fetch_add(1, std::memory_order_relaxed);
+        std::uint32_t ahead  = ticket - serving_.load(std::memory_order_acquire);
+        if (ahead == 0)
+            return;
+
+        detail::spin_backoff backoff;
+        do
+        {
+            for (std::uint32_t idx = 1; idx < ahead; ++idx)
+                detail::cpu_relax();
+            backoff.pause();
+            ahead = ticket - serving_.load(std::memory_order_acquire);
+        } while (ahead != 0);
+    }
+
+    /** Hand the lock to the next ticket, with a release guarantee. There is no checking that you actually own the
+     *  mutex.
+    **/
+    void unlock()
+    {
+        serving_.store(serving_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    // next_ is written by arriving threads and serving_ by the owner, so keep them on separate cache lines.
+    std::atomic<std::uint32_t> next_;
+    char                       next_padding_[64 - sizeof(std::atomic<std::uint32_t>)];
+    std::atomic<std::uint32_t> serving_;
+};
+
+}
+
+#endif/*__MONADIC_TICKET_MUTEX_HPP_INCLUDED__*/
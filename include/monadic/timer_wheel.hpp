@@ -0,0 +1,586 @@
+/** \file
+ *  Header file for \c timer_wheel.
+ *
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __MONADIC_TIMER_WHEEL_HPP_INCLUDED__
+#define __MONADIC_TIMER_WHEEL_HPP_INCLUDED__
+
+#include "completion.hpp"
+#include "exceptional.hpp"
+#include "inline_function.hpp"
+#include "when.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace monadic
+{
+
+/** The failure delivered by \c timer_wheel::within (and \c completion::within) when the value does not arrive in
+ *  time.
+**/
+class completion_timeout :
+        public std::runtime_error
+{
+public:
+    completion_timeout() :
+            std::runtime_error("completion timed out")
+    { }
+};
+
+class timer_wheel;
+
+namespace detail
+{
+
+/** A scheduled timer. Nodes live in slabs owned by the \c timer_wheel and are reused, so \c generation is bumped every
+ *  time one is recycled -- a stale handle to a reused node can tell that it is stale.
+**/
+struct timer_node
+{
+    using action_type = inline_function<void (), 16>;
+
+    timer_node*   prev;
+    timer_node*   next;
+    timer_node**  slot;       //!< The list this node is in, or \c nullptr if it is not scheduled.
+    std::uint64_t expiry;     //!< The tick this node fires on.
+    std::uint64_t generation;
+    action_type   action;
+
+    timer_node() :
+            prev(nullptr),
+            next(nullptr),
+            slot(nullptr),
+            expiry(0),
+            generation(0)
+    { }
+};
+
+/** What \c timer_wheel::after schedules: deliver the promise. **/
+struct timer_after_action
+{
+    completion_promise<void> promise_;
+
+    void operator()()
+    {
+        promise_.set_value();
+    }
+};
+
+/** The shared state of a \c timer_wheel::within. The value and the timer race to flip \c done_; whichever wins
+ *  delivers to \c promise_ and cleans up after the other (cancelling the timer or disabling \c source_). The timer
+ *  only joins the race if disabling \c source_ stopped the value, so a value which has already been handed to our
+ *  callback is never dropped in favour of a timeout.
+ *
+ *  The timer's node is published through \c timer_node_ once it has been scheduled. If the value arrives first, it
+ *  cancels the timer if it can see the node; the thread scheduling the timer checks \c done_ afterwards, so between
+ *  the two of them the timer is always cancelled (at worst twice, which the generation makes harmless).
+**/
+template <typename T>
+struct timer_within_state
+{
+    std::atomic<std::size_t> refs_;
+    std::atomic<bool>        done_;
+    timer_wheel*             wheel_;
+    std::uint64_t            timer_generation_;
+    std::atomic<timer_node*> timer_node_;
+    completion<T>            source_;
+    completion_promise<T>    promise_;
+
+    timer_within_state(timer_wheel* wheel, completion<T>&& source) :
+            refs_(1),
+            done_(false),
+            wheel_(wheel),
+            timer_generation_(0),
+            timer_node_(nullptr),
+            source_(std::move(source))
+    { }
+
+    void cancel_timer();
+};
+
+template <typename T>
+struct timer_within_callback
+{
+    when_state_ref<timer_within_state<T>> state_;
+
+    void operator()(exceptional<T>&& result)
+    {
+        if (state_->done_.exchange(true, std::memory_order_seq_cst))
+            return;
+
+        state_->promise_.complete(std::move(result));
+        state_->cancel_timer();
+    }
+};
+
+template <typename T>
+struct timer_within_timeout
+{
+    when_state_ref<timer_within_state<T>> state_;
+
+    void operator()()
+    {
+        // Let whoever was producing the value know it is no longer wanted (this also drops our callback on it). If the
+        // value got there first, our callback has been claimed and will deliver it, so the timeout has lost.
+        if (!state_->source_.disable())
+            return;
+        if (state_->done_.exchange(true, std::memory_order_seq_cst))
+            return;
+
+        state_->promise_.set_exception(std::make_exception_ptr(completion_timeout()));
+    }
+};
+
+}
+
+/** A service for timers, driven by a single thread: \c after gives a \c completion which is delivered after a delay,
+ *  and \c within puts a deadline on another \c completion. Neither spawns a thread or blocks one per timer.
+ *
+ *  The timers are kept in a hierarchical timing wheel: four levels of 256 slots, where each level covers 256 times the
+ *  span of the one below it. A timer goes in the slot of the lowest level whose span covers its delay; whenever a
+ *  lower level wraps around, the next slot of the level above is emptied back into the levels below ("cascaded").
+ *  Scheduling and cancelling a timer are both O(1) (linking and unlinking a node in a doubly-linked list under a
+ *  lock), and each timer is cascaded at most three times. Timers further out than the top level's span (about 49 days
+ *  with the default 1 millisecond tick) are parked in its last slot and cascaded again when they come around.
+ *
+ *  Nodes are allocated in slabs and recycled through a free list, so memory is bounded by the largest number of timers
+ *  outstanding at once (each one is 64 bytes plus the slab overhead) and scheduling does not allocate in the steady
+ *  state. The thread only wakes up once per tick while there are timers; with none outstanding, it sleeps until one is
+ *  scheduled.
+ *
+ *  \code
+ *  timer_wheel timers;
+ *
+ *  fetch(url).within(timers, std::chrono::milliseconds(250))
+ *            .recover([] (std::exception_ptr ex) { ... });  // a completion_timeout if fetch took too long
+ *  \endcode
+ *
+ *  \note
+ *  Timers fire on the wheel's thread at the first tick at or after they are due, so a timer can be up to one tick
+ *  (plus scheduling delay) late but is never early. Callbacks run on the wheel's thread too, so anything slow should be
+ *  moved off of it with \c completion::via. A callback which throws does not stop the wheel: the first such exception
+ *  is kept until \c take_exception is called.
+**/
+class timer_wheel
+{
+public:
+    using clock_type = std::chrono::steady_clock;
+
+    static const std::size_t level_bits  = 8;
+    static const std::size_t level_count = 4;
+    static const std::size_t slot_count  = std::size_t(1) << level_bits;
+
+public:
+    /** Start the wheel and its thread.
+     *
+     *  \param tick The resolution of the wheel. Shorter ticks make timers more precise, but wake the thread more often.
+     *  \throws std::invalid_argument if \a tick is not positive.
+    **/
+    explicit timer_wheel(std::chrono::nanoseconds tick = std::chrono::milliseconds(1)) :
+            tick_(tick),
+            start_(clock_type::now()),
+            current_(0),
+            size_(0),
+            free_(nullptr),
+            wake_tick_(std::numeric_limits<std::uint64_t>::max()),
+            firing_(nullptr),
+            stop_(false)
+    {
+        if (tick_ <= std::chrono::nanoseconds::zero())
+            throw std::invalid_argument("timer_wheel tick must be positive");
+
+        for (auto& level : slots_)
+            for (auto& slot : level)
+                slot = nullptr;
+        thread_ = std::thread([this] { run(); });
+    }
+
+    timer_wheel(const timer_wheel&) = delete;
+    timer_wheel& operator=(const timer_wheel&) = delete;
+
+    /** Stop the thread. Timers which have not fired yet are dropped without firing, so a pending \c after is never
+     *  delivered. The wheel must outlive every \c within which is still waiting on its value.
+    **/
+    ~timer_wheel() noexcept
+    {
+        {
+            std::lock_guard<std::mutex> lock(protect_);
+            stop_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+    }
+
+    /** Get a \c completion which is delivered once \a delay has passed. Disabling it does not unschedule the timer, but
+     *  nothing is delivered when it fires.
+    **/
+    template <typename TRep, typename TPeriod>
+    completion<void> after(const std::chrono::duration<TRep, TPeriod>& delay)
+    {
+        completion_promise<void> promise;
+        auto result = promise.get_completion();
+        schedule(delay, detail::timer_after_action { std::move(promise) });
+        return result;
+    }
+
+    /** Get a \c completion which is delivered the same value as \a source, unless \a timeout passes first. In that
+     *  case, it is delivered a \c completion_timeout failure instead and \a source is disabled (which, like any
+     *  \c completion::disable, travels back up the chain \a source came from). If the value arrives in time, the timer
+     *  is cancelled.
+     *
+     *  \see completion::within
+    **/
+    template <typename T, typename TRep, typename TPeriod>
+    completion<T> within(completion<T> source, const std::chrono::duration<TRep, TPeriod>& timeout)
+    {
+        using state_type = detail::timer_within_state<T>;
+
+        detail::when_state_ref<state_type> state(new state_type(this, std::move(source)));
+        auto result = state->promise_.get_completion();
+        state->source_.on_complete(detail::timer_within_callback<T> { state.share() });
+        if (state->done_.load(std::memory_order_seq_cst))
+            return result;
+
+        std::uint64_t         generation;
+        detail::timer_node*   node = schedule(timeout, detail::timer_within_timeout<T> { state.share() }, generation);
+        state->timer_generation_ = generation;
+        state->timer_node_.store(node, std::memory_order_seq_cst);
+        if (state->done_.load(std::memory_order_seq_cst))
+            cancel(node, generation);
+        return result;
+    }
+
+    /** Get the first exception thrown by a firing timer (which means a continuation of an \c after or \c within
+     *  threw) since the last call, or a null \c std::exception_ptr if none has.
+    **/
+    std::exception_ptr take_exception()
+    {
+        std::lock_guard<std::mutex> lock(protect_);
+        std::exception_ptr error = std::move(error_);
+        error_ = nullptr;
+        return error;
+    }
+
+    /** The number of timers which have been scheduled but have not fired or been cancelled. **/
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(protect_);
+        return size_;
+    }
+
+    /** The resolution of this wheel. **/
+    std::chrono::nanoseconds tick() const
+    {
+        return tick_;
+    }
+
+private:
+    template <typename T>
+    friend struct detail::timer_within_state;
+
+    template <typename TRep, typename TPeriod, typename Action>
+    detail::timer_node* schedule(const std::chrono::duration<TRep, TPeriod>& delay, Action&& action)
+    {
+        std::uint64_t generation;
+        return schedule(delay, std::forward<Action>(action), generation);
+    }
+
+    /** Schedule \a action to run once \a delay has passed.
+     *
+     *  \param[out] generation The generation of the returned node, for \c cancel.
+    **/
+    template <typename TRep, typename TPeriod, typename Action>
+    detail::timer_node* schedule(const std::chrono::duration<TRep, TPeriod>& delay,
+                                 Action&&                                    action,
+                                 std::uint64_t&                              generation
+                                )
+    {
+        // Round up, so the timer never fires early.
+        auto          due    = clock_type::now() + delay - start_;
+        std::int64_t  ticks  = (std::chrono::duration_cast<std::chrono::nanoseconds>(due).count() + tick_.count() - 1)
+                             / tick_.count();
+        std::uint64_t expiry = ticks < 0 ? 0 : std::uint64_t(ticks);
+
+        bool notify;
+        detail::timer_node* node;
+        {
+            std::lock_guard<std::mutex> lock(protect_);
+            node = allocate_node();
+            node->action = std::forward<Action>(action);
+            node->expiry = std::max(expiry, current_ + 1);
+            place(node);
+            generation = node->generation;
+            ++size_;
+            // Only wake the thread if it would otherwise sleep past this timer.
+            notify = node->expiry < wake_tick_;
+        }
+        if (notify)
+            wake_.notify_one();
+        return node;
+    }
+
+    /** Unschedule the timer for \a node if it is still the one from \a generation. The action is destroyed without
+     *  being called.
+    **/
+    void cancel(detail::timer_node* node, std::uint64_t generation)
+    {
+        detail::timer_node::action_type action;
+        std::lock_guard<std::mutex> lock(protect_);
+        if (node->generation != generation || !node->slot)
+            return;
+
+        unlink(node);
+        action = std::move(node->action);
+        release_node(node);
+        --size_;
+        // The action is destroyed after the lock is released, since it might hold the last reference to a completion.
+    }
+
+    detail::timer_node* allocate_node()
+    {
+        if (!free_)
+        {
+            static const std::size_t slab_size = 1024;
+            std::unique_ptr<detail::timer_node[]> slab(new detail::timer_node[slab_size]);
+            for (std::size_t idx = 0; idx < slab_size; ++idx)
+                slab[idx].next = idx + 1 < slab_size ? &slab[idx + 1] : nullptr;
+            free_ = &slab[0];
+            slabs_.push_back(std::move(slab));
+        }
+        detail::timer_node* node = free_;
+        free_ = node->next;
+        node->next = nullptr;
+        return node;
+    }
+
+    void release_node(detail::timer_node* node)
+    {
+        ++node->generation;
+        node->next = free_;
+        free_ = node;
+    }
+
+    /** Put \a node in the slot for its expiry, relative to \c current_. **/
+    void place(detail::timer_node* node)
+    {
+        std::uint64_t delta = node->expiry > current_ ? node->expiry - current_ : 0;
+        std::size_t   level = 0;
+        while (level + 1 < level_count && delta >= (std::uint64_t(1) << (level_bits * (level + 1))))
+            ++level;
+
+        std::uint64_t target = node->expiry;
+        if (delta >= (std::uint64_t(1) << (level_bits * level_count)))
+        {
+            // Further out than the wheel spans -- park it in the last slot of the top level and look again when that
+            // comes around.
+            target = current_ + (std::uint64_t(slot_count - 1) << (level_bits * (level_count - 1)));
+        }
+        link(node, &slots_[level][(target >> (level_bits * level)) & (slot_count - 1)]);
+    }
+
+    static void link(detail::timer_node* node, detail::timer_node** slot)
+    {
+        node->slot = slot;
+        node->prev = nullptr;
+        node->next = *slot;
+        if (node->next)
+            node->next->prev = node;
+        *slot = node;
+    }
+
+    static void unlink(detail::timer_node* node)
+    {
+        if (node->prev)
+            node->prev->next = node->next;
+        else
+            *node->slot = node->next;
+        if (node->next)
+            node->next->prev = node->prev;
+        node->slot = nullptr;
+        node->prev = nullptr;
+        node->next = nullptr;
+    }
+
+    /** The first tick after \c current_ which has work to do: either a bottom level slot with timers in it, or a
+     *  cascade of an upper level slot with timers in it. Nothing happens on the ticks in between, so the thread sleeps
+     *  through them and \c run skips straight over them.
+    **/
+    std::uint64_t next_event() const
+    {
+        std::uint64_t next = std::numeric_limits<std::uint64_t>::max();
+        for (std::size_t level = 0; level < level_count; ++level)
+        {
+            // A slot at this level is visited when the tick's bits for this level match its index and every bit below
+            // them is zero (for the bottom level, that is just every tick).
+            std::size_t   shift = level_bits * level;
+            std::uint64_t base  = current_ >> shift;
+            for (std::uint64_t step = 1; step <= slot_count; ++step)
+            {
+                if (slots_[level][(base + step) & (slot_count - 1)])
+                {
+                    next = std::min(next, (base + step) << shift);
+                    break;
+                }
+            }
+        }
+        return next;
+    }
+
+    /** Move to the next tick: cascade the upper levels if the lower ones wrapped, then move every node in the current
+     *  slot of the bottom level onto \c firing_. Nothing here allocates, so a tick can never be half processed.
+    **/
+    void advance() noexcept
+    {
+        ++current_;
+
+        // Cascade from the top down, since a cascaded timer can land in a slot of a level which is cascaded next.
+        std::size_t wrapped = 0;
+        while (wrapped + 1 < level_count && ((current_ >> (level_bits * (wrapped + 1))) << (level_bits * (wrapped + 1)))
+                                            == current_
+              )
+            ++wrapped;
+        for (std::size_t level = wrapped; level > 0; --level)
+        {
+            detail::timer_node** slot = &slots_[level][(current_ >> (level_bits * level)) & (slot_count - 1)];
+            detail::timer_node*  node = *slot;
+            *slot = nullptr;
+            while (node)
+            {
+                detail::timer_node* next = node->next;
+                place(node);
+                node = next;
+            }
+        }
+
+        detail::timer_node** slot = &slots_[0][current_ & (slot_count - 1)];
+        detail::timer_node*  node = *slot;
+        *slot = nullptr;
+        while (node)
+        {
+            // A node which is firing is in no slot, so \c cancel leaves it alone; it is released once it has run.
+            detail::timer_node* next = node->next;
+            node->slot = nullptr;
+            node->prev = nullptr;
+            node->next = firing_;
+            firing_ = node;
+            --size_;
+            node = next;
+        }
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(protect_);
+        while (!stop_)
+        {
+            std::uint64_t now_tick = std::uint64_t((clock_type::now() - start_) / tick_);
+            if (size_ == 0)
+            {
+                // Nothing to cascade or fire, so skip straight to now instead of walking the empty ticks.
+                current_ = std::max(current_, now_tick);
+                wake_tick_ = std::numeric_limits<std::uint64_t>::max();
+                wake_.wait(lock, [this] { return stop_ || size_ != 0; });
+                continue;
+            }
+
+            std::uint64_t next = next_event();
+            while (next <= now_tick && !firing_)
+            {
+                current_ = next - 1;
+                advance();
+                next = size_ == 0 ? std::numeric_limits<std::uint64_t>::max() : next_event();
+            }
+
+            if (firing_)
+            {
+                // Callbacks run without the lock, so they can schedule or cancel timers themselves. The nodes on the
+                // list belong to this thread until they are released.
+                detail::timer_node* firing = firing_;
+                firing_ = nullptr;
+                lock.unlock();
+                std::exception_ptr error;
+                for (detail::timer_node* node = firing; node; node = node->next)
+                {
+                    try
+                    {
+                        node->action();
+                    }
+                    catch (...)
+                    {
+                        if (!error)
+                            error = std::current_exception();
+                    }
+                    node->action = nullptr;
+                }
+                lock.lock();
+                while (firing)
+                {
+                    detail::timer_node* next = firing->next;
+                    release_node(firing);
+                    firing = next;
+                }
+                if (error && !error_)
+                    error_ = std::move(error);
+                continue;
+            }
+
+            // Nothing is due until the next event, so there is no point in walking the ticks before it.
+            current_ = std::max(current_, std::min(now_tick, next - 1));
+            wake_tick_ = next;
+            wake_.wait_until(lock, start_ + tick_ * std::int64_t(next));
+        }
+    }
+
+private:
+    const std::chrono::nanoseconds                     tick_;
+    const clock_type::time_point                       start_;
+    mutable std::mutex                                 protect_;
+    std::condition_variable                            wake_;
+    std::uint64_t                                      current_; //!< The last tick which has been processed.
+    std::size_t                                        size_;
+    detail::timer_node*                                slots_[level_count][slot_count];
+    detail::timer_node*                                free_;
+    std::vector<std::unique_ptr<detail::timer_node[]>> slabs_;
+    std::uint64_t                                      wake_tick_; //!< The tick the thread is sleeping until.
+    detail::timer_node*                                firing_;    //!< Nodes taken by \c advance, to run next.
+    std::exception_ptr                                 error_;
+    bool                                               stop_;
+    std::thread                                        thread_;
+};
+
+namespace detail
+{
+
+template <typename T>
+void timer_within_state<T>::cancel_timer()
+{
+    timer_node* node = timer_node_.load(std::memory_order_seq_cst);
+    if (node)
+        wheel_->cancel(node, timer_generation_);
+}
+
+}
+
+}
+
+#endif/*__MONADIC_TIMER_WHEEL_HPP_INCLUDED__*/
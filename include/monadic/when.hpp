@@ -0,0 +1,318 @@
+/** \file
+ *  Header file for \c when_all and \c when_any.
+ *
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __MONADIC_WHEN_HPP_INCLUDED__
+#define __MONADIC_WHEN_HPP_INCLUDED__
+
+#include "completion.hpp"
+#include "exceptional.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace monadic
+{
+
+/** The value delivered by \c when_any. **/
+template <typename T>
+struct when_any_result
+{
+    std::size_t    index; //!< The position of the first \c completion to be delivered.
+    exceptional<T> value; //!< The value it was delivered.
+};
+
+namespace detail
+{
+
+template <std::size_t... I>
+struct index_sequence
+{ };
+
+template <std::size_t N, std::size_t... I>
+struct make_index_sequence :
+        make_index_sequence<N - 1, N - 1, I...>
+{ };
+
+template <std::size_t... I>
+struct make_index_sequence<0, I...>
+{
+    using type = index_sequence<I...>;
+};
+
+/** An owning reference to the shared state of a \c when_all or \c when_any. The \c State carries its own \c refs_
+ *  count, which starts at 1 for the reference held by the creator; every callback attached to a child \c completion
+ *  holds another.
+**/
+template <typename State>
+class when_state_ref
+{
+public:
+    /** Adopt the initial reference to a freshly-allocated \a state. **/
+    explicit when_state_ref(State* state) noexcept :
+            state_(state)
+    { }
+
+    when_state_ref(when_state_ref&& src) noexcept :
+            state_(src.state_)
+    {
+        src.state_ = nullptr;
+    }
+
+    when_state_ref(const when_state_ref&) = delete;
+    when_state_ref& operator=(const when_state_ref&) = delete;
+
+    when_state_ref& operator=(when_state_ref&& src) noexcept
+    {
+        std::swap(state_, src.state_);
+        return *this;
+    }
+
+    ~when_state_ref() noexcept
+    {
+        if (state_ && state_->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete state_;
+    }
+
+    /** Get another reference to the same state. **/
+    when_state_ref share() const noexcept
+    {
+        state_->refs_.fetch_add(1, std::memory_order_relaxed);
+        return when_state_ref(state_);
+    }
+
+    State* operator->() const noexcept
+    {
+        return state_;
+    }
+
+private:
+    State* state_;
+};
+
+/** The shared state of a \c when_all. Each child writes its own slot of \c results_ and then counts down
+ *  \c remaining_; the acquire-release countdown publishes every slot to whichever thread brings it to zero, which
+ *  delivers the results. The count starts one higher than the number of children so that the results can not be
+ *  delivered before every callback has been attached.
+**/
+template <typename TResults>
+struct when_all_state
+{
+    std::atomic<std::size_t>     refs_;
+    std::atomic<std::size_t>     remaining_;
+    TResults                     results_;
+    completion_promise<TResults> promise_;
+
+    when_all_state(std::size_t count, TResults&& results) :
+            refs_(1),
+            remaining_(count + 1),
+            results_(std::move(results))
+    { }
+
+    void arrive()
+    {
+        if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            promise_.set_value(std::move(results_));
+    }
+};
+
+template <typename T>
+struct when_all_range_callback
+{
+    when_state_ref<when_all_state<std::vector<exceptional<T>>>> state_;
+    std::size_t                                                 index_;
+
+    void operator()(exceptional<T>&& result)
+    {
+        state_->results_[index_] = std::move(result);
+        state_->arrive();
+    }
+};
+
+template <typename TResults, std::size_t Index>
+struct when_all_tuple_callback
+{
+    when_state_ref<when_all_state<TResults>> state_;
+
+    void operator()(typename std::tuple_element<Index, TResults>::type&& result)
+    {
+        std::get<Index>(state_->results_) = std::move(result);
+        state_->arrive();
+    }
+};
+
+template <typename TResults, std::size_t... Index, typename... T>
+void when_all_attach(const when_state_ref<when_all_state<TResults>>& state,
+                     index_sequence<Index...>,
+                     completion<T>&... completions
+                    )
+{
+    int expand[] = { 0, (completions.on_complete(when_all_tuple_callback<TResults, Index> { state.share() }), 0)... };
+    static_cast<void>(expand);
+}
+
+/** The shared state of a \c when_any. The first child to be delivered wins \c won_ and delivers its value. The losers
+ *  are disabled once both the winner has been decided and every callback has been attached (tracked by the
+ *  \c disable_countdown_), since disabling a child which has not had its callback attached yet would make attaching it
+ *  fail.
+**/
+template <typename T>
+struct when_any_state
+{
+    std::atomic<std::size_t>               refs_;
+    std::atomic<bool>                      won_;
+    std::atomic<int>                       disable_countdown_;
+    std::size_t                            winner_;
+    std::vector<completion<T>>             children_;
+    completion_promise<when_any_result<T>> promise_;
+
+    explicit when_any_state(std::vector<completion<T>>&& children) :
+            refs_(1),
+            won_(false),
+            disable_countdown_(2),
+            winner_(0),
+            children_(std::move(children))
+    { }
+
+    void arrive()
+    {
+        if (disable_countdown_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+
+        for (std::size_t idx = 0; idx < children_.size(); ++idx)
+            if (idx != winner_)
+                children_[idx].disable();
+        // Let go of the children so their data (and the callbacks referring back to this state) can be released.
+        children_.clear();
+    }
+};
+
+template <typename T>
+struct when_any_callback
+{
+    when_state_ref<when_any_state<T>> state_;
+    std::size_t                       index_;
+
+    void operator()(exceptional<T>&& result)
+    {
+        if (state_->won_.exchange(true, std::memory_order_acq_rel))
+            return;
+
+        state_->winner_ = index_;
+        state_->promise_.set_value(when_any_result<T> { index_, std::move(result) });
+        state_->arrive();
+    }
+};
+
+}
+
+/** Get a \c completion which is delivered once every \c completion in the range <tt>[first, last)</tt> has been
+ *  delivered. The results are delivered in the same order as the range, whether they succeeded or failed, so a failure
+ *  of one does not hide the results of the others.
+ *
+ *  All of the bookkeeping is in a single shared state allocated up front; each child counts down an atomic when it is
+ *  delivered, so no lock is taken. Delivering an empty range completes immediately.
+ *
+ *  \param first, last A range of forward iterators to <tt>completion&lt;T&gt;</tt>. Each \c completion has a callback
+ *                     attached, so it can not be continued or \c get after this.
+ *  \throws std::logic_error if one of the completions has already been continued or disabled. In that case, the
+ *                           returned \c completion would never be delivered.
+ *
+ *  \code
+ *  std::vector<completion<response>> requests = send_to_all(backends);
+ *  when_all(requests.begin(), requests.end())
+ *      .map([] (std::vector<exceptional<response>> responses) { ... });
+ *  \endcode
+**/
+template <typename TIter>
+auto when_all(TIter first, TIter last)
+        -> completion<std::vector<exceptional<typename std::decay<decltype(*first)>::type::value_type>>>
+{
+    using value_type    = typename std::decay<decltype(*first)>::type::value_type;
+    using results_type  = std::vector<exceptional<value_type>>;
+    using state_type    = detail::when_all_state<results_type>;
+    using callback_type = detail::when_all_range_callback<value_type>;
+
+    std::size_t count = std::size_t(std::distance(first, last));
+    detail::when_state_ref<state_type> state(new state_type(count, results_type(count)));
+    auto result = state->promise_.get_completion();
+    for (std::size_t idx = 0; first != last; ++first, ++idx)
+        first->on_complete(callback_type { state.share(), idx });
+    state->arrive();
+    return result;
+}
+
+/** Get a \c completion which is delivered a tuple of the results of each of the given \a completions once all of them
+ *  have been delivered. This is the heterogeneous version of the range \c when_all.
+ *
+ *  \code
+ *  when_all(fetch_user(id), fetch_permissions(id))
+ *      .map([] (std::tuple<exceptional<user>, exceptional<permissions>> results) { ... });
+ *  \endcode
+**/
+template <typename... T>
+completion<std::tuple<exceptional<T>...>> when_all(completion<T>... completions)
+{
+    using results_type = std::tuple<exceptional<T>...>;
+    using state_type   = detail::when_all_state<results_type>;
+
+    detail::when_state_ref<state_type> state(new state_type(sizeof...(T), results_type()));
+    auto result = state->promise_.get_completion();
+    detail::when_all_attach(state, typename detail::make_index_sequence<sizeof...(T)>::type(), completions...);
+    state->arrive();
+    return result;
+}
+
+/** Get a \c completion which is delivered the result of whichever \c completion in the range <tt>[first, last)</tt> is
+ *  delivered first, along with its position in the range. Every other \c completion in the range is disabled, so the
+ *  threads producing their values can see that nobody cares and skip the work.
+ *
+ *  \param first, last A non-empty range of forward iterators to <tt>completion&lt;T&gt;</tt>. Like with \c when_all,
+ *                     these can not be used after this call.
+ *  \throws std::invalid_argument if the range is empty.
+ *  \throws std::logic_error if one of the completions has already been continued or disabled.
+ *
+ *  \note
+ *  The shared state holds on to the completions until one of them is delivered. If none of them ever are, their data
+ *  is kept alive along with it.
+**/
+template <typename TIter>
+auto when_any(TIter first, TIter last)
+        -> completion<when_any_result<typename std::decay<decltype(*first)>::type::value_type>>
+{
+    using value_type    = typename std::decay<decltype(*first)>::type::value_type;
+    using state_type    = detail::when_any_state<value_type>;
+    using callback_type = detail::when_any_callback<value_type>;
+
+    if (first == last)
+        throw std::invalid_argument("when_any requires at least one completion");
+
+    detail::when_state_ref<state_type> state(new state_type(std::vector<completion<value_type>>(first, last)));
+    auto result = state->promise_.get_completion();
+    for (std::size_t idx = 0; idx < state->children_.size(); ++idx)
+    {
+        // Once there is a winner, the rest are going to be disabled anyway.
+        if (state->won_.load(std::memory_order_acquire))
+            break;
+        state->children_[idx].on_complete(callback_type { state.share(), idx });
+    }
+    state->arrive();
+    return result;
+}
+
+}
+
+#endif/*__MONADIC_WHEN_HPP_INCLUDED__*/
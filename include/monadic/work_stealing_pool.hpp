@@ -0,0 +1,510 @@
+/** \file
+ *  Header file for \c work_stealing_pool.
+ *
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __MONADIC_WORK_STEALING_POOL_HPP_INCLUDED__
+#define __MONADIC_WORK_STEALING_POOL_HPP_INCLUDED__
+
+#include "completion.hpp"
+#include "executor.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace monadic
+{
+
+namespace detail
+{
+
+/** A Chase-Lev work-stealing deque of \c T pointers. The owning thread pushes and pops at the bottom (LIFO, so recently
+ *  pushed and still-cached work runs first); any other thread can steal from the top (FIFO). None of the operations
+ *  take a lock.
+ *
+ *  The implementation follows "Correct and Efficient Work-Stealing for Weak Memory Models" (Lê, Pop, Cohen and Zappa
+ *  Nardelli, 2013). When the buffer grows, the old buffer is kept alive until the deque is destroyed, since a thief
+ *  might still be reading from it.
+**/
+template <typename T>
+class work_stealing_deque
+{
+public:
+    explicit work_stealing_deque(std::size_t initial_capacity = 256) :
+            top_(0),
+            bottom_(0)
+    {
+        std::size_t capacity = 1;
+        while (capacity < initial_capacity)
+            capacity *= 2;
+        buffers_.emplace_back(new buffer(capacity));
+        buffer_.store(buffers_.back().get(), std::memory_order_relaxed);
+    }
+
+    work_stealing_deque(const work_stealing_deque&) = delete;
+    work_stealing_deque& operator=(const work_stealing_deque&) = delete;
+
+    /** Push \a item onto the bottom. Only the owning thread may call this. **/
+    void push(T* item)
+    {
+        std::int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        std::int64_t top    = top_.load(std::memory_order_acquire);
+        buffer*      buf    = buffer_.load(std::memory_order_relaxed);
+        if (bottom - top > std::int64_t(buf->capacity) - 1)
+            buf = grow(buf, top, bottom);
+        buf->put(bottom, item);
+        bottom_.store(bottom + 1, std::memory_order_release);
+    }
+
+    /** Pop an item from the bottom. Only the owning thread may call this.
+     *
+     *  \returns the most recently pushed item or \c nullptr if the deque is empty.
+    **/
+    T* pop()
+    {
+        std::int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+        buffer*      buf    = buffer_.load(std::memory_order_relaxed);
+        bottom_.store(bottom, std::memory_order_seq_cst);
+        std::int64_t top    = top_.load(std::memory_order_seq_cst);
+
+        if (top > bottom)
+        {
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        T* item = buf->get(bottom);
+        if (top == bottom)
+        {
+            // Last item -- race against the thieves for it.
+            if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                item = nullptr;
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    /** Steal an item from the top. Any thread may call this.
+     *
+     *  \returns the oldest item or \c nullptr if the deque is empty or another thread won the race for the item.
+    **/
+    T* steal()
+    {
+        std::int64_t top    = top_.load(std::memory_order_seq_cst);
+        std::int64_t bottom = bottom_.load(std::memory_order_seq_cst);
+        if (top >= bottom)
+            return nullptr;
+
+        T* item = buffer_.load(std::memory_order_acquire)->get(top);
+        if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return nullptr;
+        return item;
+    }
+
+    /** Check if the deque looks empty. This is only a hint when called from threads other than the owner. **/
+    bool empty() const
+    {
+        return top_.load(std::memory_order_seq_cst) >= bottom_.load(std::memory_order_seq_cst);
+    }
+
+private:
+    struct buffer
+    {
+        std::size_t                     capacity;
+        std::unique_ptr<std::atomic<T*>[]> items;
+
+        explicit buffer(std::size_t capacity_) :
+                capacity(capacity_),
+                items(new std::atomic<T*>[capacity_])
+        { }
+
+        T* get(std::int64_t idx) const
+        {
+            return items[std::size_t(idx) & (capacity - 1)].load(std::memory_order_relaxed);
+        }
+
+        void put(std::int64_t idx, T* item)
+        {
+            items[std::size_t(idx) & (capacity - 1)].store(item, std::memory_order_relaxed);
+        }
+    };
+
+    buffer* grow(buffer* old, std::int64_t top, std::int64_t bottom)
+    {
+        buffers_.emplace_back(new buffer(old->capacity * 2));
+        buffer* buf = buffers_.back().get();
+        for (std::int64_t idx = top; idx < bottom; ++idx)
+            buf->put(idx, old->get(idx));
+        buffer_.store(buf, std::memory_order_release);
+        return buf;
+    }
+
+private:
+    // top_ is written by thieves and bottom_ by the owner, so keep them on separate cache lines. This is padding rather
+    // than alignas, since workers are allocated with plain new, which does not respect extended alignment in C++11.
+    std::atomic<std::int64_t>             top_;
+    char                                  top_padding_[64 - sizeof(std::atomic<std::int64_t>)];
+    std::atomic<std::int64_t>             bottom_;
+    char                                  bottom_padding_[64 - sizeof(std::atomic<std::int64_t>)];
+    std::atomic<buffer*>                  buffer_;
+    std::vector<std::unique_ptr<buffer>>  buffers_;
+};
+
+/** The task \c work_stealing_pool::submit schedules: call \c func_ and deliver the result to \c promise_. **/
+template <typename T, typename Func>
+struct pool_submit_task
+{
+    completion_promise<T> promise_;
+    Func                  func_;
+
+    void operator()()
+    {
+        promise_.complete(monadic::try_to(func_));
+    }
+};
+
+}
+
+/** A fixed-size pool of threads which run tasks. Each worker thread has its own \c detail::work_stealing_deque:
+ *
+ *   - A task submitted from one of the pool's own threads (for example, from inside a continuation running on the pool)
+ *     is pushed onto that worker's deque without taking any lock.
+ *   - A worker runs its own tasks in LIFO order, so the task it most recently created (whose data is most likely still
+ *     in cache) runs next.
+ *   - A worker without local work takes tasks submitted from outside of the pool, then tries to steal the oldest task
+ *     of the other workers. Only when there is nothing to steal does it go to sleep.
+ *
+ *  This type satisfies the \ref executors "Executor" concept, so it can be used with \c completion::then_on,
+ *  \c completion::via and friends.
+ *
+ *  Tasks submitted while the pool is being destroyed still run -- the destructor waits for every queued task to finish
+ *  before joining the worker threads.
+ *
+ *  A task given to \c execute which throws does not take its worker down with it: the worker carries on with the next
+ *  task, and the first such exception is kept until \c take_exception is called. Tasks from \c submit never get that
+ *  far, since their exceptions are delivered to the returned \c completion; but the continuations of that
+ *  \c completion run on the worker too, and can still throw.
+**/
+class work_stealing_pool
+{
+public:
+    /** Create a pool with \a thread_count worker threads.
+     *
+     *  \throws std::invalid_argument if \a thread_count is 0.
+    **/
+    explicit work_stealing_pool(std::size_t thread_count = default_thread_count()) :
+            stopping_(false),
+            sleepers_(0)
+    {
+        if (thread_count == 0)
+            throw std::invalid_argument("work_stealing_pool must have at least one thread");
+
+        workers_.reserve(thread_count);
+        for (std::size_t idx = 0; idx < thread_count; ++idx)
+            workers_.emplace_back(new worker(*this, idx));
+
+        try
+        {
+            for (auto& w : workers_)
+                w->thread = std::thread([this, &w] { run_worker(*w); });
+        }
+        catch (...)
+        {
+            shutdown();
+            throw;
+        }
+    }
+
+    work_stealing_pool(const work_stealing_pool&) = delete;
+    work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+
+    ~work_stealing_pool() noexcept
+    {
+        shutdown();
+    }
+
+    /** The number of threads which will be used if none is specified: the hardware concurrency, or 1 if that is not
+     *  known.
+    **/
+    static std::size_t default_thread_count()
+    {
+        std::size_t count = std::thread::hardware_concurrency();
+        return count == 0 ? 1 : count;
+    }
+
+    /** The number of worker threads in this pool. **/
+    std::size_t size() const
+    {
+        return workers_.size();
+    }
+
+    /** Get the first exception thrown by a task since the last call, or a null \c std::exception_ptr if none has. **/
+    std::exception_ptr take_exception()
+    {
+        std::lock_guard<std::mutex> lock(error_protect_);
+        std::exception_ptr error = std::move(error_);
+        error_ = nullptr;
+        return error;
+    }
+
+    /** Schedule \a task to run on one of the pool's threads. If the calling thread is a worker of this pool, the task
+     *  goes onto that worker's own deque without locking.
+    **/
+    template <typename F>
+    void execute(F&& task)
+    {
+        worker* self = current_worker();
+        if (self && &self->owner == this)
+        {
+            self->tasks.push(self->make_node(std::forward<F>(task)));
+        }
+        else
+        {
+            std::unique_ptr<task_node> node(new task_node(std::forward<F>(task)));
+            std::lock_guard<std::mutex> lock(injected_protect_);
+            injected_.push_back(node.get());
+            node.release();
+        }
+        wake_one();
+    }
+
+    /** Run \a func on one of the pool's threads.
+     *
+     *  \returns a \c completion which is delivered the result of \a func (or the exception it throws).
+    **/
+    template <typename Func>
+    auto submit(Func&& func)
+            -> completion<decltype(func())>
+    {
+        using result_type = decltype(func());
+        using task_type   = detail::pool_submit_task<result_type, typename std::decay<Func>::type>;
+
+        completion_promise<result_type> promise;
+        auto result = promise.get_completion();
+        execute(task_type { std::move(promise), std::forward<Func>(func) });
+        return result;
+    }
+
+private:
+    struct task_node
+    {
+        executor_task task;
+
+        template <typename F>
+        explicit task_node(F&& task_) :
+                task(std::forward<F>(task_))
+        { }
+    };
+
+    struct worker
+    {
+        work_stealing_pool&                   owner;
+        std::size_t                           index;
+        std::uint64_t                         rng_state;
+        detail::work_stealing_deque<task_node> tasks;
+        std::vector<task_node*>               free_nodes;
+        std::thread                           thread;
+
+        static const std::size_t max_free_nodes = 1024;
+
+        worker(work_stealing_pool& owner_, std::size_t index_) :
+                owner(owner_),
+                index(index_),
+                rng_state(0x9E3779B97F4A7C15ULL * (index_ + 1))
+        { }
+
+        ~worker() noexcept
+        {
+            for (task_node* node : free_nodes)
+                delete node;
+        }
+
+        /** Get a node for \a task, reusing one this worker has already run if possible. **/
+        template <typename F>
+        task_node* make_node(F&& task)
+        {
+            if (free_nodes.empty())
+                return new task_node(std::forward<F>(task));
+
+            task_node* node = free_nodes.back();
+            free_nodes.pop_back();
+            node->task = std::forward<F>(task);
+            return node;
+        }
+
+        void recycle(task_node* node)
+        {
+            if (free_nodes.size() < max_free_nodes)
+                free_nodes.push_back(node);
+            else
+                delete node;
+        }
+
+        std::size_t next_random()
+        {
+            // xorshift64
+            rng_state ^= rng_state << 13;
+            rng_state ^= rng_state >> 7;
+            rng_state ^= rng_state << 17;
+            return std::size_t(rng_state);
+        }
+    };
+
+    static worker*& current_worker()
+    {
+        static thread_local worker* instance = nullptr;
+        return instance;
+    }
+
+    task_node* take_injected()
+    {
+        std::lock_guard<std::mutex> lock(injected_protect_);
+        if (injected_.empty())
+            return nullptr;
+        task_node* node = injected_.front();
+        injected_.pop_front();
+        return node;
+    }
+
+    task_node* steal_from_others(worker& self)
+    {
+        std::size_t count = workers_.size();
+        std::size_t start = self.next_random();
+        for (std::size_t offset = 0; offset < count; ++offset)
+        {
+            worker& victim = *workers_[(start + offset) % count];
+            if (&victim == &self)
+                continue;
+            if (task_node* node = victim.tasks.steal())
+                return node;
+        }
+        return nullptr;
+    }
+
+    task_node* find_task(worker& self)
+    {
+        if (task_node* node = self.tasks.pop())
+            return node;
+        if (task_node* node = take_injected())
+            return node;
+        return steal_from_others(self);
+    }
+
+    bool has_visible_work()
+    {
+        {
+            std::lock_guard<std::mutex> lock(injected_protect_);
+            if (!injected_.empty())
+                return true;
+        }
+        for (auto& w : workers_)
+            if (!w->tasks.empty())
+                return true;
+        return false;
+    }
+
+    void wake_one()
+    {
+        // This is a read-modify-write rather than a load so that it is ordered with the increment of sleepers_ in
+        // run_worker: either we see the sleeper or the sleeper sees the task we just queued.
+        if (sleepers_.fetch_add(0, std::memory_order_seq_cst) != 0)
+        {
+            std::lock_guard<std::mutex> lock(sleep_protect_);
+            sleep_cv_.notify_one();
+        }
+    }
+
+    void run_worker(worker& self)
+    {
+        current_worker() = &self;
+        while (true)
+        {
+            if (task_node* node = find_task(self))
+            {
+                try
+                {
+                    node->task();
+                }
+                catch (...)
+                {
+                    keep_exception(std::current_exception());
+                }
+                node->task = nullptr;
+                self.recycle(node);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleep_protect_);
+            sleepers_.fetch_add(1, std::memory_order_seq_cst);
+            if (!has_visible_work())
+            {
+                if (stopping_.load(std::memory_order_acquire))
+                {
+                    sleepers_.fetch_sub(1, std::memory_order_relaxed);
+                    break;
+                }
+                sleep_cv_.wait(lock);
+            }
+            sleepers_.fetch_sub(1, std::memory_order_relaxed);
+        }
+        current_worker() = nullptr;
+    }
+
+    void keep_exception(std::exception_ptr error)
+    {
+        std::lock_guard<std::mutex> lock(error_protect_);
+        if (!error_)
+            error_ = std::move(error);
+    }
+
+    void shutdown() noexcept
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_protect_);
+            stopping_.store(true, std::memory_order_release);
+            sleep_cv_.notify_all();
+        }
+        for (auto& w : workers_)
+            if (w->thread.joinable())
+                w->thread.join();
+
+        // If the threads could not all be started, there might be work left over. It will never run, so just drop it.
+        for (task_node* node : injected_)
+            delete node;
+        injected_.clear();
+        for (auto& w : workers_)
+            while (task_node* node = w->tasks.pop())
+                delete node;
+    }
+
+private:
+    std::vector<std::unique_ptr<worker>> workers_;
+    std::mutex                           injected_protect_;
+    std::deque<task_node*>               injected_;
+    std::mutex                           sleep_protect_;
+    std::condition_variable              sleep_cv_;
+    std::atomic<bool>                    stopping_;
+    std::atomic<std::size_t>             sleepers_;
+    std::mutex                           error_protect_;
+    std::exception_ptr                   error_;
+};
+
+}
+
+#endif/*__MONADIC_WORK_STEALING_POOL_HPP_INCLUDED__*/
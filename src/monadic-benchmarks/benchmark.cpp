@@ -0,0 +1,101 @@
+/** \file
+ *  
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "benchmark.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+
+namespace
+{
+
+std::atomic<std::size_t> allocations(0);
+
+}
+
+void* operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace monadic_benchmarks
+{
+
+std::size_t allocation_count()
+{
+    return allocations.load(std::memory_order_relaxed);
+}
+
+stopwatch::stopwatch() :
+        _start(std::chrono::steady_clock::now()),
+        _start_allocations(allocation_count())
+{ }
+
+std::chrono::nanoseconds stopwatch::elapsed() const
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start);
+}
+
+std::size_t stopwatch::allocations() const
+{
+    return allocation_count() - _start_allocations;
+}
+
+benchmark_list_type& get_benchmarks()
+{
+    static benchmark_list_type instance;
+    return instance;
+}
+
+benchmark::benchmark(const std::string& name, std::size_t iterations) :
+        _name(name),
+        _iterations(iterations)
+{
+    get_benchmarks().push_back(this);
+}
+
+void benchmark::run()
+{
+    std::cout << "BENCHMARK: " << _name << std::endl;
+    stopwatch watch;
+    run_impl(_iterations);
+    report("per iteration", watch, _iterations);
+}
+
+void benchmark::report(const std::string& label, const stopwatch& watch, std::size_t ops) const
+{
+    auto        elapsed     = watch.elapsed();
+    std::size_t allocations = watch.allocations();
+    double      per_op      = ops == 0 ? 0.0 : double(elapsed.count()) / double(ops);
+    double      allocs_op   = ops == 0 ? 0.0 : double(allocations) / double(ops);
+    std::cout << "  " << std::left << std::setw(40) << label
+              << std::right << std::setw(12) << std::fixed << std::setprecision(1) << per_op << " ns/op"
+              << std::setw(8) << std::setprecision(2) << allocs_op << " allocs/op"
+              << "  (" << ops << " ops in " << std::setprecision(3) << (double(elapsed.count()) / 1e6) << " ms)"
+              << std::endl;
+}
+
+}
@@ -0,0 +1,96 @@
+/** \file
+ *  
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __MONADIC_BENCHMARKS_BENCHMARK_HPP_INCLUDED__
+#define __MONADIC_BENCHMARKS_BENCHMARK_HPP_INCLUDED__
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <string>
+
+namespace monadic_benchmarks
+{
+
+class benchmark;
+
+typedef std::deque<benchmark*> benchmark_list_type;
+benchmark_list_type& get_benchmarks();
+
+/** Prevent the optimizer from discarding the computation of \a value. **/
+template <typename T>
+void do_not_optimize(T&& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/** The number of calls to the global \c operator \c new made by this program so far. **/
+std::size_t allocation_count();
+
+/** Measures the elapsed time and the number of allocations made since it was created. **/
+class stopwatch
+{
+public:
+    stopwatch();
+    
+    std::chrono::nanoseconds elapsed() const;
+    
+    std::size_t allocations() const;
+    
+private:
+    std::chrono::steady_clock::time_point _start;
+    std::size_t                           _start_allocations;
+};
+
+/** A single benchmark. The body is given the number of \c iterations it should perform and is timed as a whole; the
+ *  reported numbers are the time and allocations per iteration. Use \c report to print additional measurements (such
+ *  as a breakdown by thread count) from within the body.
+**/
+class benchmark
+{
+public:
+    explicit benchmark(const std::string& name, std::size_t iterations);
+    
+    void run();
+    
+    const std::string& name() const
+    {
+        return _name;
+    }
+    
+protected:
+    /** Print a labeled result of the time and allocations measured by \a watch over \a ops operations. **/
+    void report(const std::string& label, const stopwatch& watch, std::size_t ops) const;
+    
+private:
+    virtual void run_impl(std::size_t iterations) = 0;
+    
+protected:
+    std::string _name;
+    std::size_t _iterations;
+};
+
+#define BENCHMARK(name_, iterations_)                           \
+    class name_ ## _benchmark :                                 \
+            public ::monadic_benchmarks::benchmark              \
+    {                                                           \
+    public:                                                     \
+        name_ ## _benchmark() :                                 \
+            ::monadic_benchmarks::benchmark(#name_, iterations_) \
+        { }                                                     \
+                                                                \
+        void run_impl(std::size_t iterations);                  \
+    } name_ ## _benchmark_instance;                             \
+                                                                \
+    void name_ ## _benchmark::run_impl(std::size_t iterations)
+
+}
+
+#endif/*__MONADIC_BENCHMARKS_BENCHMARK_HPP_INCLUDED__*/
@@ -0,0 +1,228 @@
+/** \file
+ *  
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "benchmark.hpp"
+
+#include <monadic/completion.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace monadic_benchmarks
+{
+
+using namespace monadic;
+
+static const std::size_t chain_length = 20;
+
+/** The \c completion_map test pattern: build a chain of \c map calls before the value is delivered. The reported time
+ *  is per hop (one \c map and its eventual invocation).
+**/
+BENCHMARK(completion_map_chain_per_hop, 100000)
+{
+    stopwatch watch;
+    for (std::size_t iter = 0; iter < iterations; ++iter)
+    {
+        completion_promise<int> promise;
+        completion<int> fval = promise.get_completion();
+        for (std::size_t idx = 0; idx < chain_length; ++idx)
+            fval = fval.map([] (int x) { return x + 1; });
+        promise.set_value(1);
+        do_not_optimize(fval.get());
+    }
+    report("map chain (per hop)", watch, iterations * chain_length);
+}
+
+struct add_one
+{
+    int operator()(int x) const
+    {
+        return x + 1;
+    }
+};
+
+/** The same 20 steps as \c completion_map_chain_per_hop, but fused with \c completion::pipe into a single
+ *  continuation. The reported time is per step, so it can be compared directly.
+**/
+BENCHMARK(completion_pipe_per_hop, 100000)
+{
+    static_assert(chain_length == 20, "the pipe below has to be written out by hand");
+    
+    stopwatch watch;
+    for (std::size_t iter = 0; iter < iterations; ++iter)
+    {
+        completion_promise<int> promise;
+        completion<int> fval = promise.get_completion()
+                                      .pipe(map(add_one()), map(add_one()), map(add_one()), map(add_one()),
+                                            map(add_one()), map(add_one()), map(add_one()), map(add_one()),
+                                            map(add_one()), map(add_one()), map(add_one()), map(add_one()),
+                                            map(add_one()), map(add_one()), map(add_one()), map(add_one()),
+                                            map(add_one()), map(add_one()), map(add_one()), map(add_one())
+                                           );
+        promise.set_value(1);
+        do_not_optimize(fval.get());
+    }
+    report("pipe (per hop)", watch, iterations * chain_length);
+}
+
+/** Like \c completion_map_chain_per_hop, but the value is delivered before the chain is built, so every \c map runs
+ *  inline.
+**/
+BENCHMARK(completion_map_ready_per_hop, 100000)
+{
+    stopwatch watch;
+    for (std::size_t iter = 0; iter < iterations; ++iter)
+    {
+        completion_promise<int> promise;
+        promise.set_value(1);
+        completion<int> fval = promise.get_completion();
+        for (std::size_t idx = 0; idx < chain_length; ++idx)
+            fval = fval.map([] (int x) { return x + 1; });
+        do_not_optimize(fval.get());
+    }
+    report("map ready (per hop)", watch, iterations * chain_length);
+}
+
+/** Call \c get on a \c completion whose value has already been delivered. **/
+BENCHMARK(completion_get_ready, 1000000)
+{
+    stopwatch watch;
+    for (std::size_t iter = 0; iter < iterations; ++iter)
+    {
+        completion_promise<int> promise;
+        promise.set_value(int(iter));
+        do_not_optimize(promise.get_completion().get());
+    }
+    report("get (ready)", watch, iterations);
+}
+
+/** Two threads hand values back and forth, each blocking in \c get until the other delivers. The reported time is per
+ *  round trip (two blocking gets).
+**/
+BENCHMARK(completion_get_ping_pong, 20000)
+{
+    std::vector<completion_promise<int>> ping_promises(iterations);
+    std::vector<completion_promise<int>> pong_promises(iterations);
+    std::vector<completion<int>>         pings;
+    std::vector<completion<int>>         pongs;
+    for (std::size_t idx = 0; idx < iterations; ++idx)
+    {
+        pings.push_back(ping_promises[idx].get_completion());
+        pongs.push_back(pong_promises[idx].get_completion());
+    }
+    
+    stopwatch watch;
+    std::thread ponger([&]
+        {
+            for (std::size_t idx = 0; idx < iterations; ++idx)
+                pong_promises[idx].set_value(pings[idx].get());
+        });
+    for (std::size_t idx = 0; idx < iterations; ++idx)
+    {
+        ping_promises[idx].set_value(int(idx));
+        do_not_optimize(pongs[idx].get());
+    }
+    ponger.join();
+    report("round trip", watch, iterations);
+}
+
+/** Deliver a failure through a 10-stage chain of \c map calls, ending in a \c recover. The reported time is per
+ *  chain.
+**/
+BENCHMARK(completion_failure_chain, 20000)
+{
+    const std::size_t  stages = 10;
+    std::exception_ptr error  = std::make_exception_ptr(std::runtime_error("failure"));
+    
+    stopwatch watch;
+    for (std::size_t iter = 0; iter < iterations; ++iter)
+    {
+        completion_promise<int> promise;
+        completion<int> fval = promise.get_completion();
+        for (std::size_t idx = 0; idx < stages; ++idx)
+            fval = fval.map([] (int x) { return x + 1; });
+        completion<int> recovered = fval.recover([] (std::exception_ptr) { return -1; });
+        promise.set_exception(error);
+        do_not_optimize(recovered.get());
+    }
+    report("failed 10-stage chain", watch, iterations);
+}
+
+/** Read \c state and \c disable a \c completion while its continuation is still running on another thread. The
+ *  transition to \c complete happens before the continuation is called, so neither has to wait for it to finish.
+**/
+BENCHMARK(completion_state_during_callback, 1000000)
+{
+    completion_promise<int> promise;
+    completion<int> source = promise.get_completion();
+    std::atomic<bool> entered(false);
+    std::atomic<bool> release(false);
+    source.on_complete([&] (exceptional<int>)
+                       {
+                           entered.store(true);
+                           while (!release.load())
+                               std::this_thread::yield();
+                       }
+                      );
+    std::thread producer([&] { promise.set_value(1); });
+    while (!entered.load())
+        std::this_thread::yield();
+    
+    stopwatch watch;
+    for (std::size_t iter = 0; iter < iterations; ++iter)
+        do_not_optimize(source.state());
+    report("state (callback running)", watch, iterations);
+    
+    stopwatch disable_watch;
+    for (std::size_t iter = 0; iter < iterations; ++iter)
+        source.disable();
+    report("disable (callback running)", disable_watch, iterations);
+    
+    release.store(true);
+    producer.join();
+}
+
+/** The same reads and disables with a \c std::mutex held around a running continuation, the way a lock-based
+ *  \c completion would. Each reader waits out the continuation, which here takes about a microsecond.
+**/
+BENCHMARK(completion_state_during_callback_locked, 10000)
+{
+    std::mutex                    protect;
+    std::atomic<completion_state> state(completion_state::has_callback);
+    std::atomic<bool>             stop(false);
+    std::thread producer([&]
+        {
+            while (!stop.load())
+            {
+                std::lock_guard<std::mutex> lock(protect);
+                auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(1);
+                while (std::chrono::steady_clock::now() < until)
+                    continue;
+            }
+        });
+    
+    stopwatch watch;
+    for (std::size_t iter = 0; iter < iterations; ++iter)
+    {
+        std::lock_guard<std::mutex> lock(protect);
+        do_not_optimize(state.load());
+    }
+    report("state (locked callback running)", watch, iterations);
+    
+    stop.store(true);
+    producer.join();
+}
+
+}
@@ -0,0 +1,137 @@
+/** \file
+ *
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "benchmark.hpp"
+
+#include <monadic/completion_channel.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace monadic_benchmarks
+{
+
+using namespace monadic;
+
+static const std::size_t batch_size = 64;
+
+/** Send and receive one value at a time through the \c completion returning calls. **/
+BENCHMARK(completion_channel_send_receive, 1000000)
+{
+    completion_channel<std::size_t> channel(1024);
+    stopwatch watch;
+    for (std::size_t idx = 0; idx < iterations; ++idx)
+    {
+        channel.send(idx);
+        do_not_optimize(channel.receive().get());
+    }
+    report("send + receive", watch, iterations);
+}
+
+/** The same with \c try_send and \c try_receive, which do not allocate. **/
+BENCHMARK(completion_channel_try, 1000000)
+{
+    completion_channel<std::size_t> channel(1024);
+    std::size_t out = 0;
+    stopwatch watch;
+    for (std::size_t idx = 0; idx < iterations; ++idx)
+    {
+        std::size_t value = idx;
+        channel.try_send(value);
+        channel.try_receive(out);
+        do_not_optimize(out);
+    }
+    report("try_send + try_receive", watch, iterations);
+}
+
+/** Fill the channel with \c try_send and drain it with \c receive_n. The reported time is per value. **/
+BENCHMARK(completion_channel_receive_n, 20000)
+{
+    completion_channel<std::size_t> channel(batch_size);
+    stopwatch watch;
+    for (std::size_t iter = 0; iter < iterations; ++iter)
+    {
+        for (std::size_t idx = 0; idx < batch_size; ++idx)
+        {
+            std::size_t value = idx;
+            channel.try_send(value);
+        }
+        do_not_optimize(channel.receive_n(batch_size).get().size());
+    }
+    report("try_send + receive_n (per value)", watch, iterations * batch_size);
+}
+
+/** A producer thread pushes values as fast as the channel lets it while the main thread drains them in batches. The
+ *  channel is the general one, since it has no single-producer, single-consumer mode.
+**/
+BENCHMARK(completion_channel_one_to_one, 2000000)
+{
+    completion_channel<std::size_t> channel(1024);
+    stopwatch watch;
+    std::thread producer([&]
+                         {
+                             for (std::size_t idx = 0; idx < iterations; ++idx)
+                             {
+                                 std::size_t value = idx;
+                                 if (!channel.try_send(value))
+                                     channel.send(value).get();
+                             }
+                         }
+                        );
+    for (std::size_t received = 0; received < iterations; )
+        received += channel.receive_n(batch_size).get().size();
+    producer.join();
+    report("one to one (per value)", watch, iterations);
+}
+
+/** The same two threads with a mutex and condition variable around a \c std::deque, as a point of comparison. **/
+BENCHMARK(completion_channel_one_to_one_mutex_deque, 2000000)
+{
+    std::mutex              protect;
+    std::condition_variable changed;
+    std::deque<std::size_t> queue;
+    const std::size_t       capacity = 1024;
+
+    stopwatch watch;
+    std::thread producer([&]
+                         {
+                             for (std::size_t idx = 0; idx < iterations; ++idx)
+                             {
+                                 std::unique_lock<std::mutex> lock(protect);
+                                 changed.wait(lock, [&] { return queue.size() < capacity; });
+                                 queue.push_back(idx);
+                                 changed.notify_all();
+                             }
+                         }
+                        );
+    std::vector<std::size_t> batch;
+    for (std::size_t received = 0; received < iterations; )
+    {
+        batch.clear();
+        {
+            std::unique_lock<std::mutex> lock(protect);
+            changed.wait(lock, [&] { return !queue.empty(); });
+            while (!queue.empty() && batch.size() < batch_size)
+            {
+                batch.push_back(queue.front());
+                queue.pop_front();
+            }
+            changed.notify_all();
+        }
+        received += batch.size();
+    }
+    producer.join();
+    report("one to one mutex + deque (per value)", watch, iterations);
+}
+
+}
@@ -0,0 +1,34 @@
+/** \file
+ *  
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "benchmark.hpp"
+
+#include <monadic/completion_pool.hpp>
+
+namespace monadic_benchmarks
+{
+
+using namespace monadic;
+
+/** The same as \c completion_get_ready, but the promise comes from a \c completion_pool. **/
+BENCHMARK(completion_pool_get_ready, 1000000)
+{
+    completion_pool<int> pool(64);
+    stopwatch watch;
+    for (std::size_t iter = 0; iter < iterations; ++iter)
+    {
+        completion_promise<int> promise = pool.make_promise();
+        promise.set_value(int(iter));
+        do_not_optimize(promise.get_completion().get());
+    }
+    report("pooled get (ready)", watch, iterations);
+}
+
+}
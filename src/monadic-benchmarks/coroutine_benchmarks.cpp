@@ -0,0 +1,62 @@
+/** \file
+ *  
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "benchmark.hpp"
+
+#include <monadic/coroutine.hpp>
+
+// Only built with a C++20 compiler (make benchmark CXX_STANDARD="--std=c++20").
+#if MONADIC_HAS_COROUTINES
+
+#include <vector>
+
+namespace monadic_benchmarks
+{
+
+using namespace monadic;
+
+static const std::size_t step_count = 20;
+
+static completion<int> await_all(std::vector<completion<int>>& steps)
+{
+    int total = 0;
+    for (auto& step : steps)
+        total += co_await std::move(step);
+    co_return total;
+}
+
+/** A single coroutine awaits \c step_count completions in turn, each delivered after the coroutine is suspended on it.
+ *  Compare with \c completion_map_chain_per_hop, which allocates a \c completion_data per step.
+**/
+BENCHMARK(coroutine_await_per_step, 100000)
+{
+    std::vector<completion_promise<int>> promises;
+    std::vector<completion<int>>         steps;
+    stopwatch watch;
+    for (std::size_t iter = 0; iter < iterations; ++iter)
+    {
+        promises.clear();
+        steps.clear();
+        for (std::size_t idx = 0; idx < step_count; ++idx)
+        {
+            promises.emplace_back();
+            steps.push_back(promises.back().get_completion());
+        }
+        completion<int> total = await_all(steps);
+        for (auto& p : promises)
+            p.set_value(1);
+        do_not_optimize(total.get());
+    }
+    report("co_await (per step, incl. promise)", watch, iterations * step_count);
+}
+
+}
+
+#endif
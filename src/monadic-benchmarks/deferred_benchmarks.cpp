@@ -0,0 +1,55 @@
+/** \file
+ *
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "benchmark.hpp"
+
+#include <monadic/deferred.hpp>
+
+namespace monadic_benchmarks
+{
+
+using namespace monadic;
+
+/** Produce a value and run it through three \c map steps on the calling thread. **/
+BENCHMARK(deferred_map_get, 1000000)
+{
+    stopwatch watch;
+    for (std::size_t iter = 0; iter < iterations; ++iter)
+    {
+        int seed = int(iter);
+        do_not_optimize(defer([seed] { return seed; })
+                        .map([] (int x) { return x + 1; })
+                        .map([] (int x) { return x * 2; })
+                        .map([] (int x) { return x - 3; })
+                        .get()
+                       );
+    }
+    report("deferred map x3 + get", watch, iterations);
+}
+
+/** The same steps as \c deferred_map_get with an eager \c completion, which allocates for every step. **/
+BENCHMARK(deferred_map_get_eager, 1000000)
+{
+    stopwatch watch;
+    for (std::size_t iter = 0; iter < iterations; ++iter)
+    {
+        completion_promise<int> promise;
+        promise.set_value(int(iter));
+        do_not_optimize(promise.get_completion()
+                               .map([] (int x) { return x + 1; })
+                               .map([] (int x) { return x * 2; })
+                               .map([] (int x) { return x - 3; })
+                               .get()
+                       );
+    }
+    report("completion map x3 + get", watch, iterations);
+}
+
+}
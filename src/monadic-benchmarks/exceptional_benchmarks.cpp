@@ -0,0 +1,156 @@
+/** \file
+ *
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "benchmark.hpp"
+
+#include <monadic/exceptional.hpp>
+
+#include <array>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace monadic_benchmarks
+{
+
+using namespace monadic;
+
+namespace
+{
+
+using big_struct = std::array<double, 16>;
+
+/** The layout \c exceptional had before its value and exception shared storage. **/
+template <typename T>
+struct side_by_side
+{
+    std::exception_ptr ex;
+    T                  val;
+};
+
+template <typename T>
+void report_size(const std::string& name)
+{
+    std::cout << "  sizeof(exceptional<" << name << ">)" << std::string(24 - name.size(), ' ')
+              << std::setw(5) << sizeof(exceptional<T>) << " bytes  (side by side: " << sizeof(side_by_side<T>) << ")"
+              << std::endl;
+}
+
+template <typename T>
+void construct_success(std::size_t iterations, const T& value)
+{
+    for (std::size_t iter = 0; iter < iterations; ++iter)
+    {
+        exceptional<T> x = exceptional<T>::success(value);
+        do_not_optimize(x);
+    }
+}
+
+template <typename T>
+void construct_failure(std::size_t iterations, const std::exception_ptr& error)
+{
+    for (std::size_t iter = 0; iter < iterations; ++iter)
+    {
+        exceptional<T> x = exceptional<T>::failure(error);
+        do_not_optimize(x);
+    }
+}
+
+}
+
+/** Print the size of \c exceptional for some common value types, next to what it would be with separate members. **/
+BENCHMARK(exceptional_sizeof, 1)
+{
+    report_size<int>("int");
+    report_size<double>("double");
+    report_size<std::string>("std::string");
+    report_size<std::vector<int>>("std::vector<int>");
+    report_size<big_struct>("std::array<double, 16>");
+    std::cout << "  sizeof(exceptional<int, std::error_code>)     " << std::setw(5)
+              << sizeof(exceptional<int, std::error_code>) << " bytes" << std::endl;
+    do_not_optimize(iterations);
+}
+
+/** Construct successful and failed instances of \c exceptional for some common value types. A failure only copies the
+ *  \c std::exception_ptr; no value is constructed.
+**/
+BENCHMARK(exceptional_construct, 1000000)
+{
+    std::exception_ptr error = std::make_exception_ptr(std::runtime_error("failure"));
+    
+    {
+        stopwatch watch;
+        construct_success<double>(iterations, 1.0);
+        report("success<double>", watch, iterations);
+    }
+    {
+        stopwatch watch;
+        construct_failure<double>(iterations, error);
+        report("failure<double>", watch, iterations);
+    }
+    {
+        std::string value("a string long enough not to fit in the small buffer");
+        stopwatch watch;
+        construct_success<std::string>(iterations, value);
+        report("success<std::string>", watch, iterations);
+    }
+    {
+        stopwatch watch;
+        construct_failure<std::string>(iterations, error);
+        report("failure<std::string>", watch, iterations);
+    }
+    {
+        big_struct value = {};
+        stopwatch watch;
+        construct_success<big_struct>(iterations, value);
+        report("success<std::array<double, 16>>", watch, iterations);
+    }
+    {
+        stopwatch watch;
+        construct_failure<big_struct>(iterations, error);
+        report("failure<std::array<double, 16>>", watch, iterations);
+    }
+}
+
+/** Create a fresh failure and push it through a \c map, the way a hot path reports an expected error: once as an
+ *  exception, once as an \c std::error_code stored inline.
+**/
+BENCHMARK(exceptional_typed_failure, 1000000)
+{
+    {
+        stopwatch watch;
+        for (std::size_t iter = 0; iter < iterations; ++iter)
+        {
+            auto x = exceptional<int>::failure(std::make_exception_ptr(std::system_error(
+                             std::make_error_code(std::errc::resource_unavailable_try_again)
+                         )))
+                     .map([] (int v) { return v + 1; });
+            do_not_optimize(x);
+        }
+        report("failure<int> (exception_ptr)", watch, iterations);
+    }
+    {
+        stopwatch watch;
+        for (std::size_t iter = 0; iter < iterations; ++iter)
+        {
+            auto x = exceptional<int, std::error_code>::failure(
+                             std::make_error_code(std::errc::resource_unavailable_try_again)
+                         )
+                     .map([] (int v) { return v + 1; });
+            do_not_optimize(x);
+        }
+        report("failure<int, std::error_code>", watch, iterations);
+    }
+}
+
+}
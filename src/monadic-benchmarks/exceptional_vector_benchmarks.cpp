@@ -0,0 +1,131 @@
+/** \file
+ *
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "benchmark.hpp"
+
+#include <monadic/exceptional_vector.hpp>
+
+#include <cstddef>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace monadic_benchmarks
+{
+
+using namespace monadic;
+
+namespace
+{
+
+const std::size_t batch_size = 10000;
+
+/** A batch of scores where one row in \a failure_every fails (or none, if it is 0). **/
+template <typename TBatch>
+TBatch make_scores(std::size_t failure_every)
+{
+    std::exception_ptr error = std::make_exception_ptr(std::runtime_error("bad row"));
+    TBatch out;
+    out.reserve(batch_size);
+    for (std::size_t idx = 0; idx < batch_size; ++idx)
+    {
+        if (failure_every != 0 && idx % failure_every == 0)
+            out.push_back(exceptional<double>::failure(error));
+        else
+            out.push_back(exceptional<double>::success(double(idx) * 0.25));
+    }
+    return out;
+}
+
+double adjust(double x)
+{
+    return x * 1.5 + 2.0;
+}
+
+void map_rows(const std::vector<exceptional<double>>& batch, std::size_t iterations)
+{
+    for (std::size_t iter = 0; iter < iterations; ++iter)
+    {
+        std::vector<exceptional<double>> out;
+        out.reserve(batch.size());
+        for (const auto& row : batch)
+            out.push_back(row.map(adjust));
+        do_not_optimize(out);
+    }
+}
+
+void map_rows(const exceptional_vector<double>& batch, std::size_t iterations)
+{
+    for (std::size_t iter = 0; iter < iterations; ++iter)
+    {
+        auto out = batch.map(adjust);
+        do_not_optimize(out);
+    }
+}
+
+}
+
+/** Map a batch of 10k \c exceptional<double> scores, stored as a \c std::vector<exceptional<double>> and as an
+ *  \c exceptional_vector<double>, with no failures and with a failure in every 100 and every 8 rows. The results are
+ *  per row.
+**/
+BENCHMARK(exceptional_vector_map, 1000)
+{
+    for (std::size_t failure_every : { std::size_t(0), std::size_t(100), std::size_t(8) })
+    {
+        std::string failures = failure_every == 0   ? "no failures"
+                             : failure_every == 100 ? "1% failures"
+                             :                        "12% failures";
+        {
+            auto batch = make_scores<std::vector<exceptional<double>>>(failure_every);
+            stopwatch watch;
+            map_rows(batch, iterations);
+            report("vector<exceptional>  " + failures, watch, iterations * batch_size);
+        }
+        {
+            auto batch = make_scores<exceptional_vector<double>>(failure_every);
+            stopwatch watch;
+            map_rows(batch, iterations);
+            report("exceptional_vector   " + failures, watch, iterations * batch_size);
+        }
+    }
+}
+
+/** Replace the failures in a batch of 10k scores with a default, in each layout. The results are per row. **/
+BENCHMARK(exceptional_vector_recover, 1000)
+{
+    auto fallback = [] (const std::exception_ptr&) { return 0.0; };
+    {
+        auto batch = make_scores<std::vector<exceptional<double>>>(100);
+        stopwatch watch;
+        for (std::size_t iter = 0; iter < iterations; ++iter)
+        {
+            std::vector<exceptional<double>> out;
+            out.reserve(batch.size());
+            for (const auto& row : batch)
+                out.push_back(row.recover(fallback));
+            do_not_optimize(out);
+        }
+        report("vector<exceptional>  1% failures", watch, iterations * batch_size);
+    }
+    {
+        auto batch = make_scores<exceptional_vector<double>>(100);
+        stopwatch watch;
+        for (std::size_t iter = 0; iter < iterations; ++iter)
+        {
+            auto out = batch.recover(fallback);
+            do_not_optimize(out);
+        }
+        report("exceptional_vector   1% failures", watch, iterations * batch_size);
+    }
+}
+
+}
@@ -0,0 +1,36 @@
+/** \file
+ *  
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "benchmark.hpp"
+
+int main(int argc, char** argv)
+{
+    std::string filter;
+    if (argc == 2)
+        filter = argv[1];
+    
+    // Real users of completions are multi-threaded. Some standard libraries skip atomic operations (in shared_ptr, for
+    // example) until a second thread has been started, which would make comparisons against them meaningless.
+    std::thread([] { }).join();
+    
+    for (auto bench : monadic_benchmarks::get_benchmarks())
+    {
+        bool shouldrun = filter.empty()
+                      || bench->name().find(filter) != std::string::npos;
+        if (shouldrun)
+            bench->run();
+    }
+    
+    return 0;
+}
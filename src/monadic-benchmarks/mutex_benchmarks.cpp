@@ -0,0 +1,219 @@
+/** \file
+ *
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "benchmark.hpp"
+
+#include <monadic/adaptive_mutex.hpp>
+#include <monadic/mcs_mutex.hpp>
+#include <monadic/spin_mutex.hpp>
+#include <monadic/ticket_mutex.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace monadic_benchmarks
+{
+
+using namespace monadic;
+
+namespace
+{
+
+/** Have \a threads threads take turns incrementing a shared counter under \a mtx, \a iterations times in total. The
+ *  threads start together, so every acquisition is contended.
+**/
+template <typename TMutex>
+void contend(TMutex& mtx, std::size_t threads, std::size_t iterations)
+{
+    std::uint64_t            counter = 0;
+    std::atomic<std::size_t> ready(0);
+    std::vector<std::thread> workers;
+    for (std::size_t idx = 0; idx < threads; ++idx)
+        workers.emplace_back([&, idx]
+                             {
+                                 std::size_t count = iterations / threads + (idx < iterations % threads ? 1 : 0);
+                                 ready.fetch_add(1);
+                                 while (ready.load() < threads)
+                                     std::this_thread::yield();
+
+                                 for (std::size_t iter = 0; iter < count; ++iter)
+                                 {
+                                     std::lock_guard<TMutex> lock(mtx);
+                                     ++counter;
+                                 }
+                             }
+                            );
+    for (auto& worker : workers)
+        worker.join();
+    do_not_optimize(counter);
+}
+
+template <typename TMutex>
+void lock_unlock(TMutex& mtx, std::size_t iterations)
+{
+    for (std::size_t iter = 0; iter < iterations; ++iter)
+    {
+        std::lock_guard<TMutex> lock(mtx);
+        do_not_optimize(iter);
+    }
+}
+
+/** Have \a threads threads take \a mtx \a acquisitions times in total, holding it for \a hold each time (sleeping, as
+ *  if the holder were blocked or descheduled).
+ *
+ *  \returns the CPU time the process used, in milliseconds.
+**/
+template <typename TMutex>
+double hold_long(TMutex& mtx, std::size_t threads, std::size_t acquisitions, std::chrono::microseconds hold)
+{
+    std::clock_t start = std::clock();
+    std::vector<std::thread> workers;
+    for (std::size_t idx = 0; idx < threads; ++idx)
+        workers.emplace_back([&]
+                             {
+                                 for (std::size_t iter = 0; iter < acquisitions / threads; ++iter)
+                                 {
+                                     std::lock_guard<TMutex> lock(mtx);
+                                     std::this_thread::sleep_for(hold);
+                                 }
+                             }
+                            );
+    for (auto& worker : workers)
+        worker.join();
+    return 1000.0 * double(std::clock() - start) / CLOCKS_PER_SEC;
+}
+
+/** The thread counts to measure: powers of 2 from 1 to 64. Counts above the hardware concurrency show how each lock
+ *  behaves when the thread next in line may not be running.
+**/
+std::vector<std::size_t> thread_counts()
+{
+    std::vector<std::size_t> out;
+    for (std::size_t threads = 1; threads <= 64; threads *= 2)
+        out.push_back(threads);
+    return out;
+}
+
+}
+
+/** Take an uncontended lock and release it. **/
+BENCHMARK(mutex_uncontended, 10000000)
+{
+    {
+        spin_mutex mtx;
+        stopwatch watch;
+        lock_unlock(mtx, iterations);
+        report("spin_mutex", watch, iterations);
+    }
+    {
+        adaptive_mutex mtx;
+        stopwatch watch;
+        lock_unlock(mtx, iterations);
+        report("adaptive_mutex", watch, iterations);
+    }
+    {
+        ticket_mutex mtx;
+        stopwatch watch;
+        lock_unlock(mtx, iterations);
+        report("ticket_mutex", watch, iterations);
+    }
+    {
+        mcs_mutex mtx;
+        stopwatch watch;
+        lock_unlock(mtx, iterations);
+        report("mcs_mutex", watch, iterations);
+    }
+    {
+        std::mutex mtx;
+        stopwatch watch;
+        lock_unlock(mtx, iterations);
+        report("std::mutex", watch, iterations);
+    }
+}
+
+/** Increment a counter under a lock from 1 to 64 threads, comparing \c spin_mutex, \c adaptive_mutex, the fair queue
+ *  locks (\c ticket_mutex and \c mcs_mutex) and \c std::mutex. The results are per acquisition.
+**/
+BENCHMARK(mutex_contention, 200000)
+{
+    for (std::size_t threads : thread_counts())
+    {
+        {
+            spin_mutex mtx;
+            stopwatch watch;
+            contend(mtx, threads, iterations);
+            report("spin_mutex " + std::to_string(threads) + " threads", watch, iterations);
+        }
+        {
+            adaptive_mutex mtx;
+            stopwatch watch;
+            contend(mtx, threads, iterations);
+            report("adaptive_mutex " + std::to_string(threads) + " threads", watch, iterations);
+        }
+        {
+            ticket_mutex mtx;
+            stopwatch watch;
+            contend(mtx, threads, iterations);
+            report("ticket_mutex " + std::to_string(threads) + " threads", watch, iterations);
+        }
+        {
+            mcs_mutex mtx;
+            stopwatch watch;
+            contend(mtx, threads, iterations);
+            report("mcs_mutex " + std::to_string(threads) + " threads", watch, iterations);
+        }
+        {
+            std::mutex mtx;
+            stopwatch watch;
+            contend(mtx, threads, iterations);
+            report("std::mutex " + std::to_string(threads) + " threads", watch, iterations);
+        }
+    }
+}
+
+/** Hold a lock for 200us at a time (sleeping inside of it) from 4 threads, and print how much CPU time the waiters burn
+ *  for each acquisition. Waiters on a \c spin_mutex keep a core busy for the whole time; waiters on an
+ *  \c adaptive_mutex learn to park almost immediately.
+**/
+BENCHMARK(mutex_long_hold, 400)
+{
+    const std::size_t               threads = 4;
+    const std::chrono::microseconds hold(200);
+    auto print = [&] (const char* label, double cpu_ms)
+                 {
+                     std::cout << "  " << std::left << std::setw(40) << label << std::right << std::fixed
+                               << std::setprecision(1) << std::setw(8) << 1000.0 * cpu_ms / double(iterations)
+                               << " us CPU/op" << std::endl;
+                 };
+    {
+        spin_mutex mtx;
+        print("spin_mutex", hold_long(mtx, threads, iterations, hold));
+    }
+    {
+        adaptive_mutex mtx;
+        print("adaptive_mutex", hold_long(mtx, threads, iterations, hold));
+    }
+    {
+        std::mutex mtx;
+        print("std::mutex", hold_long(mtx, threads, iterations, hold));
+    }
+}
+
+}
@@ -0,0 +1,108 @@
+/** \file
+ *
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "benchmark.hpp"
+
+#include <monadic/parallel.hpp>
+#include <monadic/work_stealing_pool.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace monadic_benchmarks
+{
+
+using namespace monadic;
+
+/** A small, fixed amount of CPU work per element. **/
+static std::uint64_t element_work(std::uint64_t seed)
+{
+    for (int idx = 0; idx < 50; ++idx)
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return seed;
+}
+
+static std::uint64_t combine(std::uint64_t acc, std::uint64_t x)
+{
+    return acc ^ element_work(x);
+}
+
+/** Reduce \c iterations elements with \c parallel_reduce on pools of 1 thread up to the hardware concurrency, at
+ *  several grain sizes. The hand-rolled version starts one \c std::thread per core for every call and splits the range
+ *  evenly between them, which is what \c parallel_reduce replaces. The results are per element.
+**/
+BENCHMARK(parallel_reduce_scaling, 1 << 20)
+{
+    std::vector<std::uint64_t> values(iterations);
+    for (std::size_t idx = 0; idx < values.size(); ++idx)
+        values[idx] = idx;
+
+    std::size_t max_threads = work_stealing_pool::default_thread_count();
+    for (std::size_t threads = 1; ; threads = std::min(threads * 2, max_threads))
+    {
+        {
+            stopwatch watch;
+            std::vector<std::uint64_t> partials(threads);
+            std::vector<std::thread>   workers;
+            for (std::size_t worker = 0; worker < threads; ++worker)
+                workers.emplace_back([&, worker]
+                                     {
+                                         std::size_t begin = values.size() * worker / threads;
+                                         std::size_t end   = values.size() * (worker + 1) / threads;
+                                         std::uint64_t acc = 0;
+                                         for (std::size_t idx = begin; idx < end; ++idx)
+                                             acc = combine(acc, values[idx]);
+                                         partials[worker] = acc;
+                                     }
+                                    );
+            for (auto& worker : workers)
+                worker.join();
+            do_not_optimize(partials);
+            report(std::to_string(threads) + " threads, std::thread", watch, iterations);
+        }
+
+        work_stealing_pool pool(threads);
+        for (std::size_t grain : { std::size_t(16), std::size_t(256), std::size_t(4096), std::size_t(65536) })
+        {
+            stopwatch watch;
+            auto result = parallel_reduce(pool, values.begin(), values.end(), std::uint64_t(0), combine, grain);
+            do_not_optimize(result.get());
+            report(std::to_string(threads) + " threads, grain " + std::to_string(grain), watch, iterations);
+        }
+
+        if (threads >= max_threads)
+            break;
+    }
+}
+
+/** Map \c iterations elements with \c parallel_map on a pool with a thread per core, at several grain sizes, to show
+ *  the cost of collecting an \c exceptional per element. The results are per element.
+**/
+BENCHMARK(parallel_map_grain, 1 << 20)
+{
+    std::vector<std::uint64_t> values(iterations);
+    for (std::size_t idx = 0; idx < values.size(); ++idx)
+        values[idx] = idx;
+
+    work_stealing_pool pool;
+    for (std::size_t grain : { std::size_t(16), std::size_t(256), std::size_t(4096), std::size_t(65536) })
+    {
+        stopwatch watch;
+        auto results = parallel_map(pool, values.begin(), values.end(), element_work, grain);
+        do_not_optimize(results.get());
+        report(std::to_string(pool.size()) + " threads, grain " + std::to_string(grain), watch, iterations);
+    }
+}
+
+}
@@ -0,0 +1,80 @@
+/** \file
+ *
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "benchmark.hpp"
+
+#include <monadic/shared_completion.hpp>
+
+#include <vector>
+
+namespace monadic_benchmarks
+{
+
+using namespace monadic;
+
+static const std::size_t subscriber_count = 16;
+
+/** Attach 16 consumers to a \c shared_completion before the value arrives, then deliver it. The reported time is per
+ *  consumer.
+**/
+BENCHMARK(shared_completion_fan_out, 50000)
+{
+    stopwatch watch;
+    for (std::size_t iter = 0; iter < iterations; ++iter)
+    {
+        completion_promise<std::size_t> promise;
+        shared_completion<std::size_t> shared = promise.get_completion().share();
+        std::size_t total = 0;
+        for (std::size_t idx = 0; idx < subscriber_count; ++idx)
+            shared.on_complete([&total] (const exceptional<std::size_t>& x) { total += x.get(); });
+        promise.set_value(iter);
+        do_not_optimize(total);
+    }
+    report("subscribe + deliver (per consumer)", watch, iterations * subscriber_count);
+}
+
+/** The same fan-out done by hand: one extra \c completion_promise per consumer, delivered from a single callback. **/
+BENCHMARK(shared_completion_fan_out_manual, 50000)
+{
+    stopwatch watch;
+    for (std::size_t iter = 0; iter < iterations; ++iter)
+    {
+        completion_promise<std::size_t> promise;
+        std::vector<completion_promise<std::size_t>> fan(subscriber_count);
+        std::size_t total = 0;
+        for (auto& consumer : fan)
+            consumer.get_completion().on_complete([&total] (exceptional<std::size_t> x) { total += x.get(); });
+        promise.get_completion().on_complete([&fan] (exceptional<std::size_t> x)
+                                             {
+                                                 for (auto& consumer : fan)
+                                                     consumer.complete(x);
+                                             }
+                                            );
+        promise.set_value(iter);
+        do_not_optimize(total);
+    }
+    report("extra promises (per consumer)", watch, iterations * subscriber_count);
+}
+
+/** Subscribe to a \c shared_completion which has already been delivered. **/
+BENCHMARK(shared_completion_late_subscriber, 10000000)
+{
+    completion_promise<std::size_t> promise;
+    promise.set_value(1);
+    shared_completion<std::size_t> shared = promise.get_completion().share();
+    std::size_t total = 0;
+    stopwatch watch;
+    for (std::size_t iter = 0; iter < iterations; ++iter)
+        shared.on_complete([&total] (const exceptional<std::size_t>& x) { total += x.get(); });
+    report("late subscriber", watch, iterations);
+    do_not_optimize(total);
+}
+
+}
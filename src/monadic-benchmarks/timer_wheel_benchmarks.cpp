@@ -0,0 +1,50 @@
+/** \file
+ *
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "benchmark.hpp"
+
+#include <monadic/timer_wheel.hpp>
+
+#include <vector>
+
+namespace monadic_benchmarks
+{
+
+using namespace monadic;
+
+/** Put a deadline on a \c completion and deliver it in time, which schedules and then cancels a timer. **/
+BENCHMARK(timer_wheel_within_cancel, 1000000)
+{
+    timer_wheel timers;
+    stopwatch watch;
+    for (std::size_t iter = 0; iter < iterations; ++iter)
+    {
+        completion_promise<std::size_t> promise;
+        completion<std::size_t> c = promise.get_completion().within(timers, std::chrono::seconds(10));
+        promise.set_value(iter);
+        do_not_optimize(c.get());
+    }
+    report("within + deliver in time", watch, iterations);
+}
+
+/** Schedule a million timers spread over a minute, so they live in every level of the wheel, then drop them. **/
+BENCHMARK(timer_wheel_outstanding, 1000000)
+{
+    std::vector<completion<void>> pending;
+    pending.reserve(iterations);
+    timer_wheel timers;
+    stopwatch watch;
+    for (std::size_t iter = 0; iter < iterations; ++iter)
+        pending.emplace_back(timers.after(std::chrono::microseconds(iter * 60)));
+    report("after (1M outstanding)", watch, iterations);
+    do_not_optimize(timers.size());
+}
+
+}
@@ -0,0 +1,88 @@
+/** \file
+ *  
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "benchmark.hpp"
+
+#include <monadic/when.hpp>
+
+#include <mutex>
+#include <vector>
+
+namespace monadic_benchmarks
+{
+
+using namespace monadic;
+
+static const std::size_t fan_out = 32;
+
+/** Join \c fan_out completions with \c when_all. The reported time is per child. **/
+BENCHMARK(when_all_fan_out, 20000)
+{
+    std::vector<completion_promise<int>> promises;
+    std::vector<completion<int>> completions;
+    stopwatch watch;
+    for (std::size_t iter = 0; iter < iterations; ++iter)
+    {
+        promises.clear();
+        completions.clear();
+        for (std::size_t idx = 0; idx < fan_out; ++idx)
+        {
+            promises.emplace_back();
+            completions.push_back(promises.back().get_completion());
+        }
+        auto all = when_all(completions.begin(), completions.end());
+        for (auto& p : promises)
+            p.set_value(1);
+        do_not_optimize(all.get().size());
+    }
+    report("when_all (per child)", watch, iterations * fan_out);
+}
+
+/** The same join done by hand with \c on_complete and a mutex-protected counter, as it was before \c when_all. **/
+BENCHMARK(when_all_fan_out_manual, 20000)
+{
+    std::vector<completion_promise<int>> promises;
+    std::vector<completion<int>> completions;
+    stopwatch watch;
+    for (std::size_t iter = 0; iter < iterations; ++iter)
+    {
+        promises.clear();
+        completions.clear();
+        for (std::size_t idx = 0; idx < fan_out; ++idx)
+        {
+            promises.emplace_back();
+            completions.push_back(promises.back().get_completion());
+        }
+
+        std::mutex                    protect;
+        std::size_t                   remaining = fan_out;
+        std::vector<exceptional<int>> results(fan_out);
+        completion_promise<std::vector<exceptional<int>>> done;
+        auto all = done.get_completion();
+        for (std::size_t idx = 0; idx < fan_out; ++idx)
+            completions[idx].on_complete([&, idx] (exceptional<int>&& x)
+                                         {
+                                             std::unique_lock<std::mutex> lock(protect);
+                                             results[idx] = std::move(x);
+                                             if (--remaining == 0)
+                                             {
+                                                 lock.unlock();
+                                                 done.set_value(std::move(results));
+                                             }
+                                         }
+                                        );
+        for (auto& p : promises)
+            p.set_value(1);
+        do_not_optimize(all.get().size());
+    }
+    report("manual join (per child)", watch, iterations * fan_out);
+}
+
+}
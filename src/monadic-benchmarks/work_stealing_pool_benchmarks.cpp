@@ -0,0 +1,80 @@
+/** \file
+ *  
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "benchmark.hpp"
+
+#include <monadic/work_stealing_pool.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+namespace monadic_benchmarks
+{
+
+using namespace monadic;
+
+/** A small, fixed amount of CPU work per task. **/
+static std::uint64_t spin_work(std::uint64_t seed)
+{
+    for (int idx = 0; idx < 2000; ++idx)
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return seed;
+}
+
+/** Fan out \c iterations tasks from inside the pool (so they go to the local deque and get stolen by the other workers)
+ *  and report the time per task for pools of 1 thread up to the hardware concurrency.
+**/
+BENCHMARK(work_stealing_pool_scaling, 200000)
+{
+    std::size_t max_threads = work_stealing_pool::default_thread_count();
+    for (std::size_t threads = 1; ; threads = std::min(threads * 2, max_threads))
+    {
+        work_stealing_pool pool(threads);
+        std::atomic<std::size_t> remaining(iterations);
+        completion_promise<void> done;
+        completion<void> finished = done.get_completion();
+
+        stopwatch watch;
+        pool.execute([&]
+                     {
+                         for (std::size_t idx = 0; idx < iterations; ++idx)
+                             pool.execute([&, idx]
+                                          {
+                                              do_not_optimize(spin_work(idx));
+                                              if (remaining.fetch_sub(1) == 1)
+                                                  done.set_value();
+                                          }
+                                         );
+                     }
+                    );
+        finished.get();
+        report(std::to_string(threads) + " threads (per task)", watch, iterations);
+
+        if (threads >= max_threads)
+            break;
+    }
+}
+
+/** Submit tasks from a thread outside of the pool, which go through the shared injection queue. **/
+BENCHMARK(work_stealing_pool_submit_external, 200000)
+{
+    work_stealing_pool pool;
+    stopwatch watch;
+    completion<std::size_t> last = pool.submit([] { return std::size_t(0); });
+    for (std::size_t idx = 1; idx < iterations; ++idx)
+        last = pool.submit([idx] { return idx; });
+    do_not_optimize(last.get());
+    report("external submit", watch, iterations);
+}
+
+}
@@ -0,0 +1,127 @@
+/** \file
+ *  
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "test.hpp"
+#include "util.hpp"
+
+#include <monadic/adaptive_mutex.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace monadic_tests
+{
+
+using namespace monadic;
+
+TEST(adaptive_mutex_try_lock)
+{
+    adaptive_mutex mtx;
+    ensure(mtx.try_lock());
+    ensure(!mtx.try_lock());
+    ensure(!mtx.try_lock_spins(100));
+    ensure_eq(1U, mtx.native_handle()->load());
+    mtx.unlock();
+    ensure_eq(0U, mtx.native_handle()->load());
+    ensure(mtx.try_lock_spins(1));
+    mtx.unlock();
+}
+
+TEST(adaptive_mutex_try_lock_for)
+{
+    adaptive_mutex mtx;
+    std::lock_guard<adaptive_mutex> held(mtx);
+
+    auto start = std::chrono::steady_clock::now();
+    ensure(!mtx.try_lock_for(std::chrono::milliseconds(5)));
+    ensure(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(5));
+
+    ensure(!mtx.try_lock_until(std::chrono::steady_clock::now() - std::chrono::seconds(1)));
+}
+
+TEST(adaptive_mutex_parks_and_wakes)
+{
+    adaptive_mutex mtx;
+    mtx.lock();
+
+    std::thread waiter([&mtx]
+                       {
+                           mtx.lock();
+                           mtx.unlock();
+                       }
+                      );
+    // Once the waiter gives up spinning, it marks the lock as contended and parks.
+    ensure(loop_until([&mtx] { return mtx.native_handle()->load() == 2U; },
+                      std::chrono::steady_clock::now() + std::chrono::seconds(10)
+                     )
+          );
+    mtx.unlock();
+    waiter.join();
+    ensure_eq(0U, mtx.native_handle()->load());
+}
+
+TEST(adaptive_mutex_timed_handoff)
+{
+    adaptive_mutex mtx;
+    mtx.lock();
+    std::thread other([&mtx]
+                      {
+                          std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                          mtx.unlock();
+                      }
+                     );
+    ensure(mtx.try_lock_for(std::chrono::seconds(10)));
+    other.join();
+    mtx.unlock();
+}
+
+TEST(adaptive_mutex_spin_limit_decays)
+{
+    adaptive_mutex mtx;
+    std::uint32_t initial = mtx.spin_limit();
+    ensure_lt(std::uint32_t(adaptive_mutex::min_spins), initial);
+
+    // A lock which is always held for longer than the spin limit teaches waiters to stop spinning.
+    mtx.lock();
+    for (int attempt = 0; attempt < 50; ++attempt)
+        ensure(!mtx.try_lock_for(std::chrono::microseconds(1)));
+    mtx.unlock();
+    ensure_eq(std::uint32_t(adaptive_mutex::min_spins), mtx.spin_limit());
+}
+
+TEST(adaptive_mutex_contention)
+{
+    static const std::size_t thread_count = 8;
+    static const std::size_t increments   = 20000;
+
+    adaptive_mutex mtx;
+    std::size_t    counter = 0;
+    std::vector<std::thread> threads;
+    for (std::size_t idx = 0; idx < thread_count; ++idx)
+        threads.emplace_back([&]
+                             {
+                                 for (std::size_t iter = 0; iter < increments; ++iter)
+                                 {
+                                     std::lock_guard<adaptive_mutex> lock(mtx);
+                                     ++counter;
+                                 }
+                             }
+                            );
+    for (auto& thread : threads)
+        thread.join();
+    ensure_eq(thread_count * increments, counter);
+    ensure_eq(0U, mtx.native_handle()->load());
+}
+
+}
@@ -0,0 +1,139 @@
+/** \file
+ *  
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "test.hpp"
+#include "util.hpp"
+
+#include <monadic/completion.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace monadic_tests
+{
+
+using namespace monadic;
+
+TEST(cancellation_propagates_up_chain)
+{
+    completion_promise<int> promise;
+    std::size_t calls = 0;
+    completion<int> head = promise.get_completion();
+    completion<int> middle = head.map([&calls] (int x) { ++calls; return x + 1; });
+    completion<int> tail = middle.map([&calls] (int x) { ++calls; return x + 1; });
+    ensure(!promise.is_cancelled());
+
+    tail.disable();
+    ensure(promise.is_cancelled());
+    ensure(head.state() == completion_state::disabled);
+    ensure(middle.state() == completion_state::disabled);
+
+    promise.set_value(1);
+    ensure_eq(0U, calls);
+}
+
+TEST(cancellation_token)
+{
+    completion_promise<int> promise;
+    completion_cancellation_token token = promise.get_cancellation_token();
+    completion_cancellation_token copy = token;
+    ensure(!completion_cancellation_token().is_cancelled());
+
+    completion<int> c = promise.get_completion().then([] (exceptional<int> x) { return x.get(); });
+    ensure(!copy.is_cancelled());
+    c.disable();
+    ensure(token.is_cancelled());
+    ensure(copy.is_cancelled());
+}
+
+TEST(cancellation_token_outlives_promise)
+{
+    completion_cancellation_token token;
+    {
+        completion_promise<int> promise;
+        token = promise.get_cancellation_token();
+        promise.get_completion().disable();
+    }
+    ensure(token.is_cancelled());
+}
+
+TEST(cancellation_through_executor)
+{
+    manual_executor exec;
+    completion_promise<int> promise;
+    std::size_t calls = 0;
+    completion<int> c = promise.get_completion()
+                               .map_on(exec, [&calls] (int x) { ++calls; return x; })
+                               .map([&calls] (int x) { ++calls; return x; });
+    c.disable();
+    ensure(promise.is_cancelled());
+    promise.set_value(1);
+    ensure_eq(0U, exec.run_all());
+    ensure_eq(0U, calls);
+}
+
+TEST(cancellation_skips_queued_step)
+{
+    manual_executor exec;
+    completion_promise<int> promise;
+    std::size_t calls = 0;
+    completion<int> c = promise.get_completion().map_on(exec, [&calls] (int x) { ++calls; return x; });
+    promise.set_value(1);
+    ensure_eq(1U, exec.pending());
+
+    // The value has already left the promise, so there is nothing upstream to cancel -- but the queued step is skipped.
+    c.disable();
+    ensure_eq(1U, exec.run_all());
+    ensure_eq(0U, calls);
+}
+
+TEST(cancellation_after_delivery_does_not_reach_back)
+{
+    completion_promise<int> promise;
+    completion<int> c = promise.get_completion().map([] (int x) { return x + 1; });
+    promise.set_value(1);
+    c.disable();
+    ensure(!promise.is_cancelled());
+}
+
+TEST(cancellation_long_chain)
+{
+    completion_promise<int> promise;
+    completion<int> c = promise.get_completion();
+    for (std::size_t idx = 0; idx < 10000; ++idx)
+        c = c.map([] (int x) { return x + 1; });
+    c.disable();
+    ensure(promise.is_cancelled());
+}
+
+TEST(cancellation_race_with_delivery)
+{
+    const std::size_t count = 20000;
+    std::vector<completion_promise<int>> promises(count);
+    std::vector<completion<int>>         tails;
+    tails.reserve(count);
+    for (auto& promise : promises)
+        tails.push_back(promise.get_completion().map([] (int x) { return x + 1; }).map([] (int x) { return x * 2; }));
+
+    std::thread producer([&]
+        {
+            for (std::size_t idx = 0; idx < count; ++idx)
+                promises[idx].set_value(int(idx));
+        });
+    for (auto& tail : tails)
+        tail.disable();
+    producer.join();
+
+    for (auto& tail : tails)
+        ensure(tail.state() == completion_state::disabled);
+}
+
+}
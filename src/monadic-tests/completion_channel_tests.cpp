@@ -0,0 +1,297 @@
+/** \file
+ *
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "test.hpp"
+#include "util.hpp"
+
+#include <monadic/completion_channel.hpp>
+#include <monadic/timer_wheel.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace monadic_tests
+{
+
+using namespace monadic;
+
+TEST(completion_channel_in_order)
+{
+    completion_channel<int> channel(8);
+    for (int x = 0; x < 5; ++x)
+        ensure(channel.send(x).state() == completion_state::has_value);
+    for (int x = 0; x < 5; ++x)
+        ensure_eq(x, channel.receive().get());
+}
+
+TEST(completion_channel_receive_waits)
+{
+    completion_channel<int> channel(4);
+    auto first = channel.receive();
+    auto second = channel.receive();
+    ensure(first.state() == completion_state::no_value);
+
+    channel.send(1);
+    channel.send(2);
+    ensure_eq(1, first.get());
+    ensure_eq(2, second.get());
+}
+
+TEST(completion_channel_capacity_rounds_up)
+{
+    completion_channel<int> channel(5);
+    ensure_eq(8U, channel.capacity());
+    ensure_eq(2U, completion_channel<int>(1).capacity());
+    ensure_throws(std::invalid_argument, completion_channel<int>(0));
+}
+
+TEST(completion_channel_backpressure)
+{
+    completion_channel<int> channel(2);
+    ensure(channel.send(0).state() == completion_state::has_value);
+    ensure(channel.send(1).state() == completion_state::has_value);
+    auto third = channel.send(2);
+    auto fourth = channel.send(3);
+    ensure(third.state() == completion_state::no_value);
+
+    ensure_eq(0, channel.receive().get());
+    ensure(third.state() == completion_state::has_value);
+    ensure(fourth.state() == completion_state::no_value);
+
+    // A waiting send keeps later sends from the same thread from jumping ahead of it, even with room in the ring.
+    int later = 4;
+    ensure(!channel.try_send(later));
+    for (int x = 1; x < 4; ++x)
+        ensure_eq(x, channel.receive().get());
+    ensure(fourth.state() == completion_state::has_value);
+}
+
+TEST(completion_channel_receive_n)
+{
+    completion_channel<int> channel(8);
+    for (int x = 0; x < 5; ++x)
+        channel.send(x);
+
+    std::vector<int> first = channel.receive_n(3).get();
+    ensure_eq(3U, first.size());
+    ensure_eq(0, first[0]);
+    ensure_eq(2, first[2]);
+
+    std::vector<int> rest = channel.receive_n(100).get();
+    ensure_eq(2U, rest.size());
+    ensure_eq(3, rest[0]);
+    ensure_eq(4, rest[1]);
+
+    ensure_throws(std::invalid_argument, channel.receive_n(0));
+}
+
+TEST(completion_channel_receive_n_waits)
+{
+    completion_channel<int> channel(8);
+    auto batch = channel.receive_n(4);
+    ensure(batch.state() == completion_state::no_value);
+
+    channel.send(7);
+    std::vector<int> values = batch.get();
+    ensure_eq(1U, values.size());
+    ensure_eq(7, values[0]);
+}
+
+TEST(completion_channel_try)
+{
+    completion_channel<std::unique_ptr<int>> channel(2);
+    std::unique_ptr<int> value(new int(1));
+    ensure(channel.try_send(value));
+    ensure(!value);
+    std::unique_ptr<int> second(new int(3));
+    ensure(channel.try_send(second));
+
+    std::unique_ptr<int> rejected(new int(2));
+    ensure(!channel.try_send(rejected));
+    ensure(rejected && *rejected == 2);
+
+    std::unique_ptr<int> out;
+    ensure(channel.try_receive(out));
+    ensure_eq(1, *out);
+    ensure(channel.try_receive(out));
+    ensure_eq(3, *out);
+    ensure(!channel.try_receive(out));
+}
+
+TEST(completion_channel_close_drains_first)
+{
+    completion_channel<int> channel(4);
+    channel.send(1);
+    channel.close();
+    ensure(channel.is_closed());
+    ensure_throws(completion_channel_closed, channel.send(2).get());
+
+    ensure_eq(1, channel.receive().get());
+    ensure_throws(completion_channel_closed, channel.receive().get());
+    ensure_throws(completion_channel_closed, channel.receive_n(2).get());
+}
+
+TEST(completion_channel_close_with_reason)
+{
+    completion_channel<int> channel(4);
+    auto waiting = channel.receive();
+    auto waiting_batch = channel.receive_n(2);
+    channel.close(std::make_exception_ptr(std::runtime_error("upstream went away")));
+    ensure_throws(std::runtime_error, waiting.get());
+    ensure_throws(std::runtime_error, waiting_batch.get());
+    ensure_throws(std::runtime_error, channel.receive().get());
+}
+
+TEST(completion_channel_close_fails_waiting_sends)
+{
+    completion_channel<int> channel(2);
+    channel.send(1);
+    channel.send(2);
+    auto waiting = channel.send(3);
+    channel.close();
+    ensure_throws(completion_channel_closed, waiting.get());
+
+    ensure_eq(1, channel.receive().get());
+    ensure_eq(2, channel.receive().get());
+    ensure_throws(completion_channel_closed, channel.receive().get());
+}
+
+TEST(completion_channel_disabled_receive_gives_up_its_place)
+{
+    completion_channel<int> channel(4);
+    auto abandoned = channel.receive();
+    auto next = channel.receive();
+    abandoned.disable();
+
+    channel.send(1);
+    ensure_eq(1, next.get());
+}
+
+TEST(completion_channel_disabled_send_is_withdrawn)
+{
+    completion_channel<int> channel(2);
+    channel.send(1);
+    channel.send(2);
+    auto withdrawn = channel.send(3);
+    auto kept = channel.send(4);
+    withdrawn.disable();
+
+    ensure_eq(1, channel.receive().get());
+    ensure_eq(2, channel.receive().get());
+    ensure_eq(4, channel.receive().get());
+    ensure(kept.state() == completion_state::has_value);
+}
+
+TEST(completion_channel_threads)
+{
+    static const int producers = 4;
+    static const int per_producer = 5000;
+
+    completion_channel<int> channel(64);
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&channel, p]
+        {
+            for (int x = 0; x < per_producer; ++x)
+                channel.send(p * per_producer + x).get();
+        });
+    }
+
+    std::atomic<long long> sum(0);
+    std::atomic<int>       received(0);
+    std::vector<std::thread> consumers;
+    for (int c = 0; c < 2; ++c)
+    {
+        consumers.emplace_back([&]
+        {
+            std::vector<int> last_seen(producers, -1);
+            while (true)
+            {
+                std::vector<int> batch;
+                try
+                {
+                    batch = channel.receive_n(16).get();
+                }
+                catch (const completion_channel_closed&)
+                {
+                    return;
+                }
+                for (int x : batch)
+                {
+                    // Each producer's values arrive in the order they were sent.
+                    ensure(last_seen[x / per_producer] < x);
+                    last_seen[x / per_producer] = x;
+                    sum.fetch_add(x);
+                }
+                received.fetch_add(int(batch.size()));
+            }
+        });
+    }
+
+    for (auto& t : threads)
+        t.join();
+    channel.close();
+    for (auto& t : consumers)
+        t.join();
+
+    const long long total = producers * per_producer;
+    ensure_eq(total, received.load());
+    ensure_eq(total * (total - 1) / 2, sum.load());
+}
+
+TEST(completion_channel_receive_within_race)
+{
+    // Receives which time out race with the sends which would satisfy them. A value taken for a receiver which times
+    // out in the meantime must go to a later receiver instead of being lost.
+    static const int count = 3000;
+
+    completion_channel<int> channel(8);
+    timer_wheel             timers(std::chrono::microseconds(20));
+    std::thread producer([&channel]
+                         {
+                             for (int x = 0; x < count; ++x)
+                             {
+                                 channel.send(x).get();
+                                 if (x % 4 == 0)
+                                     std::this_thread::yield();
+                             }
+                         }
+                        );
+
+    int       received = 0;
+    long long sum      = 0;
+    int       timeouts = 0;
+    auto      expiry   = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (received < count && std::chrono::steady_clock::now() < expiry)
+    {
+        try
+        {
+            sum += channel.receive().within(timers, std::chrono::microseconds(received % 7 * 10)).get();
+            ++received;
+        }
+        catch (const completion_timeout&)
+        {
+            ++timeouts;
+        }
+    }
+    producer.join();
+
+    ensure_eq(count, received);
+    ensure_eq(static_cast<long long>(count) * (count - 1) / 2, sum);
+    int extra;
+    ensure(!channel.try_receive(extra));
+}
+
+}
@@ -0,0 +1,122 @@
+/** \file
+ *  
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "test.hpp"
+
+#include <monadic/completion_pool.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace monadic_tests
+{
+
+using namespace monadic;
+
+TEST(completion_pool_recycles)
+{
+    completion_pool<int> pool(4, 1);
+    ensure_eq(4U, pool.capacity());
+    ensure_eq(4U, pool.free_count());
+
+    {
+        completion_promise<int> promise = pool.make_promise();
+        completion<int> c = promise.get_completion().map([] (int x) { return x + 1; });
+        ensure_eq(3U, pool.free_count());
+        promise.set_value(1);
+        ensure_eq(2, c.get());
+    }
+    ensure_eq(4U, pool.free_count());
+
+    // A recycled instance comes back fresh.
+    completion_promise<int> promise = pool.make_promise();
+    completion<int> c = promise.get_completion();
+    ensure(c.state() == completion_state::no_value);
+    promise.set_value(5);
+    ensure_eq(5, c.get());
+}
+
+TEST(completion_pool_releases_value)
+{
+    completion_pool<std::shared_ptr<int>> pool(1, 1);
+    auto value = std::make_shared<int>(1);
+    {
+        completion_promise<std::shared_ptr<int>> promise = pool.make_promise();
+        promise.set_value(value);
+        ensure_eq(2, value.use_count());
+    }
+    ensure_eq(1, value.use_count());
+}
+
+TEST(completion_pool_grows)
+{
+    completion_pool<int> pool(2, 1);
+    std::vector<completion_promise<int>> promises;
+    for (int idx = 0; idx < 40; ++idx)
+        promises.push_back(pool.make_promise());
+    ensure_le(40U, pool.capacity());
+    promises.clear();
+    ensure_eq(pool.capacity(), pool.free_count());
+}
+
+TEST(completion_pool_thread_index_reused)
+{
+    completion_pool<int> pool(32, 2);
+    std::vector<std::size_t> indices;
+    for (int thread_idx = 0; thread_idx < 20; ++thread_idx)
+    {
+        std::thread([&]
+                    {
+                        indices.push_back(detail::completion_pool_thread_index());
+                        std::vector<completion_promise<int>> promises;
+                        for (int idx = 0; idx < 16; ++idx)
+                            promises.push_back(pool.make_promise());
+                    }
+                   ).join();
+    }
+
+    // Each thread took over the number (and the cached instances) of the one before it, so nothing was stranded.
+    for (std::size_t index : indices)
+        ensure_eq(indices[0], index);
+    ensure_eq(32U, pool.capacity());
+    ensure_eq(pool.capacity(), pool.free_count());
+}
+
+TEST(completion_pool_threads)
+{
+    completion_pool<int> pool(64, 4);
+    std::vector<std::thread> threads;
+    for (int thread_idx = 0; thread_idx < 4; ++thread_idx)
+        threads.emplace_back([&]
+                             {
+                                 for (int idx = 0; idx < 10000; ++idx)
+                                 {
+                                     auto promise = pool.make_promise();
+                                     auto c = promise.get_completion();
+                                     // Hand the promise to another thread every so often so instances move between
+                                     // shards.
+                                     if (idx % 100 == 0)
+                                         std::thread([&promise, idx] { promise.set_value(idx); }).join();
+                                     else
+                                         promise.set_value(idx);
+                                     if (c.get() != idx)
+                                         throw std::logic_error("wrong value");
+                                 }
+                             }
+                            );
+    for (auto& t : threads)
+        t.join();
+    ensure_eq(pool.capacity(), pool.free_count());
+}
+
+}
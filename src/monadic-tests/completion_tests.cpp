@@ -14,9 +14,16 @@
 #include <monadic/completion.hpp>
 #include <monadic/spin_mutex.hpp>
 
+#include <atomic>
 #include <cassert>
 #include <chrono>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
 #include <thread>
+#include <vector>
 
 namespace monadic_tests
 {
@@ -88,4 +95,361 @@ TEST(completion_promise_multiple_sets)
     ensure_throws(std::logic_error, promise.set_value());
 }
 
+TEST(completion_handles_are_one_pointer)
+{
+    ensure_eq(sizeof(void*), sizeof(completion<int>));
+    ensure_eq(sizeof(void*), sizeof(completion_promise<int>));
+}
+
+TEST(completion_data_ptr_refcount)
+{
+    completion_data_ptr<int> data = make_completion_data<int>();
+    ensure_eq(1U, data->refs_.load());
+    {
+        completion_promise<int> promise(data);
+        completion<int> c = promise.get_completion();
+        ensure_eq(3U, data->refs_.load());
+    }
+    ensure_eq(1U, data->refs_.load());
+}
+
+TEST(completion_race_set_value_map)
+{
+    const std::size_t count = 100000;
+    std::vector<completion_promise<int>> promises(count);
+    std::vector<completion<int>>         sources;
+    std::vector<completion<int>>         results;
+    sources.reserve(count);
+    results.reserve(count);
+    for (auto& promise : promises)
+        sources.push_back(promise.get_completion());
+    
+    std::thread producer([&]
+        {
+            for (std::size_t idx = 0; idx < count; ++idx)
+                promises[idx].set_value(int(idx));
+        });
+    for (auto& source : sources)
+        results.push_back(source.map([] (int x) { return x + 1; }).map([] (int x) { return x * 2; }));
+    producer.join();
+    
+    for (std::size_t idx = 0; idx < count; ++idx)
+        ensure_eq((int(idx) + 1) * 2, results[idx].get());
+}
+
+TEST(completion_race_set_value_disable)
+{
+    const std::size_t count = 100000;
+    std::vector<completion_promise<int>> promises(count);
+    std::vector<completion<int>>         sources;
+    std::atomic<std::size_t>             calls(0);
+    sources.reserve(count);
+    for (auto& promise : promises)
+        sources.push_back(promise.get_completion());
+    
+    std::thread producer([&]
+        {
+            for (std::size_t idx = 0; idx < count; ++idx)
+                promises[idx].set_value(int(idx));
+        });
+    for (auto& source : sources)
+    {
+        source.on_complete([&calls] (exceptional<int>) { ++calls; });
+        source.disable();
+    }
+    producer.join();
+    
+    for (auto& source : sources)
+        ensure(source.state() == completion_state::disabled);
+    ensure_le(calls.load(), count);
+}
+
+TEST(completion_long_chain)
+{
+    // Deep enough that calling each continuation from inside the last one would overflow the stack.
+    const std::size_t stages = 1000000;
+    completion_promise<std::size_t> promise;
+    completion<std::size_t> fval = promise.get_completion();
+    for (std::size_t idx = 0; idx < stages; ++idx)
+        fval = fval.map([] (std::size_t x) { return x + 1; });
+    
+    promise.set_value(0);
+    ensure(fval.state() == completion_state::has_value);
+    ensure_eq(stages, fval.get());
+}
+
+TEST(completion_long_chain_failure)
+{
+    const std::size_t stages = 1000000;
+    completion_promise<int> promise;
+    completion<int> fval = promise.get_completion();
+    for (std::size_t idx = 0; idx < stages; ++idx)
+        fval = fval.then([] (exceptional<int> x) { return x.get() + 1; });
+    
+    promise.set_exception(std::make_exception_ptr(std::runtime_error("failure")));
+    ensure_throws(std::runtime_error, fval.get());
+}
+
+TEST(completion_callback_throws_rest_still_run)
+{
+    completion_promise<int> promise;
+    completion<int> source = promise.get_completion();
+    std::vector<completion_promise<int>> downstream(2);
+    std::vector<int> seen;
+    
+    // The first two callbacks are queued behind the one which throws, so they only run if the queue keeps going.
+    downstream[0].get_completion().on_complete([&seen] (exceptional<int> x) { seen.push_back(x.get()); });
+    downstream[1].get_completion().on_complete([&seen] (exceptional<int> x) { seen.push_back(x.get()); });
+    source.on_complete([&downstream] (exceptional<int> x)
+                       {
+                           downstream[0].set_value(x.get() + 1);
+                           downstream[1].set_value(x.get() + 2);
+                           throw std::runtime_error("callback failed");
+                       }
+                      );
+    ensure_throws(std::runtime_error, promise.set_value(1));
+    ensure(seen == (std::vector<int> { 2, 3 }));
+}
+
+TEST(completion_block_inside_callback)
+{
+    completion_promise<int> promise;
+    completion_promise<int> inner;
+    std::future_status status = std::future_status::deferred;
+    int result = 0;
+    
+    // The delivery to the map is queued behind the callback which is waiting for it, so it has to be run from the wait.
+    auto twice = [] (int y) { return y * 2; };
+    promise.get_completion().on_complete([&] (exceptional<int> x)
+                                         {
+                                             completion<int> mapped = inner.get_completion().map(twice);
+                                             inner.set_value(x.get());
+                                             status = mapped.wait_for(std::chrono::milliseconds(500));
+                                             result = mapped.get();
+                                         }
+                                        );
+    promise.set_value(21);
+    ensure(status == std::future_status::ready);
+    ensure_eq(42, result);
+}
+
+TEST(completion_callback_runs_unlocked)
+{
+    completion_promise<int> promise;
+    completion<int> source = promise.get_completion();
+    std::atomic<bool> entered(false);
+    std::atomic<bool> release(false);
+    source.on_complete([&] (exceptional<int>)
+                       {
+                           entered = true;
+                           while (!release)
+                               std::this_thread::yield();
+                       }
+                      );
+    
+    std::thread producer([&] { promise.set_value(1); });
+    while (!entered)
+        std::this_thread::yield();
+    
+    // The callback is still running on the producer, but the state has already moved on and disable does not wait.
+    ensure(source.state() == completion_state::complete);
+    source.disable();
+    ensure(source.state() == completion_state::disabled);
+    release = true;
+    producer.join();
+}
+
+TEST(completion_ready_callback_sees_complete)
+{
+    completion_promise<int> promise;
+    promise.set_value(1);
+    completion<int> source = promise.get_completion();
+    completion_state seen = completion_state::no_value;
+    source.on_complete([&] (exceptional<int>) { seen = source.state(); });
+    ensure(seen == completion_state::complete);
+}
+
+TEST(completion_wait_for_timeout)
+{
+    completion_promise<int> promise;
+    completion<int> c = promise.get_completion();
+    ensure(c.wait_for(std::chrono::milliseconds(5)) == std::future_status::timeout);
+    promise.set_value(4);
+    ensure(c.wait_for(std::chrono::milliseconds(5)) == std::future_status::ready);
+    ensure(c.state() == completion_state::has_value);
+    ensure_eq(4, c.get());
+}
+
+TEST(completion_wait_until_delivered)
+{
+    completion_promise<int> promise;
+    completion<int> c = promise.get_completion();
+    std::thread producer([&]
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            promise.set_value(9);
+        });
+    auto status = c.wait_until(std::chrono::steady_clock::now() + std::chrono::seconds(10));
+    producer.join();
+    ensure(status == std::future_status::ready);
+    ensure(c.state() == completion_state::has_value);
+    ensure_eq(9, c.get());
+}
+
+TEST(completion_wait_with_callback_throws)
+{
+    completion_promise<int> promise;
+    completion<int> c = promise.get_completion();
+    c.on_complete([] (exceptional<int>) { });
+    ensure(c.state() == completion_state::has_callback);
+    ensure_throws(std::logic_error, c.wait());
+    ensure_throws(std::logic_error, c.wait_for(std::chrono::milliseconds(1)));
+    ensure_throws(std::logic_error, c.get());
+    promise.set_value(1);
+}
+
+TEST(completion_get_failure)
+{
+    completion_promise<int> promise;
+    completion<int> c = promise.get_completion();
+    promise.set_exception(std::make_exception_ptr(std::runtime_error("bad")));
+    ensure_throws(std::runtime_error, c.get());
+    ensure(c.state() == completion_state::complete);
+}
+
+TEST(completion_get_disabled_throws)
+{
+    completion_promise<int> promise;
+    completion<int> c = promise.get_completion();
+    c.disable();
+    ensure_throws(std::logic_error, c.get());
+}
+
+TEST(completion_failure_passes_through_map)
+{
+    completion_promise<int> promise;
+    completion<int> c = promise.get_completion();
+    std::size_t calls = 0;
+    for (std::size_t idx = 0; idx < 5; ++idx)
+        c = c.map([&calls] (int x) { ++calls; return x; });
+    
+    std::exception_ptr error = std::make_exception_ptr(std::runtime_error("bad"));
+    completion<int> recovered = c.recover([error] (std::exception_ptr ex) { return ex == error ? 1 : 0; });
+    promise.set_exception(error);
+    ensure_eq(1, recovered.get());
+    ensure_eq(0U, calls);
+}
+
+TEST(completion_pipe)
+{
+    completion_promise<int> promise;
+    completion<std::size_t> c = promise.get_completion()
+                                       .pipe(map([] (int x) { return x * 2; }),
+                                             map([] (int x) { return std::to_string(x); }),
+                                             map([] (std::string s) { return s.size(); })
+                                            );
+    ensure(c.state() == completion_state::no_value);
+    promise.set_value(512);
+    ensure_eq(4U, c.get());
+}
+
+TEST(completion_pipe_ready)
+{
+    completion_promise<int> promise;
+    promise.set_value(3);
+    completion<int> c = promise.get_completion().pipe(map([] (int x) { return x + 1; }));
+    ensure(c.state() == completion_state::has_value);
+    ensure_eq(4, c.get());
+}
+
+TEST(completion_pipe_failure_skips_to_recover)
+{
+    completion_promise<int> promise;
+    std::size_t calls = 0;
+    completion<int> c = promise.get_completion()
+                               .pipe(map([&calls] (int) -> int { ++calls; throw std::runtime_error("bad"); }),
+                                     map([&calls] (int x) { ++calls; return x; }),
+                                     recover([] (std::exception_ptr) { return -1; }),
+                                     then([] (exceptional<int> x) { return x.get() * 10; })
+                                    );
+    promise.set_value(1);
+    ensure_eq(-10, c.get());
+    ensure_eq(1U, calls);
+}
+
+TEST(completion_pipe_disable)
+{
+    completion_promise<int> promise;
+    std::size_t calls = 0;
+    completion<int> c = promise.get_completion()
+                               .pipe(map([&calls] (int x) { ++calls; return x; }),
+                                     map([&calls] (int x) { ++calls; return x; })
+                                    );
+    c.disable();
+    ensure(promise.is_cancelled());
+    promise.set_value(1);
+    ensure_eq(0U, calls);
+}
+
+TEST(completion_map_move_only)
+{
+    struct add_owned
+    {
+        std::unique_ptr<int> amount;
+        
+        int operator()(int x) const
+        {
+            return x + *amount;
+        }
+    };
+    
+    completion_promise<int> promise;
+    completion<int> c = promise.get_completion().map(add_owned { std::unique_ptr<int>(new int(2)) });
+    promise.set_value(1);
+    ensure_eq(3, c.get());
+}
+
+TEST(completion_no_default_constructor)
+{
+    struct no_default
+    {
+        explicit no_default(int value) :
+                value(value)
+        { }
+        
+        int value;
+    };
+    
+    completion_promise<no_default> promise;
+    completion<int> mapped = promise.get_completion().map([] (no_default x) { return x.value * 2; });
+    promise.set_value(no_default(4));
+    ensure_eq(8, mapped.get());
+}
+
+TEST(completion_typed_error)
+{
+    completion_promise<int> promise;
+    completion<int> c = promise.get_completion();
+    ensure(promise.complete(exceptional<int, std::error_code>::failure(std::make_error_code(std::errc::io_error))));
+    ensure_throws(std::system_error, c.get());
+}
+
+TEST(completion_try_complete_disabled_gives_value_back)
+{
+    completion_promise<std::unique_ptr<int>> promise;
+    auto c = promise.get_completion();
+    c.disable();
+
+    auto value = exceptional<std::unique_ptr<int>>::success(std::unique_ptr<int>(new int(5)));
+    ensure(!promise.try_complete(value));
+    ensure(value.is_success());
+    ensure_eq(5, *value.get());
+
+    completion_promise<int> live;
+    auto delivered = live.get_completion();
+    auto one = exceptional<int>::success(1);
+    ensure(live.try_complete(one));
+    ensure_eq(1, delivered.get());
+}
+
 }
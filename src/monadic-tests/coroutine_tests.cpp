@@ -0,0 +1,115 @@
+/** \file
+ *  
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "test.hpp"
+#include "util.hpp"
+
+#include <monadic/coroutine.hpp>
+
+// These are only built with a C++20 compiler (make CXX_STANDARD="--std=c++20").
+#if MONADIC_HAS_COROUTINES
+
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace monadic_tests
+{
+
+using namespace monadic;
+
+static completion<int> add_one(completion<int> source)
+{
+    int x = co_await std::move(source);
+    co_return x + 1;
+}
+
+static completion<std::string> describe(completion<int> a, completion<int> b)
+{
+    int x = co_await add_one(std::move(a));
+    int y = co_await std::move(b);
+    co_return std::to_string(x) + "," + std::to_string(y);
+}
+
+static completion<void> store(completion<int> source, int& out)
+{
+    out = co_await std::move(source);
+}
+
+TEST(coroutine_await_ready)
+{
+    completion_promise<int> promise;
+    promise.set_value(1);
+    completion<int> c = add_one(promise.get_completion());
+    ensure(c.state() == completion_state::has_value);
+    ensure_eq(2, c.get());
+}
+
+TEST(coroutine_await_later)
+{
+    completion_promise<int> p1;
+    completion_promise<int> p2;
+    completion<std::string> c = describe(p1.get_completion(), p2.get_completion());
+    ensure(c.state() == completion_state::no_value);
+    p1.set_value(1);
+    ensure(c.state() == completion_state::no_value);
+    p2.set_value(5);
+    ensure_eq(std::string("2,5"), c.get());
+}
+
+TEST(coroutine_void)
+{
+    completion_promise<int> promise;
+    int out = 0;
+    completion<void> c = store(promise.get_completion(), out);
+    promise.set_value(4);
+    c.get();
+    ensure_eq(4, out);
+}
+
+TEST(coroutine_failure_propagates)
+{
+    completion_promise<int> promise;
+    completion<int> c = add_one(promise.get_completion());
+    promise.set_exception(std::make_exception_ptr(std::runtime_error("x")));
+    ensure_throws(std::runtime_error, c.get());
+}
+
+TEST(coroutine_result_dropped_early)
+{
+    completion_promise<int> promise;
+    add_one(promise.get_completion());
+    // The coroutine frame outlives the dropped completion until it finishes.
+    promise.set_value(1);
+}
+
+TEST(coroutine_continue_with_map)
+{
+    completion_promise<int> promise;
+    completion<int> c = add_one(promise.get_completion()).map([] (int x) { return x * 10; });
+    promise.set_value(1);
+    ensure_eq(20, c.get());
+}
+
+TEST(coroutine_resume_on_other_thread)
+{
+    for (int iter = 0; iter < 1000; ++iter)
+    {
+        completion_promise<int> promise;
+        completion<int> c = add_one(promise.get_completion());
+        std::thread t([&promise, iter] { promise.set_value(iter); });
+        ensure_eq(iter + 1, c.get());
+        t.join();
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,120 @@
+/** \file
+ *
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "test.hpp"
+#include "util.hpp"
+
+#include <monadic/deferred.hpp>
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace monadic_tests
+{
+
+using namespace monadic;
+
+TEST(deferred_is_lazy)
+{
+    std::size_t calls = 0;
+    auto d = defer([&calls] { ++calls; return 2; })
+             .map([&calls] (int x) { ++calls; return x * 3; });
+    ensure_eq(0U, calls);
+
+    ensure_eq(6, std::move(d).get());
+    ensure_eq(2U, calls);
+}
+
+TEST(deferred_changes_type)
+{
+    auto d = defer([] { return 512; })
+             .map([] (int x) { return std::to_string(x); })
+             .map([] (std::string s) { return s.size(); });
+    static_assert(std::is_same<std::size_t, decltype(d)::value_type>::value, "map should change the value_type");
+    ensure_eq(3U, std::move(d).get());
+}
+
+TEST(deferred_failure_and_recover)
+{
+    std::size_t calls = 0;
+    auto failed = defer([] () -> int { throw std::runtime_error("bad"); })
+                  .map([&calls] (int x) { ++calls; return x; });
+    exceptional<int> result = std::move(failed).run();
+    ensure(result.is_failure());
+    ensure_eq(0U, calls);
+
+    auto recovered = defer([] () -> int { throw std::runtime_error("bad"); })
+                     .recover([] (std::exception_ptr) { return -1; })
+                     .then([] (exceptional<int> x) { return x.get() * 2; });
+    ensure_eq(-2, std::move(recovered).get());
+    ensure_throws(std::runtime_error, defer([] () -> int { throw std::runtime_error("bad"); }).get());
+}
+
+TEST(deferred_void)
+{
+    bool called = false;
+    defer([&called] { called = true; }).get();
+    ensure(called);
+
+    int mapped = defer([] { }).map([] { return 1; }).get();
+    ensure_eq(1, mapped);
+}
+
+TEST(deferred_to_completion)
+{
+    completion<int> c = defer([] { return 1; }).map([] (int x) { return x + 1; });
+    ensure(c.state() == completion_state::has_value);
+    completion<int> next = c.map([] (int x) { return x * 10; });
+    ensure_eq(20, next.get());
+}
+
+TEST(deferred_start_on)
+{
+    manual_executor exec;
+    std::size_t calls = 0;
+    completion<int> c = defer([&calls] { ++calls; return 4; }).start_on(exec);
+    ensure_eq(0U, calls);
+    ensure(c.state() == completion_state::no_value);
+
+    exec.run_all();
+    ensure_eq(1U, calls);
+    ensure_eq(4, c.get());
+}
+
+TEST(deferred_start_on_disabled_skips_work)
+{
+    manual_executor exec;
+    std::size_t calls = 0;
+    completion<int> c = defer([&calls] { ++calls; return 4; }).start_on(exec);
+    c.disable();
+    exec.run_all();
+    ensure_eq(0U, calls);
+}
+
+TEST(deferred_move_only)
+{
+    std::unique_ptr<int> owned(new int(5));
+    struct take
+    {
+        std::unique_ptr<int> value;
+
+        std::unique_ptr<int> operator()()
+        {
+            return std::move(value);
+        }
+    };
+
+    auto d = defer(take { std::move(owned) })
+             .map([] (std::unique_ptr<int> p) { return *p + 1; });
+    ensure_eq(6, std::move(d).get());
+}
+
+}
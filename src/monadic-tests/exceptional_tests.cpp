@@ -12,7 +12,13 @@
 
 #include <monadic/exceptional.hpp>
 
+#include <array>
 #include <cassert>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <system_error>
+#include <type_traits>
 
 namespace monadic_tests
 {
@@ -75,4 +81,208 @@ TEST(exceptional_failure_throws_xvalue)
     ensure_throws(int, monadic::try_to([] () -> int { throw 10; }).get());
 }
 
+namespace
+{
+
+/** Has no default constructor and counts how many instances are alive. **/
+struct counted
+{
+    static int alive;
+    
+    int value;
+    
+    explicit counted(int value) :
+            value(value)
+    {
+        ++alive;
+    }
+    
+    counted(const counted& src) :
+            value(src.value)
+    {
+        ++alive;
+    }
+    
+    counted& operator=(const counted&) = default;
+    
+    ~counted()
+    {
+        --alive;
+    }
+};
+
+int counted::alive = 0;
+
+}
+
+TEST(exceptional_failure_constructs_no_value)
+{
+    counted::alive = 0;
+    {
+        auto failed = monadic::exceptional<counted>::failure(std::make_exception_ptr(1));
+        ensure_eq(0, counted::alive);
+        auto copied = failed;
+        ensure_eq(0, counted::alive);
+        ensure_throws(int, copied.get());
+        
+        auto succeeded = monadic::exceptional<counted>::success(5);
+        ensure_eq(1, counted::alive);
+        copied = succeeded;
+        ensure_eq(2, counted::alive);
+        ensure_eq(5, copied.get().value);
+        copied = failed;
+        ensure_eq(1, counted::alive);
+        ensure(copied.is_failure());
+    }
+    ensure_eq(0, counted::alive);
+}
+
+TEST(exceptional_empty)
+{
+    monadic::exceptional<counted> empty;
+    ensure(!empty.is_success());
+    ensure(!empty.is_failure());
+    ensure_throws(std::logic_error, empty.get());
+    auto mapped = empty.map([] (const counted& x) { return x.value; });
+    ensure(!mapped.is_success());
+    ensure(!mapped.is_failure());
+    
+    empty = monadic::exceptional<counted>::success(2);
+    ensure_eq(2, empty.get().value);
+}
+
+TEST(exceptional_shares_storage)
+{
+    static_assert(sizeof(monadic::exceptional<double>) <= sizeof(std::exception_ptr) + sizeof(double),
+                  "exceptional should be no bigger than an exception_ptr next to the value"
+                 );
+    static_assert(sizeof(monadic::exceptional<std::array<double, 4>>)
+                  <= sizeof(std::exception_ptr) + sizeof(std::array<double, 4>),
+                  "exceptional should be no bigger than an exception_ptr next to the value"
+                 );
+}
+
+TEST(exceptional_flatmap_failure)
+{
+    auto failed = monadic::exceptional<int>::failure(std::make_exception_ptr(3));
+    auto r = failed.flatmap([] (int x) { return monadic::exceptional<long>::success(x); });
+    ensure(r.is_failure());
+    ensure_throws(int, r.get());
+}
+
+namespace
+{
+
+enum class lookup_error
+{
+    missing,
+    expired,
+};
+
+}
+
+TEST(exceptional_error_code)
+{
+    using result = monadic::exceptional<int, std::error_code>;
+    
+    auto ok = result::success(4);
+    ensure_eq(8, ok.map([] (int x) { return x * 2; }).get());
+    
+    auto failed = result::failure(std::make_error_code(std::errc::resource_unavailable_try_again));
+    ensure(failed.is_failure());
+    ensure(failed.error() == std::errc::resource_unavailable_try_again);
+    std::size_t calls = 0;
+    auto mapped = failed.map([&calls] (int x) { ++calls; return x; });
+    ensure_eq(0U, calls);
+    ensure(mapped.error() == std::errc::resource_unavailable_try_again);
+    ensure_throws(std::system_error, failed.get());
+    
+    auto recovered = failed.recover([] (const std::error_code& code) { return code.value() == 0 ? 0 : -1; });
+    ensure_eq(-1, recovered.get());
+}
+
+TEST(exceptional_typed_try_to)
+{
+    auto caught = monadic::try_to<std::error_code>([] () -> int
+                                                   {
+                                                       auto code = std::make_error_code(std::errc::io_error);
+                                                       throw std::system_error(code);
+                                                   }
+                                                  );
+    ensure(caught.is_failure());
+    ensure(caught.error() == std::errc::io_error);
+    
+    // Only the error type is captured -- anything else passes straight through.
+    ensure_throws(std::runtime_error,
+                  monadic::try_to<std::error_code>([] () -> int { throw std::runtime_error("not an error code"); })
+                 );
+    
+    auto unit = monadic::try_to<std::error_code>([] { });
+    ensure(unit.is_success());
+}
+
+TEST(exceptional_enum_error)
+{
+    using result = monadic::exceptional<int, lookup_error>;
+    static_assert(sizeof(result) <= 2 * sizeof(int), "an enum error should be stored inline");
+    
+    auto failed = result::success(1)
+                  .map([] (int x) -> int { if (x > 0) throw lookup_error::expired; return x; })
+                  .flatmap([] (int x) { return result::success(x + 1); });
+    ensure(failed.is_failure());
+    ensure(failed.error() == lookup_error::expired);
+    ensure_throws(lookup_error, failed.get());
+    
+    auto retried = failed.recover([] (lookup_error e) { return e == lookup_error::expired ? 10 : 20; });
+    ensure_eq(10, retried.get());
+    
+    auto missing = result::failure(lookup_error::missing)
+                   .flatmap([] (int x) { return result::success(x); });
+    ensure(missing.error() == lookup_error::missing);
+}
+
+TEST(exceptional_typed_to_exception_ptr)
+{
+    monadic::exceptional<int> converted = monadic::exceptional<int, std::error_code>::failure(
+            std::make_error_code(std::errc::timed_out)
+        );
+    ensure(converted.is_failure());
+    try
+    {
+        converted.get();
+        ensure(false);
+    }
+    catch (const std::system_error& ex)
+    {
+        ensure(ex.code() == std::errc::timed_out);
+    }
+    
+    monadic::exceptional<long> widened = monadic::exceptional<int, lookup_error>::success(3);
+    ensure_eq(3L, widened.get());
+    
+    monadic::exceptional<void> unit = monadic::exceptional<void, lookup_error>::failure(lookup_error::missing);
+    ensure_throws(lookup_error, unit.get());
+}
+
+TEST(exceptional_trivially_copyable)
+{
+    using result = monadic::exceptional<int, lookup_error>;
+    static_assert(std::is_trivially_copyable<result>::value, "exceptional of trivial types must be trivially copyable");
+    static_assert(std::is_trivially_copyable<monadic::exceptional<double, std::error_code>>::value,
+                  "exceptional of trivial types must be trivially copyable"
+                 );
+    static_assert(std::is_trivially_copyable<monadic::exceptional<void, lookup_error>>::value,
+                  "exceptional of trivial types must be trivially copyable"
+                 );
+    static_assert(!std::is_trivially_copyable<monadic::exceptional<int>>::value,
+                  "std::exception_ptr is not trivially copyable"
+                 );
+    
+    result values[2] = { result::success(4), result::failure(lookup_error::missing) };
+    result copies[2];
+    std::memcpy(copies, values, sizeof values);
+    ensure_eq(4, copies[0].get());
+    ensure(copies[1].error() == lookup_error::missing);
+}
+
 }
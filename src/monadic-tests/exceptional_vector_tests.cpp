@@ -0,0 +1,192 @@
+/** \file
+ *  
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "test.hpp"
+#include "util.hpp"
+
+#include <monadic/exceptional_vector.hpp>
+
+#include <cstddef>
+#include <exception>
+#include <stdexcept>
+#include <system_error>
+
+namespace monadic_tests
+{
+
+/** 150 elements (so the last bitmap word is partial), where every multiple of 7 is a failure. **/
+static monadic::exceptional_vector<double> make_batch()
+{
+    monadic::exceptional_vector<double> out;
+    for (std::size_t idx = 0; idx < 150; ++idx)
+    {
+        if (idx % 7 == 0)
+            out.push_failure(std::make_exception_ptr(std::runtime_error("bad row")));
+        else
+            out.push_back(double(idx));
+    }
+    return out;
+}
+
+TEST(exceptional_vector_push_access)
+{
+    auto batch = make_batch();
+    ensure_eq(150U, batch.size());
+    ensure_eq(22U, batch.failure_count());
+    ensure_eq(128U, batch.success_count());
+    
+    ensure(!batch.is_success(0));
+    ensure(batch.is_success(1));
+    ensure_eq(1.0, batch.get(1));
+    ensure_eq(1.0, batch[1].get());
+    ensure_eq(0.0, batch.values()[7]);
+    ensure_throws(std::runtime_error, batch.get(7));
+    ensure_throws(std::runtime_error, batch[147].get());
+    ensure_throws(std::logic_error, batch.error(1));
+    
+    batch.push_back(monadic::exceptional<double>::success(2.5));
+    batch.push_back(monadic::try_to([] () -> double { throw std::out_of_range("past the end"); }));
+    ensure_eq(2.5, batch.get(150));
+    ensure_throws(std::out_of_range, batch.get(151));
+    ensure_throws(std::invalid_argument, batch.push_back(monadic::exceptional<double>()));
+}
+
+TEST(exceptional_vector_map)
+{
+    auto batch  = make_batch();
+    std::size_t calls = 0;
+    auto halved = batch.map([&calls] (double x) { ++calls; return int(x) / 2; });
+    ensure_eq(batch.success_count(), calls); // failed lanes are never visited
+    ensure_eq(batch.size(), halved.size());
+    ensure_eq(batch.failure_count(), halved.failure_count());
+    for (std::size_t idx = 0; idx < halved.size(); ++idx)
+    {
+        if (idx % 7 == 0)
+            ensure_throws(std::runtime_error, halved.get(idx));
+        else
+            ensure_eq(int(idx) / 2, halved.get(idx));
+    }
+    
+    // A dense batch takes the whole-word path.
+    monadic::exceptional_vector<double> dense(130, 1.5);
+    auto doubled = dense.map([] (double x) { return x * 2; });
+    ensure_eq(130U, doubled.success_count());
+    ensure_eq(3.0, doubled.get(129));
+}
+
+TEST(exceptional_vector_map_throws)
+{
+    auto batch = make_batch();
+    auto out   = batch.map([] (double x) -> double
+                           {
+                               if (int(x) % 10 == 5)
+                                   throw std::domain_error("ends in 5");
+                               return x;
+                           }
+                          );
+    for (std::size_t idx = 0; idx < out.size(); ++idx)
+    {
+        if (idx % 7 == 0)
+            ensure_throws(std::runtime_error, out.get(idx));
+        else if (idx % 10 == 5)
+            ensure_throws(std::domain_error, out.get(idx));
+        else
+            ensure_eq(double(idx), out.get(idx));
+    }
+    
+    // Lanes which fail in an otherwise successful block keep the rest of the block.
+    monadic::exceptional_vector<int> dense(64, 1);
+    auto partial = dense.map([] (int) -> int { static int count = 0; if (++count == 10) throw 10; return 2; });
+    ensure_eq(1U, partial.failure_count());
+    ensure_throws(int, partial.get(9));
+    ensure_eq(2, partial.get(8));
+    ensure_eq(2, partial.get(10));
+}
+
+TEST(exceptional_vector_recover)
+{
+    auto batch   = make_batch();
+    auto patched = batch.recover([] (const std::exception_ptr&) { return -1.0; });
+    ensure_eq(0U, patched.failure_count());
+    ensure_eq(-1.0, patched.get(0));
+    ensure_eq(-1.0, patched.get(147));
+    ensure_eq(8.0, patched.get(8));
+    ensure_eq(22U, batch.failure_count());
+    
+    std::size_t seen = 0;
+    auto some = std::move(batch).recover([&seen] (const std::exception_ptr& ex) -> double
+                                         {
+                                             if (seen++ % 2 == 0)
+                                                 std::rethrow_exception(ex);
+                                             return 0.5;
+                                         }
+                                        );
+    ensure_eq(11U, some.failure_count());
+    ensure_throws(std::runtime_error, some.get(0));
+    ensure_eq(0.5, some.get(7));
+}
+
+TEST(exceptional_vector_typed_error)
+{
+    using batch_type = monadic::exceptional_vector<int, std::error_code>;
+    batch_type batch;
+    batch.push_back(1);
+    batch.push_failure(std::make_error_code(std::errc::timed_out));
+    batch.push_back(3);
+    
+    auto out = batch.map([] (int x) -> int
+                         {
+                             if (x == 3)
+                                 throw std::system_error(std::make_error_code(std::errc::io_error));
+                             return x * 10;
+                         }
+                        );
+    ensure_eq(10, out.get(0));
+    ensure(out.error(1) == std::errc::timed_out);
+    ensure(out.error(2) == std::errc::io_error);
+    
+    // Only the error type is captured -- anything else passes straight through.
+    ensure_throws(std::runtime_error,
+                  batch.map([] (int) -> int { throw std::runtime_error("not an error code"); })
+                 );
+    
+    auto patched = out.recover([] (const std::error_code& ec) { return ec == std::errc::io_error ? 30 : 20; });
+    ensure_eq(20, patched.get(1));
+    ensure_eq(30, patched.get(2));
+}
+
+TEST(exceptional_vector_recover_throws_other)
+{
+    using batch_type = monadic::exceptional_vector<int, std::error_code>;
+    batch_type batch;
+    batch.push_failure(std::make_error_code(std::errc::timed_out));
+    batch.push_back(2);
+    batch.push_failure(std::make_error_code(std::errc::io_error));
+    
+    // Not an std::error_code, so it is not caught; the first failure was already recovered when it was thrown.
+    std::size_t seen = 0;
+    ensure_throws(std::logic_error,
+                  std::move(batch).recover([&seen] (const std::error_code&) -> int
+                                           {
+                                               if (seen++ > 0)
+                                                   throw std::logic_error("not an error_code");
+                                               return 1;
+                                           }
+                                          )
+                 );
+    ensure_eq(2U, batch.failure_count());
+    ensure(!batch.is_success(0));
+    ensure(batch.error(0) == std::errc::timed_out);
+    ensure_eq(0, batch.values()[0]);
+    ensure_eq(2, batch.get(1));
+    ensure(!batch.is_success(2));
+}
+
+}
@@ -0,0 +1,94 @@
+/** \file
+ *  
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "test.hpp"
+#include "util.hpp"
+
+#include <monadic/completion.hpp>
+#include <monadic/executor.hpp>
+
+#include <stdexcept>
+
+namespace monadic_tests
+{
+
+using namespace monadic;
+
+TEST(executor_inline_runs_immediately)
+{
+    inline_executor exec;
+    completion_promise<int> promise;
+    completion<int> c = promise.get_completion().map_on(exec, [] (int x) { return x + 1; });
+    promise.set_value(1);
+    ensure(c.state() == completion_state::has_value);
+    ensure_eq(2, c.get());
+}
+
+TEST(executor_then_on_deferred)
+{
+    manual_executor exec;
+    completion_promise<int> promise;
+    completion<int> c = promise.get_completion()
+                               .then_on(exec, [] (exceptional<int> x) { return x.get() * 2; });
+    promise.set_value(4);
+    ensure(c.state() == completion_state::no_value);
+    ensure_eq(1U, exec.pending());
+    ensure_eq(1U, exec.run_all());
+    ensure_eq(8, c.get());
+}
+
+TEST(executor_map_on_ready_value_still_deferred)
+{
+    manual_executor exec;
+    completion_promise<int> promise;
+    promise.set_value(4);
+    completion<int> c = promise.get_completion().map_on(exec, [] (int x) { return x + 1; });
+    ensure(c.state() == completion_state::no_value);
+    exec.run_all();
+    ensure_eq(5, c.get());
+}
+
+TEST(executor_via_then_map)
+{
+    manual_executor exec;
+    completion_promise<int> promise;
+    completion<int> c = promise.get_completion()
+                               .via(exec)
+                               .map([] (int x) { return x + 1; });
+    promise.set_value(1);
+    ensure(c.state() == completion_state::no_value);
+    ensure_eq(1U, exec.run_all());
+    ensure_eq(2, c.get());
+}
+
+TEST(executor_recover_on)
+{
+    manual_executor exec;
+    completion_promise<int> promise;
+    completion<int> c = promise.get_completion()
+                               .recover_on(exec, [] (std::exception_ptr) { return -1; });
+    promise.set_exception(std::make_exception_ptr(std::runtime_error("bad")));
+    exec.run_all();
+    ensure_eq(-1, c.get());
+}
+
+TEST(executor_ref_forwards)
+{
+    manual_executor target;
+    executor_ref    exec(target);
+    completion_promise<int> promise;
+    completion<int> c = promise.get_completion().map_on(exec, [] (int x) { return x * 3; });
+    promise.set_value(3);
+    ensure_eq(1U, target.pending());
+    target.run_all();
+    ensure_eq(9, c.get());
+}
+
+}
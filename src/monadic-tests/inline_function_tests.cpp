@@ -0,0 +1,105 @@
+/** \file
+ *  
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "test.hpp"
+
+#include <monadic/completion.hpp>
+#include <monadic/inline_function.hpp>
+
+#include <array>
+#include <functional>
+#include <memory>
+
+namespace monadic_tests
+{
+
+using namespace monadic;
+
+namespace
+{
+
+struct counted
+{
+    static int live;
+    
+    counted()                { ++live; }
+    counted(const counted&)  { ++live; }
+    counted(counted&&) noexcept { ++live; }
+    ~counted()               { --live; }
+    
+    int operator()(int x) const { return x + 1; }
+};
+
+int counted::live = 0;
+
+}
+
+TEST(inline_function_empty)
+{
+    inline_function<int (int)> f;
+    ensure(!f);
+    ensure_throws(std::bad_function_call, f(1));
+    f = [] (int x) { return x * 2; };
+    ensure(!!f);
+    ensure_eq(4, f(2));
+    f = nullptr;
+    ensure(!f);
+}
+
+TEST(inline_function_move_only)
+{
+    std::unique_ptr<int> p(new int(5));
+    struct move_only
+    {
+        std::unique_ptr<int> p;
+        int operator()(int x) { return *p + x; }
+    };
+    inline_function<int (int)> f = move_only { std::move(p) };
+    inline_function<int (int)> g = std::move(f);
+    ensure(!f);
+    ensure_eq(7, g(2));
+}
+
+TEST(inline_function_small_is_inline)
+{
+    using func_type = inline_function<int (int), 32>;
+    using too_big   = std::array<char, 33>;
+    ensure(func_type::stores_inline<counted>::value);
+    ensure(!func_type::stores_inline<too_big>::value);
+    
+    {
+        func_type f = counted();
+        ensure_eq(1, counted::live);
+        func_type g = std::move(f);
+        ensure_eq(1, counted::live);
+        ensure_eq(3, g(2));
+    }
+    ensure_eq(0, counted::live);
+}
+
+TEST(inline_function_large_on_heap)
+{
+    std::array<int, 64> big;
+    big.fill(2);
+    inline_function<int (int), 16> f = [big] (int x) { return big[0] + big[63] + x; };
+    inline_function<int (int), 16> g;
+    g = std::move(f);
+    ensure_eq(5, g(1));
+}
+
+TEST(completion_then_callback_is_inline)
+{
+    auto stateless = [] (exceptional<int>) { return 1; };
+    using step_type     = detail::completion_try_step<decltype(stateless)>;
+    using callback_type = detail::completion_continuation<int, int, step_type>;
+    ensure(completion_data<int>::callback_type::stores_inline<callback_type>::value);
+}
+
+}
@@ -0,0 +1,123 @@
+/** \file
+ *  
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "test.hpp"
+
+#include <monadic/mcs_mutex.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace monadic_tests
+{
+
+using namespace monadic;
+
+TEST(mcs_mutex_try_lock)
+{
+    mcs_mutex mtx;
+    ensure(mtx.try_lock());
+    ensure(!mtx.try_lock());
+    mtx.unlock();
+    ensure(mtx.try_lock());
+    mtx.unlock();
+
+    std::unique_lock<mcs_mutex> lock(mtx);
+    ensure(lock.owns_lock());
+}
+
+TEST(mcs_mutex_is_fifo)
+{
+    static const std::size_t thread_count = 4;
+
+    mcs_mutex mtx;
+    std::vector<std::size_t> order;
+    std::vector<std::thread> threads;
+    mtx.lock();
+    for (std::size_t idx = 0; idx < thread_count; ++idx)
+    {
+        threads.emplace_back([&, idx]
+                             {
+                                 std::lock_guard<mcs_mutex> lock(mtx);
+                                 order.push_back(idx);
+                             }
+                            );
+        // Give each thread time to get in line before starting the next one.
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    mtx.unlock();
+    for (auto& thread : threads)
+        thread.join();
+
+    ensure_eq(thread_count, order.size());
+    for (std::size_t idx = 0; idx < thread_count; ++idx)
+        ensure_eq(idx, order[idx]);
+}
+
+TEST(mcs_mutex_contention)
+{
+    static const std::size_t thread_count = 4;
+    static const std::size_t increments   = 20000;
+
+    mcs_mutex mtx;
+    std::size_t counter = 0;
+    std::vector<std::thread> threads;
+    for (std::size_t idx = 0; idx < thread_count; ++idx)
+        threads.emplace_back([&]
+                             {
+                                 for (std::size_t iter = 0; iter < increments; ++iter)
+                                 {
+                                     std::lock_guard<mcs_mutex> lock(mtx);
+                                     ++counter;
+                                 }
+                             }
+                            );
+    for (auto& thread : threads)
+        thread.join();
+    ensure_eq(thread_count * increments, counter);
+    ensure(mtx.try_lock());
+    mtx.unlock();
+}
+
+TEST(mcs_mutex_nested)
+{
+    // Each lock a thread holds at the same time uses its own node.
+    mcs_mutex outer;
+    mcs_mutex inner;
+    for (int iter = 0; iter < 3; ++iter)
+    {
+        std::lock_guard<mcs_mutex> lock_outer(outer);
+        std::lock_guard<mcs_mutex> lock_inner(inner);
+        ensure(!outer.try_lock());
+        ensure(!inner.try_lock());
+    }
+    ensure(outer.try_lock());
+    ensure(inner.try_lock());
+    outer.unlock();
+    inner.unlock();
+}
+
+TEST(mcs_mutex_nodes_are_cache_aligned)
+{
+    auto& cache = detail::mcs_node_cache::local();
+    std::vector<detail::mcs_node*> nodes;
+    for (int idx = 0; idx < 8; ++idx)
+        nodes.push_back(cache.acquire());
+    for (detail::mcs_node* node : nodes)
+        ensure_eq(0U, reinterpret_cast<std::uintptr_t>(node) % 64);
+    for (detail::mcs_node* node : nodes)
+        cache.release(node);
+}
+
+}
@@ -0,0 +1,178 @@
+/** \file
+ *  
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "test.hpp"
+#include "util.hpp"
+
+#include <monadic/parallel.hpp>
+#include <monadic/work_stealing_pool.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace monadic_tests
+{
+
+using namespace monadic;
+
+TEST(parallel_for_visits_each_once)
+{
+    work_stealing_pool pool(4);
+    std::vector<std::atomic<int>> visits(100003);
+    for (auto& x : visits)
+        x.store(0);
+
+    parallel_for(pool, visits.begin(), visits.end(), [] (std::atomic<int>& x) { x.fetch_add(1); }, 1000).get();
+    for (const auto& x : visits)
+        ensure_eq(1, x.load());
+}
+
+TEST(parallel_for_failure_is_lowest)
+{
+    work_stealing_pool pool(3);
+    std::vector<int> values(10000);
+    for (std::size_t idx = 0; idx < values.size(); ++idx)
+        values[idx] = int(idx);
+
+    std::atomic<std::size_t> visited(0);
+    auto done = parallel_for(pool, values.begin(), values.end(),
+                             [&visited] (int x)
+                             {
+                                 ++visited;
+                                 if (x % 2500 == 1234)
+                                     throw std::runtime_error(std::to_string(x));
+                             },
+                             100
+                            );
+    try
+    {
+        done.get();
+        ensure(false);
+    }
+    catch (const std::runtime_error& ex)
+    {
+        ensure_eq(std::string("1234"), ex.what());
+    }
+    ensure_eq(values.size(), visited.load());
+}
+
+TEST(parallel_for_chunks)
+{
+    manual_executor exec;
+    std::vector<int> values(10, 1);
+    auto done = parallel_for(exec, values.begin(), values.end(), [] (int& x) { x *= 2; }, 3);
+    ensure_eq(4U, exec.pending()); // one task per chunk, since manual_executor does not say how many threads it has
+    ensure(done.state() == completion_state::no_value);
+
+    ensure_eq(4U, exec.run_all());
+    done.get();
+    for (int x : values)
+        ensure_eq(2, x);
+}
+
+TEST(parallel_for_empty)
+{
+    manual_executor exec;
+    std::vector<int> values;
+    auto done = parallel_for(exec, values.begin(), values.end(), [] (int) { }, 16);
+    ensure_eq(0U, exec.pending());
+    done.get();
+}
+
+TEST(parallel_map_results_in_order)
+{
+    work_stealing_pool pool(4);
+    std::vector<int> values(5000);
+    for (std::size_t idx = 0; idx < values.size(); ++idx)
+        values[idx] = int(idx);
+
+    auto results = parallel_map(pool, values.begin(), values.end(),
+                                [] (int x) -> long
+                                {
+                                    if (x % 1000 == 999)
+                                        throw std::out_of_range("unlucky");
+                                    return long(x) * x;
+                                }
+                               ).get();
+    ensure_eq(values.size(), results.size());
+    for (std::size_t idx = 0; idx < results.size(); ++idx)
+    {
+        if (idx % 1000 == 999)
+            ensure_throws(std::out_of_range, results[idx].get());
+        else
+            ensure_eq(long(idx) * long(idx), results[idx].get());
+    }
+}
+
+TEST(parallel_map_inline)
+{
+    inline_executor exec;
+    std::vector<std::string> words = { "a", "bb", "ccc" };
+    auto lengths = parallel_map(exec, words.begin(), words.end(), [] (const std::string& s) { return s.size(); });
+    ensure(lengths.state() == completion_state::has_value);
+    auto results = lengths.get();
+    ensure_eq(3U, results.size());
+    ensure_eq(2U, results[1].get());
+}
+
+TEST(parallel_reduce_sum)
+{
+    work_stealing_pool pool(4);
+    std::vector<int> values(100000, 3);
+    auto sum = parallel_reduce(pool, values.begin(), values.end(), 7L, [] (long acc, long x) { return acc + x; }, 999);
+    ensure_eq(300007L, sum.get());
+
+    // Default grain
+    auto again = parallel_reduce(pool, values.begin(), values.end(), 0L, [] (long acc, long x) { return acc + x; });
+    ensure_eq(300000L, again.get());
+}
+
+TEST(parallel_reduce_keeps_order)
+{
+    work_stealing_pool pool(4);
+    std::vector<std::string> letters;
+    std::string expected = ">";
+    for (char c = 'a'; c <= 'z'; ++c)
+    {
+        letters.push_back(std::string(1, c));
+        expected += c;
+    }
+
+    auto joined = parallel_reduce(pool, letters.begin(), letters.end(), std::string(">"),
+                                  [] (std::string acc, const std::string& x) { return acc + x; },
+                                  3
+                                 );
+    ensure_eq(expected, joined.get());
+}
+
+TEST(parallel_reduce_empty_and_failure)
+{
+    work_stealing_pool pool(2);
+    std::vector<int> none;
+    ensure_eq(5, parallel_reduce(pool, none.begin(), none.end(), 5, [] (int a, int b) { return a + b; }).get());
+
+    std::vector<int> values(1000, 1);
+    values[641] = 0;
+    auto failed = parallel_reduce(pool, values.begin(), values.end(), 0,
+                                  [] (int acc, int x) -> int
+                                  {
+                                      if (x == 0)
+                                          throw std::invalid_argument("zero");
+                                      return acc + x;
+                                  },
+                                  64
+                                 );
+    ensure_throws(std::invalid_argument, failed.get());
+}
+
+}
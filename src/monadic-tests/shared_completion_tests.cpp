@@ -0,0 +1,189 @@
+/** \file
+ *
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "test.hpp"
+#include "util.hpp"
+
+#include <monadic/shared_completion.hpp>
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace monadic_tests
+{
+
+using namespace monadic;
+
+namespace
+{
+
+/** Counts how many times it has been copied. **/
+struct copy_counter
+{
+    static std::size_t copies;
+
+    int value;
+
+    copy_counter() :
+            value(0)
+    { }
+
+    explicit copy_counter(int value) :
+            value(value)
+    { }
+
+    copy_counter(const copy_counter& src) :
+            value(src.value)
+    {
+        ++copies;
+    }
+
+    copy_counter(copy_counter&&) = default;
+    copy_counter& operator=(copy_counter&&) = default;
+
+    copy_counter& operator=(const copy_counter& src)
+    {
+        value = src.value;
+        ++copies;
+        return *this;
+    }
+};
+
+std::size_t copy_counter::copies = 0;
+
+}
+
+TEST(shared_completion_many_consumers)
+{
+    completion_promise<copy_counter> promise;
+    shared_completion<copy_counter> shared = promise.get_completion().share();
+    copy_counter::copies = 0;
+
+    std::vector<const copy_counter*> seen;
+    std::vector<int> order;
+    for (int idx = 0; idx < 5; ++idx)
+    {
+        shared.on_complete([&seen, &order, idx] (const exceptional<copy_counter>& x)
+                           {
+                               seen.push_back(&x.get());
+                               order.push_back(idx);
+                           }
+                          );
+    }
+    ensure(!shared.is_ready());
+
+    promise.set_value(copy_counter(7));
+    ensure(shared.is_ready());
+    ensure_eq(5U, seen.size());
+    for (const copy_counter* ptr : seen)
+        ensure_eq(&shared.get(), ptr);
+    ensure(order == (std::vector<int> { 0, 1, 2, 3, 4 }));
+    ensure_eq(0U, copy_counter::copies);
+}
+
+TEST(shared_completion_late_subscriber)
+{
+    completion_promise<int> promise;
+    promise.set_value(3);
+    shared_completion<int> shared(promise.get_completion());
+    ensure(shared.is_ready());
+
+    int seen = 0;
+    shared.on_complete([&seen] (const exceptional<int>& x) { seen = x.get(); });
+    ensure_eq(3, seen);
+    ensure_eq(3, shared.get());
+}
+
+TEST(shared_completion_map_then)
+{
+    completion_promise<std::string> promise;
+    shared_completion<std::string> shared = promise.get_completion().share();
+    completion<std::size_t> size = shared.map([] (const std::string& s) { return s.size(); });
+    completion<bool> ok = shared.then([] (const exceptional<std::string>& x) { return x.is_success(); });
+    completion<std::string> copy = shared.get_completion();
+
+    promise.set_value("hello");
+    ensure_eq(5U, size.get());
+    ensure(ok.get());
+    ensure_eq(std::string("hello"), copy.get());
+    ensure_eq(6U, shared.map([] (const std::string& s) { return s.size() + 1; }).get());
+}
+
+TEST(shared_completion_failure)
+{
+    completion_promise<int> promise;
+    shared_completion<int> shared = promise.get_completion().share();
+    std::size_t calls = 0;
+    completion<int> mapped = shared.map([&calls] (const int& x) { ++calls; return x; });
+
+    promise.set_exception(std::make_exception_ptr(std::runtime_error("bad")));
+    ensure_throws(std::runtime_error, mapped.get());
+    ensure_throws(std::runtime_error, shared.get());
+    ensure_eq(0U, calls);
+}
+
+TEST(shared_completion_void)
+{
+    completion_promise<void> promise;
+    shared_completion<void> shared = promise.get_completion().share();
+    completion<int> mapped = shared.map([] { return 1; });
+    promise.set_value();
+    shared.get();
+    ensure_eq(1, mapped.get());
+}
+
+TEST(shared_completion_copies_share_state)
+{
+    completion_promise<int> promise;
+    shared_completion<int> first = promise.get_completion().share();
+    shared_completion<int> second = first;
+    std::size_t calls = 0;
+    first.on_complete([&calls] (const exceptional<int>&) { ++calls; });
+    second.on_complete([&calls] (const exceptional<int>&) { ++calls; });
+    promise.set_value(1);
+    ensure_eq(2U, calls);
+    ensure_eq(&first.get(), &second.get());
+}
+
+TEST(shared_completion_race_subscribe_deliver)
+{
+    const std::size_t rounds      = 2000;
+    const std::size_t subscribers = 8;
+    for (std::size_t round = 0; round < rounds; ++round)
+    {
+        completion_promise<int> promise;
+        shared_completion<int> shared = promise.get_completion().share();
+        std::atomic<std::size_t> calls(0);
+        std::thread producer([&promise] { promise.set_value(1); });
+        for (std::size_t idx = 0; idx < subscribers; ++idx)
+            shared.on_complete([&calls] (const exceptional<int>& x) { calls.fetch_add(std::size_t(x.get())); });
+        producer.join();
+        ensure_eq(subscribers, calls.load());
+    }
+}
+
+TEST(shared_completion_get_blocks)
+{
+    completion_promise<int> promise;
+    shared_completion<int> shared = promise.get_completion().share();
+    std::atomic<int> total(0);
+    std::vector<std::thread> readers;
+    for (int idx = 0; idx < 4; ++idx)
+        readers.emplace_back([shared, &total] { total.fetch_add(shared.get()); });
+    promise.set_value(2);
+    for (auto& reader : readers)
+        reader.join();
+    ensure_eq(8, total.load());
+}
+
+}
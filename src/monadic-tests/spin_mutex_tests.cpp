@@ -0,0 +1,96 @@
+/** \file
+ *  
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "test.hpp"
+
+#include <monadic/spin_mutex.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace monadic_tests
+{
+
+using namespace monadic;
+
+TEST(spin_mutex_try_lock)
+{
+    spin_mutex mtx;
+    ensure(mtx.try_lock());
+    ensure(!mtx.try_lock());
+    ensure(!mtx.try_lock_spins(100));
+    ensure(*mtx.native_handle());
+    mtx.unlock();
+    ensure(mtx.try_lock_spins(1));
+    mtx.unlock();
+    ensure(!mtx.try_lock_spins(0));
+}
+
+TEST(spin_mutex_try_lock_for)
+{
+    spin_mutex mtx;
+    std::lock_guard<spin_mutex> held(mtx);
+
+    auto start = std::chrono::steady_clock::now();
+    ensure(!mtx.try_lock_for(std::chrono::milliseconds(5)));
+    ensure(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(5));
+}
+
+TEST(spin_mutex_try_lock_until_past)
+{
+    spin_mutex mtx;
+    // An expiry in the past still gets one attempt.
+    ensure(mtx.try_lock_until(std::chrono::steady_clock::now() - std::chrono::seconds(1)));
+    ensure(!mtx.try_lock_until(std::chrono::steady_clock::now() - std::chrono::seconds(1)));
+    mtx.unlock();
+}
+
+TEST(spin_mutex_handoff)
+{
+    spin_mutex mtx;
+    mtx.lock();
+    std::thread other([&mtx]
+                      {
+                          std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                          mtx.unlock();
+                      }
+                     );
+    ensure(mtx.try_lock_for(std::chrono::seconds(10)));
+    other.join();
+    mtx.unlock();
+}
+
+TEST(spin_mutex_contention)
+{
+    static const std::size_t thread_count = 4;
+    static const std::size_t increments   = 50000;
+
+    spin_mutex  mtx;
+    std::size_t counter = 0;
+    std::vector<std::thread> threads;
+    for (std::size_t idx = 0; idx < thread_count; ++idx)
+        threads.emplace_back([&]
+                             {
+                                 for (std::size_t iter = 0; iter < increments; ++iter)
+                                 {
+                                     std::lock_guard<spin_mutex> lock(mtx);
+                                     ++counter;
+                                 }
+                             }
+                            );
+    for (auto& thread : threads)
+        thread.join();
+    ensure_eq(thread_count * increments, counter);
+}
+
+}
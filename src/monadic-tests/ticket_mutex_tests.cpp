@@ -0,0 +1,92 @@
+/** \file
+ *  
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "test.hpp"
+
+#include <monadic/ticket_mutex.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace monadic_tests
+{
+
+using namespace monadic;
+
+TEST(ticket_mutex_try_lock)
+{
+    ticket_mutex mtx;
+    ensure(mtx.try_lock());
+    ensure(!mtx.try_lock());
+    mtx.unlock();
+    ensure(mtx.try_lock());
+    mtx.unlock();
+
+    std::unique_lock<ticket_mutex> lock(mtx);
+    ensure(lock.owns_lock());
+}
+
+TEST(ticket_mutex_is_fifo)
+{
+    static const std::size_t thread_count = 4;
+
+    ticket_mutex mtx;
+    std::vector<std::size_t> order;
+    std::vector<std::thread> threads;
+    mtx.lock();
+    for (std::size_t idx = 0; idx < thread_count; ++idx)
+    {
+        threads.emplace_back([&, idx]
+                             {
+                                 std::lock_guard<ticket_mutex> lock(mtx);
+                                 order.push_back(idx);
+                             }
+                            );
+        // Give each thread time to get in line before starting the next one.
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    mtx.unlock();
+    for (auto& thread : threads)
+        thread.join();
+
+    ensure_eq(thread_count, order.size());
+    for (std::size_t idx = 0; idx < thread_count; ++idx)
+        ensure_eq(idx, order[idx]);
+}
+
+TEST(ticket_mutex_contention)
+{
+    static const std::size_t thread_count = 4;
+    static const std::size_t increments   = 20000;
+
+    ticket_mutex mtx;
+    std::size_t counter = 0;
+    std::vector<std::thread> threads;
+    for (std::size_t idx = 0; idx < thread_count; ++idx)
+        threads.emplace_back([&]
+                             {
+                                 for (std::size_t iter = 0; iter < increments; ++iter)
+                                 {
+                                     std::lock_guard<ticket_mutex> lock(mtx);
+                                     ++counter;
+                                 }
+                             }
+                            );
+    for (auto& thread : threads)
+        thread.join();
+    ensure_eq(thread_count * increments, counter);
+    ensure(mtx.try_lock());
+    mtx.unlock();
+}
+
+}
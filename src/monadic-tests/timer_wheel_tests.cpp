@@ -0,0 +1,174 @@
+/** \file
+ *
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "test.hpp"
+#include "util.hpp"
+
+#include <monadic/timer_wheel.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace monadic_tests
+{
+
+using namespace monadic;
+
+TEST(timer_wheel_after)
+{
+    timer_wheel timers;
+    auto start = std::chrono::steady_clock::now();
+    completion<void> c = timers.after(std::chrono::milliseconds(5));
+    ensure_eq(1U, timers.size());
+    c.get();
+    ensure(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(5));
+    ensure_eq(0U, timers.size());
+}
+
+TEST(timer_wheel_within_in_time)
+{
+    timer_wheel timers;
+    completion_promise<int> promise;
+    completion<int> c = promise.get_completion().within(timers, std::chrono::seconds(30));
+    ensure_eq(1U, timers.size());
+
+    promise.set_value(3);
+    ensure_eq(3, c.get());
+    // The value arrived, so the timer was cancelled.
+    ensure_eq(0U, timers.size());
+}
+
+TEST(timer_wheel_within_ready)
+{
+    timer_wheel timers;
+    completion_promise<int> promise;
+    promise.set_value(4);
+    completion<int> c = promise.get_completion().within(timers, std::chrono::seconds(30));
+    ensure_eq(0U, timers.size());
+    ensure_eq(4, c.get());
+}
+
+TEST(timer_wheel_within_timeout)
+{
+    timer_wheel timers;
+    completion_promise<int> promise;
+    std::size_t calls = 0;
+    completion<int> c = promise.get_completion()
+                               .map([&calls] (int x) { ++calls; return x; })
+                               .within(timers, std::chrono::milliseconds(2));
+    ensure_throws(completion_timeout, c.get());
+    ensure(promise.is_cancelled());
+
+    promise.set_value(1);
+    ensure_eq(0U, calls);
+}
+
+TEST(timer_wheel_within_timeout_continuation_throws)
+{
+    timer_wheel timers;
+    completion_promise<int> promise;
+    std::atomic<bool> thrown(false);
+    promise.get_completion()
+           .within(timers, std::chrono::milliseconds(2))
+           .on_complete([&thrown] (exceptional<int>)
+                        {
+                            thrown = true;
+                            throw std::runtime_error("continuation failed");
+                        }
+                       );
+    ensure(loop_until([&thrown] { return thrown.load(); }));
+
+    // The wheel kept the exception and is still running timers.
+    ensure(timers.after(std::chrono::milliseconds(1)).wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    ensure_throws(std::runtime_error, std::rethrow_exception(timers.take_exception()));
+    ensure(!timers.take_exception());
+}
+
+TEST(timer_wheel_order)
+{
+    timer_wheel timers;
+    std::mutex protect;
+    std::vector<int> fired;
+    std::vector<completion<void>> pending;
+    for (int delay : { 40, 10, 30, 20 })
+    {
+        pending.emplace_back(timers.after(std::chrono::milliseconds(delay))
+                                   .map([&, delay]
+                                        {
+                                            std::lock_guard<std::mutex> lock(protect);
+                                            fired.push_back(delay);
+                                        }
+                                       )
+                            );
+    }
+    for (auto& c : pending)
+        c.get();
+    ensure(fired == (std::vector<int> { 10, 20, 30, 40 }));
+}
+
+TEST(timer_wheel_cascade)
+{
+    // With a 1 microsecond tick, these delays land in the second and third levels and have to be cascaded down.
+    timer_wheel timers(std::chrono::microseconds(1));
+    auto start = std::chrono::steady_clock::now();
+    completion<void> near = timers.after(std::chrono::microseconds(500));
+    completion<void> far  = timers.after(std::chrono::milliseconds(70));
+    near.get();
+    ensure(std::chrono::steady_clock::now() - start >= std::chrono::microseconds(500));
+    far.get();
+    ensure(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(70));
+    ensure_eq(0U, timers.size());
+}
+
+TEST(timer_wheel_earlier_wakes_sleeper)
+{
+    // The thread sleeps until the far timer is due, so scheduling an earlier one has to wake it up.
+    timer_wheel timers;
+    completion<void> far = timers.after(std::chrono::hours(2));
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    auto start = std::chrono::steady_clock::now();
+    completion<void> near = timers.after(std::chrono::milliseconds(5));
+    near.get();
+    ensure(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+    ensure_eq(1U, timers.size());
+}
+
+TEST(timer_wheel_many)
+{
+    static const std::size_t count = 5000;
+    timer_wheel timers;
+    std::atomic<std::size_t> fired(0);
+    std::vector<completion<void>> pending;
+    for (std::size_t idx = 0; idx < count; ++idx)
+        pending.emplace_back(timers.after(std::chrono::milliseconds(idx % 20))
+                                   .map([&fired] { fired.fetch_add(1); })
+                            );
+    for (auto& c : pending)
+        c.get();
+    ensure_eq(count, fired.load());
+    ensure_eq(0U, timers.size());
+}
+
+TEST(timer_wheel_destroyed_with_pending)
+{
+    std::unique_ptr<timer_wheel> timers(new timer_wheel());
+    completion<void> c = timers->after(std::chrono::hours(1));
+    timers.reset();
+    ensure(c.state() == completion_state::no_value);
+}
+
+}
@@ -13,7 +13,11 @@
 
 #include "test.hpp"
 
+#include <monadic/executor.hpp>
+
 #include <chrono>
+#include <cstddef>
+#include <deque>
 #include <utility>
 
 namespace monadic_tests
@@ -36,6 +40,44 @@ bool loop_until(Predicate&& pred)
     return loop_until(std::forward<Predicate>(pred), std::chrono::steady_clock::now() + std::chrono::milliseconds(100));
 }
 
+/** An executor which queues tasks until \c run_all is called, so tests can observe what happens before and after a task
+ *  runs.
+**/
+class manual_executor
+{
+public:
+    template <typename F>
+    void execute(F&& task)
+    {
+        _tasks.emplace_back(std::forward<F>(task));
+    }
+    
+    std::size_t pending() const
+    {
+        return _tasks.size();
+    }
+    
+    /** Run tasks until none are left (including tasks which were queued by running tasks).
+     *  
+     *  \returns the number of tasks run.
+    **/
+    std::size_t run_all()
+    {
+        std::size_t count = 0;
+        while (!_tasks.empty())
+        {
+            monadic::executor_task task = std::move(_tasks.front());
+            _tasks.pop_front();
+            task();
+            ++count;
+        }
+        return count;
+    }
+    
+private:
+    std::deque<monadic::executor_task> _tasks;
+};
+
 }
 
 #endif/*__MONADIC_TESTS_UTIL_HPP_INCLUDED__*/
@@ -0,0 +1,141 @@
+/** \file
+ *  
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "test.hpp"
+#include "util.hpp"
+
+#include <monadic/when.hpp>
+
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace monadic_tests
+{
+
+using namespace monadic;
+
+TEST(when_all_range)
+{
+    std::vector<completion_promise<int>> promises(3);
+    std::vector<completion<int>> completions;
+    for (auto& p : promises)
+        completions.push_back(p.get_completion());
+
+    auto all = when_all(completions.begin(), completions.end());
+    promises[2].set_value(2);
+    promises[0].set_value(0);
+    ensure(all.state() == completion_state::no_value);
+    promises[1].set_exception(std::make_exception_ptr(std::runtime_error("1")));
+
+    std::vector<exceptional<int>> results = all.get();
+    ensure_eq(3U, results.size());
+    ensure_eq(0, results[0].get());
+    ensure_throws(std::runtime_error, results[1].get());
+    ensure_eq(2, results[2].get());
+}
+
+TEST(when_all_range_ready)
+{
+    std::vector<completion_promise<int>> promises(2);
+    std::vector<completion<int>> completions;
+    for (auto& p : promises)
+    {
+        p.set_value(5);
+        completions.push_back(p.get_completion());
+    }
+    auto all = when_all(completions.begin(), completions.end());
+    ensure(all.state() == completion_state::has_value);
+    ensure_eq(5, all.get()[1].get());
+}
+
+TEST(when_all_range_empty)
+{
+    std::vector<completion<int>> completions;
+    auto all = when_all(completions.begin(), completions.end());
+    ensure(all.get().empty());
+}
+
+TEST(when_all_variadic)
+{
+    completion_promise<int>         p1;
+    completion_promise<std::string> p2;
+    completion_promise<void>        p3;
+    auto all = when_all(p1.get_completion(), p2.get_completion(), p3.get_completion());
+    p3.set_value();
+    p2.set_value("two");
+    ensure(all.state() == completion_state::no_value);
+    p1.set_value(1);
+
+    auto results = all.get();
+    ensure_eq(1, std::get<0>(results).get());
+    ensure_eq(std::string("two"), std::get<1>(results).get());
+    ensure(std::get<2>(results).is_success());
+}
+
+TEST(when_all_threads)
+{
+    static const int count = 64;
+    std::vector<completion_promise<int>> promises(count);
+    std::vector<completion<int>> completions;
+    for (auto& p : promises)
+        completions.push_back(p.get_completion());
+    auto all = when_all(completions.begin(), completions.end());
+
+    std::vector<std::thread> threads;
+    for (int idx = 0; idx < count; ++idx)
+        threads.emplace_back([&, idx] { promises[idx].set_value(idx); });
+    auto results = all.get();
+    for (auto& t : threads)
+        t.join();
+    for (int idx = 0; idx < count; ++idx)
+        ensure_eq(idx, results[idx].get());
+}
+
+TEST(when_any_disables_losers)
+{
+    std::vector<completion_promise<int>> promises(3);
+    std::vector<completion<int>> completions;
+    for (auto& p : promises)
+        completions.push_back(p.get_completion());
+
+    auto any = when_any(completions.begin(), completions.end());
+    promises[1].set_value(10);
+
+    when_any_result<int> result = any.get();
+    ensure_eq(1U, result.index);
+    ensure_eq(10, result.value.get());
+    ensure(completions[0].state() == completion_state::disabled);
+    ensure(completions[2].state() == completion_state::disabled);
+
+    // The losers' producers are free to deliver (or not) -- it goes nowhere.
+    promises[0].set_value(0);
+}
+
+TEST(when_any_ready)
+{
+    std::vector<completion_promise<int>> promises(2);
+    promises[1].set_value(3);
+    std::vector<completion<int>> completions { promises[0].get_completion(), promises[1].get_completion() };
+
+    auto any = when_any(completions.begin(), completions.end());
+    ensure_eq(1U, any.get().index);
+    ensure(completions[0].state() == completion_state::disabled);
+}
+
+TEST(when_any_empty_throws)
+{
+    std::vector<completion<int>> completions;
+    ensure_throws(std::invalid_argument, when_any(completions.begin(), completions.end()));
+}
+
+}
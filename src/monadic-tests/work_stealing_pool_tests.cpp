@@ -0,0 +1,153 @@
+/** \file
+ *  
+ *  Copyright (c) 2015 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "test.hpp"
+#include "util.hpp"
+
+#include <monadic/work_stealing_pool.hpp>
+
+#include <atomic>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace monadic_tests
+{
+
+using namespace monadic;
+
+TEST(work_stealing_deque_owner_is_lifo)
+{
+    detail::work_stealing_deque<int> deque(2);
+    int items[5] = { 0, 1, 2, 3, 4 };
+    for (int& x : items)
+        deque.push(&x);
+    for (int idx = 4; idx >= 0; --idx)
+        ensure(deque.pop() == &items[idx]);
+    ensure(deque.pop() == nullptr);
+    ensure(deque.empty());
+}
+
+TEST(work_stealing_deque_thief_is_fifo)
+{
+    detail::work_stealing_deque<int> deque;
+    int items[3] = { 0, 1, 2 };
+    for (int& x : items)
+        deque.push(&x);
+    ensure(deque.steal() == &items[0]);
+    ensure(deque.steal() == &items[1]);
+    ensure(deque.pop() == &items[2]);
+    ensure(deque.steal() == nullptr);
+}
+
+TEST(work_stealing_deque_race)
+{
+    static const int item_count = 100000;
+    std::vector<int> items(item_count);
+    std::vector<std::atomic<int>> taken(item_count);
+    detail::work_stealing_deque<int> deque(16);
+    std::atomic<bool> done(false);
+
+    std::vector<std::thread> thieves;
+    for (int idx = 0; idx < 3; ++idx)
+        thieves.emplace_back([&]
+                             {
+                                 while (!done.load())
+                                     if (int* x = deque.steal())
+                                         ++taken[x - items.data()];
+                             }
+                            );
+
+    for (int idx = 0; idx < item_count; ++idx)
+    {
+        deque.push(&items[idx]);
+        if (idx % 3 == 0)
+            if (int* x = deque.pop())
+                ++taken[x - items.data()];
+    }
+    while (int* x = deque.pop())
+        ++taken[x - items.data()];
+    while (!deque.empty())
+        std::this_thread::yield();
+    done = true;
+    for (auto& t : thieves)
+        t.join();
+
+    for (auto& count : taken)
+        ensure_eq(1, count.load());
+}
+
+TEST(work_stealing_pool_submit)
+{
+    work_stealing_pool pool(2);
+    ensure_eq(2U, pool.size());
+    completion<int> c = pool.submit([] { return 6 * 7; });
+    ensure_eq(42, c.get());
+}
+
+TEST(work_stealing_pool_submit_throws)
+{
+    work_stealing_pool pool(2);
+    completion<int> c = pool.submit([] () -> int { throw std::runtime_error("boom"); });
+    ensure_throws(std::runtime_error, c.get());
+}
+
+TEST(work_stealing_pool_execute_throws)
+{
+    std::atomic<int> ran(0);
+    std::exception_ptr error;
+    {
+        work_stealing_pool pool(1);
+        pool.execute([] { throw std::runtime_error("first"); });
+        pool.execute([] { throw std::logic_error("second"); });
+        pool.execute([&ran] { ++ran; });
+        ensure(loop_until([&ran] { return ran.load() == 1; }));
+        error = pool.take_exception();
+        ensure(!pool.take_exception());
+    }
+    // The worker survived the throwing tasks, and the first exception was kept.
+    ensure_throws(std::runtime_error, std::rethrow_exception(error));
+}
+
+TEST(work_stealing_pool_zero_threads_throws)
+{
+    ensure_throws(std::invalid_argument, work_stealing_pool(0));
+}
+
+TEST(work_stealing_pool_map_on)
+{
+    work_stealing_pool pool(2);
+    completion_promise<int> promise;
+    completion<std::thread::id> c = promise.get_completion()
+                                           .map_on(pool, [] (int) { return std::this_thread::get_id(); });
+    promise.set_value(1);
+    ensure(c.get() != std::this_thread::get_id());
+}
+
+TEST(work_stealing_pool_nested_submit)
+{
+    static const int fan_out = 1000;
+    std::atomic<int> ran(0);
+    {
+        work_stealing_pool pool(4);
+        for (int outer = 0; outer < 4; ++outer)
+            pool.execute([&]
+                         {
+                             for (int inner = 0; inner < fan_out; ++inner)
+                                 pool.execute([&] { ++ran; });
+                         }
+                        );
+    }
+    // The destructor waits for every queued task -- including the ones queued from inside the pool.
+    ensure_eq(4 * fan_out, ran.load());
+}
+
+}